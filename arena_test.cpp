@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <pthread.h>
 #include "util/arena.h"
@@ -7,8 +8,12 @@
 static void test_multi_threaded();
 static void* allocator(void* arg);
 static void test_single_thread();
+static void test_alignment(bool huge_pages);
+static void test_rewind();
+static void test_many_arenas();
 
 static const unsigned kNumberAllocators = 40;
+static const unsigned kNumberArenas = 4096;
 
 int main(int argc, char** argv)
 {
@@ -16,6 +21,10 @@ int main(int argc, char** argv)
 		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
 		fprintf(stderr, "\t0: Test allocator with %u threads.\n", kNumberAllocators);
 		fprintf(stderr, "\t1: Test allocator with 1 thread.\n");
+		fprintf(stderr, "\t2: Test aligned allocations with growing blocks.\n");
+		fprintf(stderr, "\t3: Test aligned allocations with huge pages.\n");
+		fprintf(stderr, "\t4: Test mark / rewind / reset.\n");
+		fprintf(stderr, "\t5: Test %u concurrent arenas (more than PTHREAD_KEYS_MAX).\n", kNumberArenas);
 		return -1;
 	}
 
@@ -26,6 +35,18 @@ int main(int argc, char** argv)
 		case 1:
 			test_single_thread();
 			break;
+		case 2:
+			test_alignment(false);
+			break;
+		case 3:
+			test_alignment(true);
+			break;
+		case 4:
+			test_rewind();
+			break;
+		case 5:
+			test_many_arenas();
+			break;
 		default:
 			fprintf(stderr, "Wrong test number %s.\n", argv[1]);
 			return -1;
@@ -37,6 +58,10 @@ int main(int argc, char** argv)
 void test_multi_threaded()
 {
 	util::concurrent::arena arena;
+	if (!arena.init()) {
+		fprintf(stderr, "Couldn't initialize arena.\n");
+		return;
+	}
 
 	// Create allocators.
 	pthread_t allocators[kNumberAllocators];
@@ -82,3 +107,146 @@ void test_single_thread()
 
 	printf("Allocated %u bytes.\n", arena.count());
 }
+
+void test_alignment(bool huge_pages)
+{
+	util::arena arena(4 * 1024, 1024 * 1024, huge_pages);
+
+	static const size_t alignments[] = {1, 8, 16, 64, 4096};
+
+	for (size_t i = 1; i <= 8 * 1024; i++) {
+		size_t alignment = alignments[i % (sizeof(alignments) / sizeof(*alignments))];
+
+		char* p;
+		if ((p = reinterpret_cast<char*>(arena.allocate(i, alignment))) == NULL) {
+			fprintf(stderr, "Couldn't allocate %u bytes.\n", i);
+			return;
+		}
+
+		if ((reinterpret_cast<uintptr_t>(p) % alignment) != 0) {
+			fprintf(stderr, "Allocation of %u bytes is not aligned to %u bytes.\n", i, alignment);
+			return;
+		}
+
+		// Touch the memory.
+		p[0] = 0;
+		p[i - 1] = 0;
+	}
+
+	printf("Allocated %u bytes.\n", arena.count());
+}
+
+void test_rewind()
+{
+	util::arena arena;
+
+	size_t size = 0;
+
+	for (unsigned request = 0; request < 1000; request++) {
+		// Allocations which live for the whole request.
+		for (size_t i = 1; i <= 1024; i++) {
+			if (!arena.allocate(i)) {
+				fprintf(stderr, "Couldn't allocate %u bytes.\n", i);
+				return;
+			}
+		}
+
+		util::arena::position pos = arena.mark();
+		size_t count = arena.count();
+
+		// Temporary allocations.
+		for (size_t i = 1; i <= 1024; i++) {
+			if (!arena.allocate(i)) {
+				fprintf(stderr, "Couldn't allocate %u bytes.\n", i);
+				return;
+			}
+		}
+
+		arena.rewind(pos);
+
+		if (arena.count() != count) {
+			fprintf(stderr, "Wrong count after rewind (%u, expected %u).\n", arena.count(), count);
+			return;
+		}
+
+		arena.reset();
+
+		if (arena.count() != 0) {
+			fprintf(stderr, "Wrong count after reset (%u).\n", arena.count());
+			return;
+		}
+
+		// After the first request, the blocks should be reused.
+		if (request == 0) {
+			size = arena.size();
+		} else if (arena.size() != size) {
+			fprintf(stderr, "Blocks not reused (%u bytes, expected %u).\n", arena.size(), size);
+			return;
+		}
+	}
+
+	// A small allocation after a big one should reuse a small free block.
+	util::arena a;
+	if ((!a.allocate(8)) || (a.size() != util::arena::kDefaultBlockSize)) {
+		fprintf(stderr, "Wrong block size (%u bytes, expected %u).\n", a.size(), util::arena::kDefaultBlockSize);
+		return;
+	}
+
+	if (!a.allocate(2 * util::arena::kDefaultBlockSize)) {
+		fprintf(stderr, "Couldn't allocate %u bytes.\n", 2 * util::arena::kDefaultBlockSize);
+		return;
+	}
+
+	size = a.size();
+	a.reset();
+
+	if ((!a.allocate(2 * util::arena::kDefaultBlockSize)) || (!a.allocate(8))) {
+		fprintf(stderr, "Couldn't allocate after reset.\n");
+		return;
+	}
+
+	if (a.size() != size) {
+		fprintf(stderr, "Free blocks not reused (%u bytes, expected %u).\n", a.size(), size);
+		return;
+	}
+
+	printf("High water: %u bytes, size: %u bytes.\n", arena.high_water(), arena.size());
+}
+
+void test_many_arenas()
+{
+	util::concurrent::arena* arenas[kNumberArenas];
+
+	for (unsigned i = 0; i < kNumberArenas; i++) {
+		arenas[i] = new util::concurrent::arena();
+
+		if (!arenas[i]->init()) {
+			fprintf(stderr, "Couldn't initialize arena %u.\n", i);
+			return;
+		}
+
+		if (!arenas[i]->allocate(16)) {
+			fprintf(stderr, "Couldn't allocate from arena %u.\n", i);
+			return;
+		}
+	}
+
+	// Allocate again from every arena (the records of this thread are
+	// reused).
+	size_t count = 0;
+	for (unsigned i = 0; i < kNumberArenas; i++) {
+		if (!arenas[i]->allocate(16)) {
+			fprintf(stderr, "Couldn't allocate from arena %u.\n", i);
+			return;
+		}
+
+		count += arenas[i]->count();
+	}
+
+	// Destroy the arenas while the records of this thread are in use.
+	for (unsigned i = 0; i < kNumberArenas; i++) {
+		delete arenas[i];
+	}
+
+	printf("Allocated %u bytes from %u arenas.\n", count, kNumberArenas);
+}
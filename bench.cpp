@@ -0,0 +1,696 @@
+// Benchmark for the data structures.
+//
+// Every thread runs a mix of reads, writes and erases on random keys
+// (uniform or zipfian distribution) and measures the latency of every
+// operation. The results are printed as one JSON object per line.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "util/concurrent/skiplist.h"
+#include "util/concurrent/insert_only_skiplist.h"
+#include "util/concurrent/skiplist_map.h"
+#include "util/concurrent/arena.h"
+#include "util/concurrent/locks/mutex.h"
+#include "util/red_black_tree.h"
+#include "util/fifo.h"
+#include "util/random.h"
+
+static const unsigned kMaxThreads = 256;
+
+// Latency histogram: values < 2^kSubBucketBits are stored in their own
+// bucket, bigger values in 2^kSubBucketBits buckets per power of two.
+static const unsigned kSubBucketBits = 4;
+static const unsigned kSubBuckets = 1 << kSubBucketBits;
+static const unsigned kNumberBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+struct longcmp {
+	int operator()(long x, long y) const
+	{
+		return (x < y) ? -1 : ((x > y) ? 1 : 0);
+	}
+};
+
+enum distribution {
+	DISTRIBUTION_UNIFORM,
+	DISTRIBUTION_ZIPFIAN
+};
+
+struct options {
+	const char* structure;
+	unsigned threads;
+	unsigned long operations;
+	unsigned reads;
+	unsigned writes;
+	unsigned erases;
+	unsigned long keys;
+	distribution dist;
+	double theta;
+};
+
+// Data structure under test.
+class target {
+	public:
+		// Destructor.
+		virtual ~target();
+
+		// Initialize.
+		virtual bool init() = 0;
+
+		// Read (returns true if the key has been found).
+		virtual bool read(long k) = 0;
+
+		// Write.
+		virtual void write(long k) = 0;
+
+		// Erase.
+		virtual void erase(long k) = 0;
+};
+
+class skiplist_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::concurrent::skiplist<long, longcmp> _M_list;
+};
+
+// Erases are lookups (the list doesn't support erasing).
+class insert_only_skiplist_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::concurrent::insert_only_skiplist<long, longcmp> _M_list;
+};
+
+class skiplist_map_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::concurrent::skiplist_map<long, long, longcmp> _M_map;
+};
+
+// The red-black tree is not thread-safe, it is protected by a mutex.
+class red_black_tree_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::red_black_tree<long, long, longcmp> _M_tree;
+		util::concurrent::locks::mutex _M_lock;
+};
+
+// Reads allocate 16 bytes, writes allocate up to 256 bytes (erases are
+// no-ops, the arena doesn't free memory).
+class arena_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::concurrent::arena _M_arena;
+};
+
+// The fifo is not thread-safe, it is protected by a mutex.
+// Reads get the front element, writes push and erases pop.
+class fifo_target : public target {
+	public:
+		// Initialize.
+		bool init();
+
+		// Read.
+		bool read(long k);
+
+		// Write.
+		void write(long k);
+
+		// Erase.
+		void erase(long k);
+
+	private:
+		util::fifo<long> _M_fifo;
+		util::concurrent::locks::mutex _M_lock;
+};
+
+// Zipfian generator, from: "Quickly Generating Billion-Record Synthetic
+// Databases", by Gray, Sundaresan, Englert, Baclawski and Weinberger.
+class zipfian {
+	public:
+		// Initialize.
+		void init(unsigned long n, double theta);
+
+		// Get next value (0 is the most popular value).
+		unsigned long next(util::xorshift& rnd) const;
+
+	private:
+		unsigned long _M_n;
+		double _M_theta;
+		double _M_alpha;
+		double _M_zetan;
+		double _M_eta;
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned id;
+
+	const options* opts;
+	target* t;
+	const zipfian* zipf;
+
+	// Number of reads which found the key.
+	uint64_t hits;
+
+	uint64_t histogram[kNumberBuckets];
+};
+
+static bool parse_options(int argc, char** argv, options& opts);
+static void usage(const char* program);
+static target* create_target(const char* structure);
+static void* run(void* arg);
+static uint64_t now();
+static unsigned bucket(uint64_t ns);
+static uint64_t bucket_value(unsigned b);
+static uint64_t percentile(const uint64_t* histogram, uint64_t count, double p);
+
+int main(int argc, char** argv)
+{
+	options opts;
+	if (!parse_options(argc, argv, opts)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	target* t;
+	if ((t = create_target(opts.structure)) == NULL) {
+		fprintf(stderr, "Unknown data structure '%s'.\n", opts.structure);
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (!t->init()) {
+		fprintf(stderr, "Couldn't initialize data structure.\n");
+		delete t;
+		return -1;
+	}
+
+	// Insert half of the keys.
+	for (unsigned long i = 0; i < opts.keys; i += 2) {
+		t->write(i);
+	}
+
+	zipfian zipf;
+	if (opts.dist == DISTRIBUTION_ZIPFIAN) {
+		zipf.init(opts.keys, opts.theta);
+	}
+
+	worker* workers;
+	if ((workers = reinterpret_cast<worker*>(calloc(opts.threads, sizeof(worker)))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory for the workers.\n");
+		delete t;
+		return -1;
+	}
+
+	uint64_t start = now();
+
+	// Create workers.
+	for (unsigned i = 0; i < opts.threads; i++) {
+		workers[i].id = i;
+		workers[i].opts = &opts;
+		workers[i].t = t;
+		workers[i].zipf = &zipf;
+
+		if (pthread_create(&workers[i].thread, NULL, run, &workers[i]) != 0) {
+			fprintf(stderr, "Couldn't create worker %u.\n", i);
+			exit(-1);
+		}
+	}
+
+	// Wait for workers.
+	for (unsigned i = 0; i < opts.threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	uint64_t elapsed = now() - start;
+
+	// Merge histograms.
+	uint64_t histogram[kNumberBuckets];
+	memset(histogram, 0, sizeof(histogram));
+
+	uint64_t hits = 0;
+
+	for (unsigned i = 0; i < opts.threads; i++) {
+		hits += workers[i].hits;
+
+		for (unsigned j = 0; j < kNumberBuckets; j++) {
+			histogram[j] += workers[i].histogram[j];
+		}
+	}
+
+	uint64_t count = static_cast<uint64_t>(opts.threads) * opts.operations;
+
+	printf("{\"structure\":\"%s\",\"threads\":%u,\"operations\":%llu,"
+	       "\"reads\":%u,\"writes\":%u,\"erases\":%u,\"keys\":%lu,"
+	       "\"distribution\":\"%s\",\"hits\":%llu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+	       "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+	       opts.structure,
+	       opts.threads,
+	       static_cast<unsigned long long>(count),
+	       opts.reads,
+	       opts.writes,
+	       opts.erases,
+	       opts.keys,
+	       (opts.dist == DISTRIBUTION_UNIFORM) ? "uniform" : "zipfian",
+	       static_cast<unsigned long long>(hits),
+	       elapsed / 1000000000.0,
+	       count / (elapsed / 1000000000.0),
+	       static_cast<unsigned long long>(percentile(histogram, count, 0.5)),
+	       static_cast<unsigned long long>(percentile(histogram, count, 0.99)),
+	       static_cast<unsigned long long>(percentile(histogram, count, 0.999)),
+	       static_cast<unsigned long long>(percentile(histogram, count, 1.0)));
+
+	free(workers);
+	delete t;
+
+	return 0;
+}
+
+bool parse_options(int argc, char** argv, options& opts)
+{
+	opts.structure = "skiplist";
+	opts.threads = 1;
+	opts.operations = 1000000;
+	opts.reads = 80;
+	opts.writes = 10;
+	opts.erases = 10;
+	opts.keys = 1000000;
+	opts.dist = DISTRIBUTION_UNIFORM;
+	opts.theta = 0.99;
+
+	int c;
+	while ((c = getopt(argc, argv, "s:t:n:r:w:e:k:d:z:")) != -1) {
+		switch (c) {
+			case 's':
+				opts.structure = optarg;
+				break;
+			case 't':
+				opts.threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				opts.operations = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				opts.reads = strtoul(optarg, NULL, 10);
+				break;
+			case 'w':
+				opts.writes = strtoul(optarg, NULL, 10);
+				break;
+			case 'e':
+				opts.erases = strtoul(optarg, NULL, 10);
+				break;
+			case 'k':
+				opts.keys = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				if (strcasecmp(optarg, "uniform") == 0) {
+					opts.dist = DISTRIBUTION_UNIFORM;
+				} else if (strcasecmp(optarg, "zipfian") == 0) {
+					opts.dist = DISTRIBUTION_ZIPFIAN;
+				} else {
+					fprintf(stderr, "Unknown distribution '%s'.\n", optarg);
+					return false;
+				}
+
+				break;
+			case 'z':
+				opts.theta = strtod(optarg, NULL);
+				break;
+			default:
+				return false;
+		}
+	}
+
+	if ((opts.threads == 0) || (opts.threads > kMaxThreads)) {
+		fprintf(stderr, "Number of threads must be between 1 and %u.\n", kMaxThreads);
+		return false;
+	}
+
+	if (opts.reads + opts.writes + opts.erases != 100) {
+		fprintf(stderr, "Reads + writes + erases must be 100.\n");
+		return false;
+	}
+
+	if (opts.keys == 0) {
+		fprintf(stderr, "Number of keys must be greater than 0.\n");
+		return false;
+	}
+
+	if ((opts.theta <= 0.0) || (opts.theta >= 1.0)) {
+		fprintf(stderr, "Zipfian theta must be between 0 and 1.\n");
+		return false;
+	}
+
+	return true;
+}
+
+void usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [options]\n", program);
+	fprintf(stderr, "\t-s <structure>: skiplist, insert_only_skiplist, skiplist_map, red_black_tree, arena, fifo (default: skiplist).\n");
+	fprintf(stderr, "\t-t <threads>: number of threads (default: 1).\n");
+	fprintf(stderr, "\t-n <operations>: number of operations per thread (default: 1000000).\n");
+	fprintf(stderr, "\t-r <percentage>: percentage of reads (default: 80).\n");
+	fprintf(stderr, "\t-w <percentage>: percentage of writes (default: 10).\n");
+	fprintf(stderr, "\t-e <percentage>: percentage of erases (default: 10).\n");
+	fprintf(stderr, "\t-k <keys>: number of keys (default: 1000000).\n");
+	fprintf(stderr, "\t-d <distribution>: uniform, zipfian (default: uniform).\n");
+	fprintf(stderr, "\t-z <theta>: zipfian theta (default: 0.99).\n");
+}
+
+target* create_target(const char* structure)
+{
+	if (strcmp(structure, "skiplist") == 0) {
+		return new (std::nothrow) skiplist_target();
+	} else if (strcmp(structure, "insert_only_skiplist") == 0) {
+		return new (std::nothrow) insert_only_skiplist_target();
+	} else if (strcmp(structure, "skiplist_map") == 0) {
+		return new (std::nothrow) skiplist_map_target();
+	} else if (strcmp(structure, "red_black_tree") == 0) {
+		return new (std::nothrow) red_black_tree_target();
+	} else if (strcmp(structure, "arena") == 0) {
+		return new (std::nothrow) arena_target();
+	} else if (strcmp(structure, "fifo") == 0) {
+		return new (std::nothrow) fifo_target();
+	}
+
+	return NULL;
+}
+
+void* run(void* arg)
+{
+	worker* w = reinterpret_cast<worker*>(arg);
+	const options* opts = w->opts;
+
+	util::xorshift rnd(w->id + 1);
+
+	for (unsigned long i = 0; i < opts->operations; i++) {
+		// The key and the operation are drawn independently.
+		long k;
+		if (opts->dist == DISTRIBUTION_UNIFORM) {
+			k = rnd.next() % opts->keys;
+		} else {
+			k = w->zipf->next(rnd);
+		}
+
+		unsigned op = rnd.next() % 100;
+
+		uint64_t start = now();
+
+		if (op < opts->reads) {
+			w->hits += w->t->read(k);
+		} else if (op < opts->reads + opts->writes) {
+			w->t->write(k);
+		} else {
+			w->t->erase(k);
+		}
+
+		w->histogram[bucket(now() - start)]++;
+	}
+
+	return NULL;
+}
+
+uint64_t now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+}
+
+unsigned bucket(uint64_t ns)
+{
+	if (ns < kSubBuckets) {
+		return ns;
+	}
+
+	// Position of the most significant bit.
+	unsigned msb = 63 - __builtin_clzll(ns);
+
+	// Use the 'kSubBucketBits' bits after the most significant bit.
+	unsigned sub = (ns >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+
+	return ((msb - kSubBucketBits + 1) * kSubBuckets) + sub;
+}
+
+uint64_t bucket_value(unsigned b)
+{
+	if (b < kSubBuckets) {
+		return b;
+	}
+
+	unsigned msb = (b / kSubBuckets) + kSubBucketBits - 1;
+	uint64_t sub = b % kSubBuckets;
+
+	// Upper bound of the bucket.
+	return (((static_cast<uint64_t>(kSubBuckets) + sub + 1) << (msb - kSubBucketBits))) - 1;
+}
+
+uint64_t percentile(const uint64_t* histogram, uint64_t count, double p)
+{
+	uint64_t threshold = static_cast<uint64_t>(ceil(count * p));
+	if (threshold == 0) {
+		threshold = 1;
+	}
+
+	uint64_t n = 0;
+	for (unsigned b = 0; b < kNumberBuckets; b++) {
+		if ((n += histogram[b]) >= threshold) {
+			return bucket_value(b);
+		}
+	}
+
+	return 0;
+}
+
+target::~target()
+{
+}
+
+bool skiplist_target::init()
+{
+	return _M_list.init();
+}
+
+bool skiplist_target::read(long k)
+{
+	return _M_list.contains(k);
+}
+
+void skiplist_target::write(long k)
+{
+	_M_list.insert(k);
+}
+
+void skiplist_target::erase(long k)
+{
+	_M_list.erase(k);
+}
+
+bool insert_only_skiplist_target::init()
+{
+	return _M_list.init();
+}
+
+bool insert_only_skiplist_target::read(long k)
+{
+	return _M_list.contains(k);
+}
+
+void insert_only_skiplist_target::write(long k)
+{
+	_M_list.insert(k);
+}
+
+void insert_only_skiplist_target::erase(long k)
+{
+	_M_list.contains(k);
+}
+
+bool skiplist_map_target::init()
+{
+	return _M_map.init();
+}
+
+bool skiplist_map_target::read(long k)
+{
+	long v;
+	return _M_map.get(k, v);
+}
+
+void skiplist_map_target::write(long k)
+{
+	_M_map.insert_or_assign(k, k);
+}
+
+void skiplist_map_target::erase(long k)
+{
+	_M_map.erase(k);
+}
+
+bool red_black_tree_target::init()
+{
+	return true;
+}
+
+bool red_black_tree_target::read(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	util::red_black_tree<long, long, longcmp>::iterator it;
+	return _M_tree.find(k, it);
+}
+
+void red_black_tree_target::write(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	_M_tree.insert(k, k);
+}
+
+void red_black_tree_target::erase(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	_M_tree.erase(k);
+}
+
+bool arena_target::init()
+{
+	return _M_arena.init();
+}
+
+bool arena_target::read(long k)
+{
+	return (_M_arena.allocate(16) != NULL);
+}
+
+void arena_target::write(long k)
+{
+	_M_arena.allocate(1 + (k % 256));
+}
+
+void arena_target::erase(long k)
+{
+}
+
+bool fifo_target::init()
+{
+	return true;
+}
+
+bool fifo_target::read(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	return (_M_fifo.front() != NULL);
+}
+
+void fifo_target::write(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	_M_fifo.push(k);
+}
+
+void fifo_target::erase(long k)
+{
+	util::concurrent::locks::scoped_lock lock(_M_lock);
+	_M_fifo.pop();
+}
+
+void zipfian::init(unsigned long n, double theta)
+{
+	_M_n = n;
+	_M_theta = theta;
+	_M_alpha = 1.0 / (1.0 - theta);
+
+	_M_zetan = 0.0;
+	for (unsigned long i = 1; i <= n; i++) {
+		_M_zetan += 1.0 / pow(i, theta);
+	}
+
+	double zeta2 = 1.0 + (1.0 / pow(2.0, theta));
+
+	_M_eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - (zeta2 / _M_zetan));
+}
+
+unsigned long zipfian::next(util::xorshift& rnd) const
+{
+	// Uniform number in [0, 1).
+	double u = (rnd.next() >> 11) * (1.0 / 9007199254740992.0);
+	double uz = u * _M_zetan;
+
+	if (uz < 1.0) {
+		return 0;
+	}
+
+	if (uz < 1.0 + pow(0.5, _M_theta)) {
+		return (_M_n > 1) ? 1 : 0;
+	}
+
+	unsigned long v = static_cast<unsigned long>(_M_n * pow((_M_eta * u) - _M_eta + 1.0, _M_alpha));
+
+	return (v < _M_n) ? v : _M_n - 1;
+}
@@ -4,14 +4,97 @@
 #include <unistd.h>
 #include <endian.h>
 #include <stdio.h>
+#include <time.h>
 #include "util/file_block_reader.h"
+#include "util/mmap_block_reader.h"
+#include "util/uring_block_reader.h"
+#include "util/parallel_block_scanner.h"
+#include "util/block_writer.h"
+#include "util/block_index.h"
+#include "util/lz.h"
+#include "util/crc32c.h"
 #include "fs/file.h"
 #include "string/buffer.h"
+#include "macros/macros.h"
 
-int main()
+static const char* kFilename = "blocks.bin";
+
+// util::lz::bound(util::block::kMaxSize).
+static const size_t kMaxCompressedSize = util::block::kMaxSize + (util::block::kMaxSize / 255) + 16;
+
+static int test_file_block_reader();
+
+static int test_mmap_block_reader();
+
+static int test_buffer_sizes();
+
+static int test_next_batch();
+
+static int test_uring_block_reader();
+
+static int test_parallel_block_scanner();
+
+static int test_block_writer();
+
+static int test_compression();
+static bool test_lz(const unsigned char* data, size_t len);
+static size_t make_text(size_t n, unsigned char* buf);
+
+static int test_checksums();
+
+static int test_invalid_headers();
+
+static bool write_blocks(fs::file& f, size_t size, size_t count, size_t first = 0);
+static bool check_block(const util::block& block, size_t size, size_t n);
+static bool read_sync_marker(fs::file& f, unsigned char* marker);
+
+int main(int argc, char** argv)
 {
-	static const char* kFilename = "blocks.bin";
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
+		fprintf(stderr, "\t0: Test file block reader.\n");
+		fprintf(stderr, "\t1: Test mmap block reader.\n");
+		fprintf(stderr, "\t2: Test file block reader with different buffer sizes.\n");
+		fprintf(stderr, "\t3: Test batched iteration of small blocks.\n");
+		fprintf(stderr, "\t4: Test io_uring block reader.\n");
+		fprintf(stderr, "\t5: Test parallel block scanner.\n");
+		fprintf(stderr, "\t6: Test block writer and block index.\n");
+		fprintf(stderr, "\t7: Test compressed blocks.\n");
+		fprintf(stderr, "\t8: Test checksums.\n");
+		fprintf(stderr, "\t9: Test invalid block headers.\n");
+
+		return -1;
+	}
 
+	switch (atoi(argv[1])) {
+		case 0:
+			return test_file_block_reader();
+		case 1:
+			return test_mmap_block_reader();
+		case 2:
+			return test_buffer_sizes();
+		case 3:
+			return test_next_batch();
+		case 4:
+			return test_uring_block_reader();
+		case 5:
+			return test_parallel_block_scanner();
+		case 6:
+			return test_block_writer();
+		case 7:
+			return test_compression();
+		case 8:
+			return test_checksums();
+		case 9:
+			return test_invalid_headers();
+		default:
+			fprintf(stderr, "Invalid test number %s.\n", argv[1]);
+			return -1;
+	}
+}
+
+int test_file_block_reader()
+{
 	fs::file f;
 	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
 		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
@@ -104,7 +187,7 @@ int main()
 				return -1;
 			}
 
-			if (i <= util::block_reader::kBufferSize) {
+			if (i <= block_reader.buffer_size()) {
 				if (b.count() > 0) {
 					fprintf(stderr, "Buffer contains data (%lu bytes), it should be empty.\n", b.count());
 
@@ -166,3 +249,1304 @@ int main()
 
 	return 0;
 }
+
+int test_mmap_block_reader()
+{
+	static const size_t kMaxSize = util::block::kMaxSize;
+	static const size_t kNumberBlocks = 64;
+
+	// Block sizes (use a small window to force remapping).
+	static const size_t sizes[] = {util::block::kMinSize, 5, 100, 4095, 4096, 4097, 65536, kMaxSize - 1, kMaxSize};
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+		return -1;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+		printf("Block size: %lu.\n", sizes[i]);
+
+		if (!write_blocks(f, sizes[i], kNumberBlocks)) {
+			fprintf(stderr, "Error writing blocks of %lu bytes.\n", sizes[i]);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	util::mmap_block_reader block_reader(f, 0, 0);
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+		for (size_t j = 0; j < kNumberBlocks; j++) {
+			util::block block;
+			if ((!block_reader.next(block)) || (!check_block(block, sizes[i], j))) {
+				fprintf(stderr, "Couldn't read block of %lu bytes.\n", sizes[i]);
+
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+	}
+
+	// Append a block after having reached the end of the file.
+	util::block block;
+	util::block_reader::error err;
+	if ((block_reader.next(block, err)) || (err != util::block_reader::kEndOfFile)) {
+		fprintf(stderr, "End of file expected.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	if ((!write_blocks(f, 100, 1)) || (!block_reader.next(block)) || (!check_block(block, 100, 0))) {
+		fprintf(stderr, "Couldn't read appended block.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// Block too big.
+	unsigned char buf[util::block::kMinSize];
+	util::blocklen_t n = htobe32(kMaxSize + 1);
+	memcpy(buf, &n, sizeof(buf));
+
+	if ((!f.write(buf, sizeof(buf))) || (block_reader.next(block, err)) || (err != util::block_reader::kBlockTooBig)) {
+		fprintf(stderr, "Block too big expected.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_buffer_sizes()
+{
+	static const size_t kMaxSize = util::block::kMaxSize;
+	static const size_t kNumberBlocks = 64;
+
+	static const size_t buffer_sizes[] = {util::block::kMinSize, 4096, 64 * 1024, util::block_reader::kDefaultBufferSize};
+	static const size_t sizes[] = {util::block::kMinSize, 5, 100, 4095, 4096, 4097, 65536, kMaxSize - 1, kMaxSize};
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+		return -1;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+		if (!write_blocks(f, sizes[i], kNumberBlocks)) {
+			fprintf(stderr, "Error writing blocks of %lu bytes.\n", sizes[i]);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(buffer_sizes); i++) {
+		printf("Buffer size: %lu.\n", buffer_sizes[i]);
+
+		// Rewind file.
+		f.seek(0, SEEK_SET);
+
+		util::file_block_reader block_reader(f, buffer_sizes[i]);
+		string::buffer b;
+
+		for (size_t j = 0; j < ARRAY_SIZE(sizes); j++) {
+			for (size_t k = 0; k < kNumberBlocks; k++) {
+				util::block block;
+				b.reset();
+				if ((!block_reader.next(block, b, -1)) || (!check_block(block, sizes[j], k))) {
+					fprintf(stderr, "Couldn't read block of %lu bytes.\n", sizes[j]);
+
+					f.close();
+					unlink(kFilename);
+
+					return -1;
+				}
+
+				// Only the blocks bigger than the buffer are copied.
+				if (b.count() != ((sizes[j] > block_reader.buffer_size()) ? sizes[j] : 0)) {
+					fprintf(stderr, "Unexpected buffer length %lu (block size: %lu).\n", b.count(), sizes[j]);
+
+					f.close();
+					unlink(kFilename);
+
+					return -1;
+				}
+			}
+		}
+
+		util::block block;
+		util::block_reader::error err;
+		if ((block_reader.next(block, b, -1, err)) || (err != util::block_reader::kEndOfFile)) {
+			fprintf(stderr, "End of file expected.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_next_batch()
+{
+	static const size_t kNumberBlocks = 1024 * 1024;
+	static const size_t kBatchSize = 256;
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+		return -1;
+	}
+
+	// Write blocks of 16 - 64 bytes.
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		if (!write_blocks(f, 16 + (i % 49), 1, i)) {
+			fprintf(stderr, "Error writing blocks.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	util::block blocks[kBatchSize];
+
+	// File block reader.
+	f.seek(0, SEEK_SET);
+
+	util::file_block_reader file_block_reader(f);
+	string::buffer b;
+
+	size_t i = 0;
+	size_t calls = 0;
+	size_t n;
+	while ((n = file_block_reader.next_batch(blocks, kBatchSize, b, -1)) > 0) {
+		for (size_t j = 0; j < n; j++, i++) {
+			if (!check_block(blocks[j], 16 + (i % 49), i)) {
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		calls++;
+	}
+
+	if (i != kNumberBlocks) {
+		fprintf(stderr, "[file_block_reader] Read %lu blocks, expected: %lu.\n", i, kNumberBlocks);
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	printf("[file_block_reader] %lu blocks read in %lu calls.\n", i, calls);
+
+	// Memory-mapped block reader.
+	util::mmap_block_reader mmap_block_reader(f);
+
+	i = 0;
+	calls = 0;
+	while ((n = mmap_block_reader.next_batch(blocks, kBatchSize)) > 0) {
+		for (size_t j = 0; j < n; j++, i++) {
+			if (!check_block(blocks[j], 16 + (i % 49), i)) {
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		calls++;
+	}
+
+	if (i != kNumberBlocks) {
+		fprintf(stderr, "[mmap_block_reader] Read %lu blocks, expected: %lu.\n", i, kNumberBlocks);
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	printf("[mmap_block_reader] %lu blocks read in %lu calls.\n", i, calls);
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_uring_block_reader()
+{
+	static const size_t kMaxSize = util::block::kMaxSize;
+	static const size_t kNumberBlocks = 64;
+
+	// Number of buffers and read sizes.
+	static const unsigned nbuffers[] = {1, 2, 3, 8};
+	static const size_t read_sizes[] = {4096, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+
+	static const size_t sizes[] = {util::block::kMinSize, 5, 100, 4095, 4096, 4097, 65536, kMaxSize - 1, kMaxSize};
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+		return -1;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+		if (!write_blocks(f, sizes[i], kNumberBlocks)) {
+			fprintf(stderr, "Error writing blocks of %lu bytes.\n", sizes[i]);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(nbuffers); i++) {
+		printf("Buffers: %u, read size: %lu.\n", nbuffers[i], read_sizes[i]);
+
+		// Rewind file.
+		f.seek(0, SEEK_SET);
+
+		util::uring_block_reader block_reader(f, nbuffers[i], read_sizes[i]);
+		if (!block_reader.init()) {
+			fprintf(stderr, "Couldn't initialize io_uring block reader.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		for (size_t j = 0; j < ARRAY_SIZE(sizes); j++) {
+			for (size_t k = 0; k < kNumberBlocks; k++) {
+				util::block block;
+				if ((!block_reader.next(block, -1)) || (!check_block(block, sizes[j], k))) {
+					fprintf(stderr, "Couldn't read block of %lu bytes.\n", sizes[j]);
+
+					f.close();
+					unlink(kFilename);
+
+					return -1;
+				}
+			}
+		}
+
+		util::block block;
+		util::block_reader::error err;
+		if ((block_reader.next(block, -1, err)) || (err != util::block_reader::kEndOfFile)) {
+			fprintf(stderr, "End of file expected.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		// Append a block after having reached the end of the file.
+		off_t filesize = f.seek(0, SEEK_END);
+
+		if ((!write_blocks(f, 100, 1)) || (!block_reader.next(block, -1)) || (!check_block(block, 100, 0))) {
+			fprintf(stderr, "Couldn't read appended block.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		// Append more blocks than fit in the buffers (the buffers which
+		// reached the end of the file shouldn't report it again).
+		size_t count = ((nbuffers[i] * read_sizes[i]) / 65536) + 2;
+
+		if (!write_blocks(f, 65536, count)) {
+			fprintf(stderr, "Error writing blocks of 65536 bytes.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		for (size_t k = 0; k < count; k++) {
+			if ((!block_reader.next(block, -1, err)) || (!check_block(block, 65536, k))) {
+				fprintf(stderr, "Couldn't read appended block %lu (error %d).\n", k, err);
+
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		if (!f.truncate(filesize)) {
+			fprintf(stderr, "Couldn't truncate file %s.\n", kFilename);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+struct block_counter {
+	unsigned char* seen;
+
+	bool operator()(const util::block& block, unsigned worker)
+	{
+		uint64_t id;
+		memcpy(&id, block.data(), sizeof(uint64_t));
+
+		__sync_fetch_and_add(&seen[id], 1);
+
+		return true;
+	}
+};
+
+int test_parallel_block_scanner()
+{
+	static const size_t kNumberBlocks = 1024 * 1024;
+	static const size_t kSyncInterval = 64 * 1024;
+	static const unsigned kMaxWorkers = 16;
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+		return -1;
+	}
+
+	// Write the file header and blocks of 16 - 64 bytes (the first 8
+	// bytes of data are the block number), with a sync block every
+	// 'kSyncInterval' bytes. Some blocks contain the sync block of another
+	// file (which must not be taken for a sync block).
+	unsigned char header[util::block::kFileHeaderSize];
+	unsigned char sync[util::block::kSyncSize];
+	util::block::make_file_header(header);
+	util::block::make_sync_block(util::block(header), sync);
+
+	unsigned char other_header[util::block::kFileHeaderSize];
+	unsigned char other_sync[util::block::kSyncSize];
+	util::block::make_file_header(other_header);
+	util::block::make_sync_block(util::block(other_header), other_sync);
+
+	string::buffer buf;
+	if (!buf.append(reinterpret_cast<const char*>(header), sizeof(header))) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	size_t last_sync = 0;
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		if (buf.count() - last_sync >= kSyncInterval) {
+			last_sync = buf.count();
+
+			if (!buf.append(reinterpret_cast<const char*>(sync), sizeof(sync))) {
+				fprintf(stderr, "Couldn't allocate memory.\n");
+
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		size_t size = 16 + (i % 49);
+
+		if (!buf.allocate(size)) {
+			fprintf(stderr, "Couldn't allocate memory.\n");
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		unsigned char* b = reinterpret_cast<unsigned char*>(buf.end());
+		memset(b, 0, size);
+
+		util::blocklen_t n = htobe32(size);
+		memcpy(b, &n, sizeof(util::blocklen_t));
+
+		uint64_t id = i;
+		memcpy(b + util::block::kMinSize, &id, sizeof(uint64_t));
+
+		if (size >= util::block::kMinSize + sizeof(uint64_t) + sizeof(other_sync)) {
+			memcpy(b + util::block::kMinSize + sizeof(uint64_t), other_sync, sizeof(other_sync));
+		}
+
+		buf.increment_count(size);
+	}
+
+	if (f.write(buf.data(), buf.count()) != static_cast<ssize_t>(buf.count())) {
+		fprintf(stderr, "Error writing blocks.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	util::parallel_block_scanner scanner;
+	if (!scanner.open(f)) {
+		fprintf(stderr, "Couldn't open parallel block scanner.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	block_counter counter;
+	counter.seen = reinterpret_cast<unsigned char*>(malloc(kNumberBlocks));
+
+	for (unsigned nworkers = 1; nworkers <= kMaxWorkers; nworkers *= 2) {
+		memset(counter.seen, 0, kNumberBlocks);
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if (!scanner.scan(nworkers, counter)) {
+			fprintf(stderr, "Error scanning file with %u workers.\n", nworkers);
+
+			free(counter.seen);
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		// Every block must have been processed once.
+		for (size_t i = 0; i < kNumberBlocks; i++) {
+			if (counter.seen[i] != 1) {
+				fprintf(stderr, "[%u workers] Block %lu processed %u times.\n", nworkers, i, counter.seen[i]);
+
+				free(counter.seen);
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		printf("%u worker(s): %lu blocks in %.3f ms.\n", nworkers, kNumberBlocks, ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0);
+	}
+
+	// The callback can be a temporary.
+	memset(counter.seen, 0, kNumberBlocks);
+
+	if (!scanner.scan(kMaxWorkers, block_counter(counter))) {
+		fprintf(stderr, "Error scanning file with a temporary callback.\n");
+
+		free(counter.seen);
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	if (memchr(counter.seen, 0, kNumberBlocks) != NULL) {
+		fprintf(stderr, "Blocks not processed with a temporary callback.\n");
+
+		free(counter.seen);
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	free(counter.seen);
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_block_writer()
+{
+	static const size_t kNumberBlocks = 1024 * 1024;
+	static const unsigned kIndexInterval = 1000;
+	static const size_t kNumberLookups = 10000;
+
+	unlink(kFilename);
+
+	// Write blocks of 16 - 64 bytes, with a sync block every 64 KiB.
+	util::block_writer writer(64 * 1024, kIndexInterval);
+	writer.group_commit(4 * 1024 * 1024, 100);
+	writer.sync_blocks(64 * 1024);
+
+	if (!writer.open(kFilename)) {
+		fprintf(stderr, "Couldn't open block writer.\n");
+		return -1;
+	}
+
+	unsigned char data[64];
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		size_t len = 16 + (i % 49) - util::block::kMinSize;
+		memset(data, i % 255, len);
+
+		if (!writer.write(data, len)) {
+			fprintf(stderr, "Error writing block %lu.\n", i);
+
+			writer.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	if ((writer.count() != kNumberBlocks) || (!writer.close())) {
+		fprintf(stderr, "Error closing block writer.\n");
+
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	string::buffer index_filename;
+	util::block_index::index_filename(kFilename, index_filename);
+
+	// The file is not empty.
+	if (writer.open(kFilename)) {
+		fprintf(stderr, "Opening a file which is not empty should fail.\n");
+
+		writer.close();
+		unlink(kFilename);
+		unlink(index_filename.data());
+
+		return -1;
+	}
+
+	fs::file f;
+	if (!f.open(kFilename, O_RDONLY)) {
+		fprintf(stderr, "Couldn't open file %s for reading.\n", kFilename);
+
+		unlink(kFilename);
+		unlink(index_filename.data());
+
+		return -1;
+	}
+
+	// Get the sync marker from the file header.
+	unsigned char marker[util::block::kSyncMarkerSize];
+	if (!read_sync_marker(f, marker)) {
+		fprintf(stderr, "File header not found.\n");
+
+		f.close();
+		unlink(kFilename);
+		unlink(index_filename.data());
+
+		return -1;
+	}
+
+	// Read blocks sequentially.
+	util::file_block_reader block_reader(f);
+	string::buffer b;
+	util::block block;
+	size_t i = 0;
+	size_t nsync = 0;
+
+	while (block_reader.next(block, b, -1)) {
+		if (block.file_header()) {
+			continue;
+		} else if (block.sync(marker)) {
+			nsync++;
+		} else if (check_block(block, 16 + (i % 49), i)) {
+			i++;
+		} else {
+			f.close();
+			unlink(kFilename);
+			unlink(index_filename.data());
+
+			return -1;
+		}
+	}
+
+	if ((i != kNumberBlocks) || (nsync == 0)) {
+		fprintf(stderr, "Read %lu blocks (%lu sync blocks), expected: %lu.\n", i, nsync, kNumberBlocks);
+
+		f.close();
+		unlink(kFilename);
+		unlink(index_filename.data());
+
+		return -1;
+	}
+
+	printf("%lu blocks and %lu sync blocks read.\n", i, nsync);
+
+	// Look up random blocks with the index.
+	util::block_index index;
+	if ((!index.load(kFilename)) || (index.interval() != kIndexInterval) || (index.count() != (kNumberBlocks + kIndexInterval - 1) / kIndexInterval)) {
+		fprintf(stderr, "Couldn't load index.\n");
+
+		f.close();
+		unlink(kFilename);
+		unlink(index_filename.data());
+
+		return -1;
+	}
+
+	for (size_t j = 0; j < kNumberLookups; j++) {
+		uint64_t n = (j * 7919) % kNumberBlocks;
+
+		off_t offset;
+		uint64_t skip;
+		if (!index.find(n, offset, skip)) {
+			fprintf(stderr, "Block %lu not found in the index.\n", n);
+
+			f.close();
+			unlink(kFilename);
+			unlink(index_filename.data());
+
+			return -1;
+		}
+
+		util::mmap_block_reader reader(f, offset);
+
+		do {
+			if (!reader.next(block)) {
+				fprintf(stderr, "Couldn't read block %lu.\n", n);
+
+				f.close();
+				unlink(kFilename);
+				unlink(index_filename.data());
+
+				return -1;
+			}
+		} while ((block.sync(marker)) || (skip-- > 0));
+
+		if (!check_block(block, 16 + (n % 49), n)) {
+			f.close();
+			unlink(kFilename);
+			unlink(index_filename.data());
+
+			return -1;
+		}
+	}
+
+	printf("%lu blocks looked up.\n", kNumberLookups);
+
+	f.close();
+	unlink(kFilename);
+	unlink(index_filename.data());
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+struct text_checker {
+	bool operator()(const util::block& block, unsigned worker)
+	{
+		uint64_t n;
+		memcpy(&n, block.data(), sizeof(uint64_t));
+
+		unsigned char buf[util::block::kMaxSize];
+		size_t len = make_text(n, buf);
+
+		if ((block.datalen() != len) || (memcmp(block.data(), buf, len) != 0)) {
+			fprintf(stderr, "[parallel_block_scanner] Invalid block %lu.\n", n);
+			__sync_fetch_and_add(&errors, 1);
+		}
+
+		__sync_fetch_and_add(&count, 1);
+
+		return true;
+	}
+
+	size_t count;
+	size_t errors;
+};
+
+int test_compression()
+{
+	static const size_t kNumberBlocks = 64 * 1024;
+
+	static unsigned char data[util::block::kMaxSize];
+	static unsigned char buf[util::block::kMaxSize];
+
+	// Compressor.
+	for (size_t len = 0; len < 256; len++) {
+		memset(data, 'a', len);
+		if (!test_lz(data, len)) {
+			return -1;
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			data[i] = random();
+		}
+
+		if (!test_lz(data, len)) {
+			return -1;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = random();
+	}
+
+	if (!test_lz(data, sizeof(data))) {
+		return -1;
+	}
+
+	size_t len = make_text(12345, data);
+	if (!test_lz(data, len)) {
+		return -1;
+	}
+
+	// Corrupted data must be rejected (or decompressed into the output
+	// buffer).
+	static unsigned char compressed[kMaxCompressedSize];
+	size_t compressed_len = util::lz::compress(data, len, compressed);
+
+	for (size_t i = 0; i < compressed_len; i++) {
+		size_t n;
+		util::lz::decompress(compressed, i, buf, len, n);
+
+		compressed[i] ^= 0x5a;
+		util::lz::decompress(compressed, compressed_len, buf, len, n);
+		compressed[i] ^= 0x5a;
+	}
+
+	printf("Compressor OK.\n");
+
+	// Write compressed blocks.
+	unlink(kFilename);
+
+	util::block_writer writer(util::block_writer::kDefaultBufferSize, 0);
+	writer.compression(64);
+	writer.sync_blocks(64 * 1024);
+
+	if (!writer.open(kFilename)) {
+		fprintf(stderr, "Couldn't open block writer.\n");
+		return -1;
+	}
+
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		len = make_text(i, data);
+
+		if (!writer.write(data, len)) {
+			fprintf(stderr, "Error writing block %lu.\n", i);
+
+			writer.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		total += util::block::kMinSize + len;
+	}
+
+	if (!writer.close()) {
+		fprintf(stderr, "Error closing block writer.\n");
+
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	fs::file f;
+	if (!f.open(kFilename, O_RDONLY)) {
+		fprintf(stderr, "Couldn't open file %s for reading.\n", kFilename);
+
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	off_t filesize = f.seek(0, SEEK_END);
+	f.seek(0, SEEK_SET);
+
+	printf("Uncompressed: %lu bytes, compressed: %lu bytes (%.2fx).\n", total, filesize, static_cast<double>(total) / filesize);
+
+	unsigned char marker[util::block::kSyncMarkerSize];
+	if (!read_sync_marker(f, marker)) {
+		fprintf(stderr, "File header not found.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// Read blocks with the different readers.
+	util::file_block_reader file_block_reader(f);
+	util::mmap_block_reader mmap_block_reader(f);
+	string::buffer b;
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		len = make_text(i, data);
+
+		for (unsigned r = 0; r < 2; r++) {
+			util::block block;
+
+			do {
+				b.reset();
+				if (((r == 0) && (!file_block_reader.next(block, b, -1))) || ((r == 1) && (!mmap_block_reader.next(block)))) {
+					fprintf(stderr, "Couldn't read block %lu.\n", i);
+
+					f.close();
+					unlink(kFilename);
+
+					return -1;
+				}
+			} while ((block.file_header()) || (block.sync(marker)));
+
+			if ((block.compressed()) || (block.datalen() != len) || (memcmp(block.data(), data, len) != 0)) {
+				fprintf(stderr, "Invalid block %lu.\n", i);
+
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+	}
+
+	util::parallel_block_scanner scanner;
+	text_checker checker;
+	checker.count = 0;
+	checker.errors = 0;
+
+	if ((!scanner.open(f)) || (!scanner.scan(4, checker)) || (checker.count != kNumberBlocks) || (checker.errors != 0)) {
+		fprintf(stderr, "Error scanning compressed blocks.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool test_lz(const unsigned char* data, size_t len)
+{
+	static unsigned char compressed[kMaxCompressedSize];
+	static unsigned char buf[util::block::kMaxSize];
+
+	size_t compressed_len = util::lz::compress(data, len, compressed);
+	if (compressed_len > util::lz::bound(len)) {
+		fprintf(stderr, "Compressed length %lu > bound %lu.\n", compressed_len, util::lz::bound(len));
+		return false;
+	}
+
+	size_t n;
+	if ((!util::lz::decompress(compressed, compressed_len, buf, len, n)) || (n != len) || (memcmp(buf, data, len) != 0)) {
+		fprintf(stderr, "Error decompressing %lu bytes.\n", len);
+		return false;
+	}
+
+	return true;
+}
+
+size_t make_text(size_t n, unsigned char* buf)
+{
+	// The first 8 bytes are the block number.
+	uint64_t id = n;
+	memcpy(buf, &id, sizeof(uint64_t));
+
+	size_t len = sizeof(uint64_t);
+	size_t nlines = 1 + (n % 32);
+
+	for (size_t i = 0; i < nlines; i++) {
+		len += sprintf(reinterpret_cast<char*>(buf) + len,
+		               "2026-10-17 12:%02lu:%02lu INFO [worker-%lu] GET /api/v1/items/%lu status=200 bytes=%lu\n",
+		               (n / 60) % 60,
+		               n % 60,
+		               i % 8,
+		               (n * 31 + i) % 100000,
+		               (n * i) % 65536);
+	}
+
+	return len;
+}
+
+int test_checksums()
+{
+	static const size_t kNumberBlocks = 64 * 1024;
+	static const size_t kBenchmarkSize = 256 * 1024 * 1024;
+
+	// Check value.
+	if ((util::crc32c::compute("123456789", 9) != 0xe3069283) || (util::crc32c::compute_table("123456789", 9) != 0xe3069283)) {
+		fprintf(stderr, "Invalid CRC-32C of \"123456789\".\n");
+		return -1;
+	}
+
+	unsigned char* data;
+	if ((data = reinterpret_cast<unsigned char*>(malloc(kBenchmarkSize))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < kBenchmarkSize; i++) {
+		data[i] = random();
+	}
+
+	// Hardware vs table (unaligned buffers, incremental computation).
+	for (size_t len = 0; len < 1024; len++) {
+		uint32_t crc = util::crc32c::compute(data + 1, len);
+
+		if ((crc != util::crc32c::compute_table(data + 1, len)) || (crc != util::crc32c::compute(data + 1 + len / 3, len - len / 3, util::crc32c::compute(data + 1, len / 3)))) {
+			fprintf(stderr, "CRC mismatch (length: %lu).\n", len);
+
+			free(data);
+			return -1;
+		}
+	}
+
+	for (unsigned i = 0; i < 2; i++) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		uint32_t crc = (i == 0) ? util::crc32c::compute(data, kBenchmarkSize) : util::crc32c::compute_table(data, kBenchmarkSize);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double secs = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+		printf("%s: %.2f GB/s (crc: 0x%08x).\n", (i == 0) ? (util::crc32c::hardware() ? "crc32 instruction" : "table (no SSE 4.2)") : "table", kBenchmarkSize / secs / 1000000000.0, crc);
+	}
+
+	free(data);
+
+	// Write blocks with checksums (some of them compressed).
+	unlink(kFilename);
+
+	util::block_writer writer(util::block_writer::kDefaultBufferSize, 0);
+	writer.checksums(true);
+	writer.compression(1024);
+
+	if (!writer.open(kFilename)) {
+		fprintf(stderr, "Couldn't open block writer.\n");
+		return -1;
+	}
+
+	unsigned char buf[util::block::kMaxSize];
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		size_t len = make_text(i, buf);
+
+		if (!writer.write(buf, len)) {
+			fprintf(stderr, "Error writing block %lu.\n", i);
+
+			writer.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	if (!writer.close()) {
+		fprintf(stderr, "Error closing block writer.\n");
+
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	fs::file f;
+	if (!f.open(kFilename, O_RDWR)) {
+		fprintf(stderr, "Couldn't open file %s for reading/writing.\n", kFilename);
+
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// Read blocks (all the blocks have a checksum).
+	util::file_block_reader block_reader(f);
+	block_reader.require_checksums(true);
+
+	string::buffer b;
+
+	for (size_t i = 0; i < kNumberBlocks; i++) {
+		size_t len = make_text(i, buf);
+
+		util::block block;
+		if ((!block_reader.next(block, b, -1)) || (block.datalen() != len) || (memcmp(block.data(), buf, len) != 0)) {
+			fprintf(stderr, "Couldn't read block %lu.\n", i);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	// Corrupt the block 1000.
+	off_t offset;
+
+	{
+		util::mmap_block_reader mmap_block_reader(f);
+
+		for (size_t i = 0; i < 1000; i++) {
+			util::block block;
+			mmap_block_reader.next(block);
+		}
+
+		offset = mmap_block_reader.offset();
+	}
+
+	unsigned char c;
+	f.pread(&c, 1, offset + 100);
+	c ^= 0x01;
+	f.pwrite(&c, 1, offset + 100);
+
+	util::mmap_block_reader mmap_block_reader(f);
+	util::block block;
+	util::block_reader::error err;
+
+	for (size_t i = 0; i < 1000; i++) {
+		if (!mmap_block_reader.next(block, err)) {
+			fprintf(stderr, "Couldn't read block %lu.\n", i);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	if ((mmap_block_reader.next(block, err)) || (err != util::block_reader::kCorruptBlock)) {
+		fprintf(stderr, "The corrupted block has not been detected.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// The next blocks can still be read.
+	if ((!mmap_block_reader.next(block)) || (!block.verify())) {
+		fprintf(stderr, "Couldn't read block after the corrupted block.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_invalid_headers()
+{
+	// Size 0, size smaller than the header and size smaller than the
+	// header plus the checksum (for a block with checksum).
+	static const util::blocklen_t headers[] = {0, util::block::kMinSize - 1, (util::block::kMinSize + 2) | util::block::kChecksum};
+
+	// The last test writes a valid block without checksum, which must be
+	// rejected when the checksums are required.
+	for (size_t i = 0; i <= ARRAY_SIZE(headers); i++) {
+		bool required = (i == ARRAY_SIZE(headers));
+
+		printf("Header: 0x%08x%s.\n", (i < ARRAY_SIZE(headers)) ? headers[i] : 100, required ? " (checksums required)" : "");
+
+		// Write the file header followed by the block.
+		unsigned char buf[util::block::kFileHeaderSize + 256];
+		memset(buf, 0, sizeof(buf));
+
+		util::block::make_file_header(buf);
+		util::block::encode_header(buf + util::block::kFileHeaderSize, (i < ARRAY_SIZE(headers)) ? headers[i] : 100);
+
+		fs::file f;
+		if ((!f.open(kFilename, O_CREAT | O_TRUNC | O_RDWR, 0644)) || (f.write(buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)))) {
+			fprintf(stderr, "Couldn't write file %s.\n", kFilename);
+
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		util::block block;
+		string::buffer b;
+		util::block_reader::error err;
+		bool ret;
+
+		// File block reader.
+		f.seek(0, SEEK_SET);
+
+		{
+			util::file_block_reader block_reader(f);
+			block_reader.require_checksums(required);
+
+			ret = (block_reader.next_batch(&block, 1, b, -1) == 1) &&
+			      (block.file_header()) &&
+			      (block_reader.next_batch(&block, 1, b, -1, err) == 0) &&
+			      (err == util::block_reader::kCorruptBlock);
+		}
+
+		// mmap block reader.
+		if (ret) {
+			util::mmap_block_reader block_reader(f);
+			block_reader.require_checksums(required);
+
+			ret = (block_reader.next(block)) &&
+			      (block.file_header()) &&
+			      (!block_reader.next(block, err)) &&
+			      (err == util::block_reader::kCorruptBlock);
+		}
+
+		// io_uring block reader.
+		if (ret) {
+			f.seek(0, SEEK_SET);
+
+			util::uring_block_reader block_reader(f);
+			block_reader.require_checksums(required);
+
+			ret = (block_reader.init()) &&
+			      (block_reader.next(block, -1)) &&
+			      (block.file_header()) &&
+			      (!block_reader.next(block, -1, err)) &&
+			      (err == util::block_reader::kCorruptBlock);
+		}
+
+		// Parallel block scanner.
+		if (ret) {
+			util::parallel_block_scanner scanner;
+			scanner.require_checksums(required);
+
+			ret = (scanner.open(f)) && (!scanner.scan(1, [](const util::block& b, unsigned worker) { return true; }));
+		}
+
+		f.close();
+
+		if (!ret) {
+			fprintf(stderr, "Invalid block header not detected.\n");
+
+			unlink(kFilename);
+
+			return -1;
+		}
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool write_blocks(fs::file& f, size_t size, size_t count, size_t first)
+{
+	unsigned char* buf;
+	if ((buf = reinterpret_cast<unsigned char*>(malloc(size))) == NULL) {
+		return false;
+	}
+
+	util::blocklen_t n = htobe32(size);
+	memcpy(buf, &n, sizeof(util::blocklen_t));
+
+	for (size_t i = 0; i < count; i++) {
+		memset(buf + util::block::kMinSize, (first + i) % 255, size - util::block::kMinSize);
+
+		if (f.write(buf, size) != static_cast<ssize_t>(size)) {
+			free(buf);
+			return false;
+		}
+	}
+
+	free(buf);
+
+	return true;
+}
+
+bool check_block(const util::block& block, size_t size, size_t n)
+{
+	if (block.size() != size) {
+		fprintf(stderr, "Block has wrong size (%u, expected: %lu).\n", block.size(), size);
+		return false;
+	}
+
+	util::blocklen_t len;
+	const unsigned char* data = block.data(len);
+	for (size_t k = 0; k < len; k++) {
+		if (data[k] != static_cast<unsigned char>(n % 255)) {
+			fprintf(stderr, "Invalid data.\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool read_sync_marker(fs::file& f, unsigned char* marker)
+{
+	util::mmap_block_reader reader(f);
+
+	util::block header;
+	if ((!reader.next(header)) || (!header.file_header())) {
+		return false;
+	}
+
+	memcpy(marker, header.sync_marker(), util::block::kSyncMarkerSize);
+
+	return true;
+}
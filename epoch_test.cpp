@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "util/concurrent/epoch.h"
+#include "util/concurrent/atomic/atomic.h"
+
+static const unsigned kMagic = 0x12345678;
+static const unsigned kNumberThreads = 8;
+static const unsigned kStressSeconds = 3;
+static const unsigned kNumberEpochs = 4096;
+
+struct object {
+	// Hook for the epoch (must be the first member).
+	util::concurrent::epoch::retired hook;
+
+	unsigned magic;
+};
+
+static unsigned long freed = 0;
+
+static object* create_object();
+static void reclaim_object(util::concurrent::epoch::retired* r);
+
+static int test_reclamation_order();
+static void* reader(void* arg);
+
+static int test_stress();
+static void* stresser(void* arg);
+
+static int test_many_epochs();
+static void* enterer(void* arg);
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
+		fprintf(stderr, "\t0: Test that an object is not freed while a reader can reach it.\n");
+		fprintf(stderr, "\t1: Stress test with %u threads (%u seconds).\n", kNumberThreads, kStressSeconds);
+		fprintf(stderr, "\t2: Test %u epochs (more than PTHREAD_KEYS_MAX).\n", kNumberEpochs);
+
+		return -1;
+	}
+
+	switch (atoi(argv[1])) {
+		case 0:
+			return test_reclamation_order();
+		case 1:
+			return test_stress();
+		case 2:
+			return test_many_epochs();
+		default:
+			fprintf(stderr, "Wrong test number %s.\n", argv[1]);
+			return -1;
+	}
+}
+
+object* create_object()
+{
+	object* obj;
+	if ((obj = reinterpret_cast<object*>(malloc(sizeof(object)))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+		abort();
+	}
+
+	obj->magic = kMagic;
+
+	return obj;
+}
+
+void reclaim_object(util::concurrent::epoch::retired* r)
+{
+	object* obj = reinterpret_cast<object*>(r);
+
+	// Poison the object (detect accesses after free without ASan).
+	obj->magic = 0;
+	free(obj);
+
+	util::concurrent::atomic::add(&freed, 1ul);
+}
+
+struct reader_args {
+	util::concurrent::epoch* e;
+	object* obj;
+
+	pthread_barrier_t* barrier;
+
+	bool ret;
+};
+
+int test_reclamation_order()
+{
+	// Sequence:
+	// - The writer enters the epoch and the global epoch advances.
+	// - The reader enters the (new) epoch and reaches the object.
+	// - The writer unlinks and retires the object (its local epoch is
+	//   behind the global epoch) and exits.
+	// - The global epoch advances again (the reader has seen the current
+	//   epoch).
+	// The object must not be freed until the reader exits.
+	util::concurrent::epoch e;
+	if (!e.init()) {
+		fprintf(stderr, "Couldn't initialize epoch.\n");
+		return -1;
+	}
+
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, 2);
+
+	reader_args args;
+	args.e = &e;
+	args.obj = create_object();
+	args.barrier = &barrier;
+	args.ret = false;
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, reader, &args) != 0) {
+		fprintf(stderr, "Error creating thread.\n");
+		return -1;
+	}
+
+	// Writer enters the epoch.
+	e.enter();
+
+	// Advance global epoch.
+	e.collect();
+
+	// Let the reader enter the epoch and reach the object.
+	pthread_barrier_wait(&barrier);
+	pthread_barrier_wait(&barrier);
+
+	// Unlink and retire object.
+	object* obj = args.obj;
+	util::concurrent::atomic::release_store(&args.obj, static_cast<object*>(NULL));
+
+	e.retire(&obj->hook, reclaim_object);
+	e.exit();
+
+	// Try to advance the global epoch and free the object.
+	for (unsigned i = 0; i < 8; i++) {
+		e.collect();
+
+		e.enter();
+		e.exit();
+	}
+
+	// Let the reader access the object.
+	pthread_barrier_wait(&barrier);
+	pthread_barrier_wait(&barrier);
+
+	pthread_join(thread, NULL);
+
+	if (!args.ret) {
+		fprintf(stderr, "The object was freed while the reader could reach it.\n");
+		return -1;
+	}
+
+	// Now the object can be freed.
+	for (unsigned i = 0; (i < 8) && (util::concurrent::atomic::acquire_load(&freed) == 0); i++) {
+		e.collect();
+	}
+
+	if (util::concurrent::atomic::acquire_load(&freed) != 1) {
+		fprintf(stderr, "The object has not been freed.\n");
+		return -1;
+	}
+
+	pthread_barrier_destroy(&barrier);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+void* reader(void* arg)
+{
+	reader_args* args = reinterpret_cast<reader_args*>(arg);
+
+	pthread_barrier_wait(args->barrier);
+
+	args->e->enter();
+	object* obj = util::concurrent::atomic::acquire_load(&args->obj);
+
+	pthread_barrier_wait(args->barrier);
+
+	// Wait for the writer.
+	pthread_barrier_wait(args->barrier);
+
+	args->ret = ((obj->magic == kMagic) && (util::concurrent::atomic::acquire_load(&freed) == 0));
+
+	args->e->exit();
+
+	pthread_barrier_wait(args->barrier);
+
+	return NULL;
+}
+
+struct stress_args {
+	util::concurrent::epoch* e;
+	object** slot;
+
+	bool* running;
+
+	unsigned long accesses;
+	bool ret;
+};
+
+int test_stress()
+{
+	util::concurrent::epoch e;
+	if (!e.init()) {
+		fprintf(stderr, "Couldn't initialize epoch.\n");
+		return -1;
+	}
+
+	object* slot = create_object();
+	bool running = true;
+
+	pthread_t threads[kNumberThreads];
+	stress_args args[kNumberThreads];
+
+	unsigned i;
+	for (i = 0; i < kNumberThreads; i++) {
+		args[i].e = &e;
+		args[i].slot = &slot;
+		args[i].running = &running;
+		args[i].accesses = 0;
+		args[i].ret = true;
+
+		if (pthread_create(&threads[i], NULL, stresser, &args[i]) != 0) {
+			fprintf(stderr, "Error creating thread.\n");
+			break;
+		}
+	}
+
+	sleep(kStressSeconds);
+
+	util::concurrent::atomic::release_store(&running, false);
+
+	int ret = (i == kNumberThreads) ? 0 : -1;
+	unsigned long accesses = 0;
+
+	for (unsigned j = 0; j < i; j++) {
+		pthread_join(threads[j], NULL);
+
+		if (!args[j].ret) {
+			ret = -1;
+		}
+
+		accesses += args[j].accesses;
+	}
+
+	if (ret == 0) {
+		printf("%lu accesses, %lu objects freed.\nSuccess.\n", accesses, util::concurrent::atomic::acquire_load(&freed));
+	} else {
+		fprintf(stderr, "An object was accessed after being freed.\n");
+	}
+
+	free(slot);
+
+	return ret;
+}
+
+void* stresser(void* arg)
+{
+	stress_args* args = reinterpret_cast<stress_args*>(arg);
+
+	unsigned long n = 0;
+
+	while (util::concurrent::atomic::acquire_load(args->running)) {
+		args->e->enter();
+
+		object* obj = util::concurrent::atomic::acquire_load(args->slot);
+
+		// Replace the object from time to time.
+		if ((++n % 4) == 0) {
+			if (util::concurrent::atomic::bool_compare_and_swap(args->slot, obj, create_object())) {
+				args->e->retire(&obj->hook, reclaim_object);
+			}
+		}
+
+		// Access the object for a while.
+		for (unsigned i = 0; i < 16; i++) {
+			if (obj->magic != kMagic) {
+				args->ret = false;
+			}
+
+			if ((i % 4) == 0) {
+				sched_yield();
+			}
+		}
+
+		args->e->exit();
+
+		args->accesses++;
+	}
+
+	return NULL;
+}
+
+struct enterer_args {
+	util::concurrent::epoch** epochs;
+
+	bool ret;
+};
+
+int test_many_epochs()
+{
+	util::concurrent::epoch** epochs;
+	if ((epochs = reinterpret_cast<util::concurrent::epoch**>(malloc(kNumberEpochs * sizeof(util::concurrent::epoch*)))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+		return -1;
+	}
+
+	for (unsigned i = 0; i < kNumberEpochs; i++) {
+		epochs[i] = new util::concurrent::epoch();
+
+		if (!epochs[i]->init()) {
+			fprintf(stderr, "Couldn't initialize epoch %u.\n", i);
+			return -1;
+		}
+	}
+
+	// Enter all the epochs from two threads.
+	enterer_args args;
+	args.epochs = epochs;
+	args.ret = false;
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, enterer, &args) != 0) {
+		fprintf(stderr, "Error creating thread.\n");
+		return -1;
+	}
+
+	enterer(&args);
+
+	pthread_join(thread, NULL);
+
+	if (!args.ret) {
+		fprintf(stderr, "Couldn't enter epoch.\n");
+		return -1;
+	}
+
+	// Destroy the epochs while the records of this thread are in use.
+	for (unsigned i = 0; i < kNumberEpochs; i++) {
+		delete epochs[i];
+	}
+
+	// The orphaned records are freed by the next epoch used.
+	util::concurrent::epoch e;
+	if ((!e.init()) || (!e.enter())) {
+		fprintf(stderr, "Couldn't enter epoch.\n");
+		return -1;
+	}
+
+	e.exit();
+
+	free(epochs);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+void* enterer(void* arg)
+{
+	enterer_args* args = reinterpret_cast<enterer_args*>(arg);
+
+	for (unsigned i = 0; i < kNumberEpochs; i++) {
+		if (!args->epochs[i]->enter()) {
+			return NULL;
+		}
+
+		args->epochs[i]->exit();
+	}
+
+	args->ret = true;
+
+	return NULL;
+}
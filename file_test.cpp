@@ -0,0 +1,1019 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "fs/file.h"
+#include "fs/async_file.h"
+
+static const char* kFilename = "test.dat";
+static const char* kCopyFilename = "test.dat.copy";
+
+static int test_vectored();
+static int test_copy();
+static int test_read_all();
+static int test_async();
+static bool async_copy(bool registered);
+static int test_io_engine();
+static int engine_op(fs::io_engine& engine, bool write, int fd, bool fixed, void* buf, unsigned count, int buf_index);
+static void on_result(int res, void* arg);
+static void on_alarm(int nsignal);
+
+static bool create_file(fs::file& f, size_t size);
+static bool check_file(const char* filename, size_t size);
+static char data(size_t n);
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
+		fprintf(stderr, "\t0: Test preadv() / pwritev() (with flags).\n");
+		fprintf(stderr, "\t1: Test copy_range(), sendfile() and splice().\n");
+		fprintf(stderr, "\t2: Test read_all() (in chunks) and mmap_all().\n");
+		fprintf(stderr, "\t3: Test fs::async_file (io_uring).\n");
+		fprintf(stderr, "\t4: Test fs::io_engine (fixed files and buffers, poll() timeout).\n");
+
+		return -1;
+	}
+
+	switch (atoi(argv[1])) {
+		case 0:
+			return test_vectored();
+		case 1:
+			return test_copy();
+		case 2:
+			return test_read_all();
+		case 3:
+			return test_async();
+		case 4:
+			return test_io_engine();
+		default:
+			fprintf(stderr, "Invalid test number %s.\n", argv[1]);
+			return -1;
+	}
+}
+
+static const size_t kFileSize = 8 * 1024 * 1024 + 123;
+
+int test_vectored()
+{
+	unlink(kFilename);
+
+	fs::file f;
+	if (!f.open(kFilename, O_CREAT | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s.\n", kFilename);
+		return -1;
+	}
+
+	// Write file with buffers of different sizes (some of them empty)
+	// at explicit offsets, with RWF_DSYNC every 64 buffers.
+	static const size_t kMaxBuffer = 64 * 1024;
+	char* buf;
+	if ((buf = reinterpret_cast<char*>(malloc(kMaxBuffer))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	size_t offset = 0;
+	unsigned n = 0;
+
+	while (offset < kFileSize) {
+		struct iovec iov[16];
+		unsigned iovcnt = 0;
+		size_t off = offset;
+
+		while ((iovcnt < 16) && (off < kFileSize)) {
+			size_t len = (n++ * 7919) % kMaxBuffer / 16;
+			if (len > kFileSize - off) {
+				len = kFileSize - off;
+			}
+
+			char* b = buf + (iovcnt * (kMaxBuffer / 16));
+			for (size_t i = 0; i < len; i++) {
+				b[i] = data(off + i);
+			}
+
+			iov[iovcnt].iov_base = b;
+			iov[iovcnt++].iov_len = len;
+
+			off += len;
+		}
+
+		int flags = ((n % 64) < 16) ? RWF_DSYNC : 0;
+
+		if (f.pwritev(iov, iovcnt, offset, flags) != static_cast<ssize_t>(off - offset)) {
+			fprintf(stderr, "Error writing to file %s.\n", kFilename);
+
+			free(buf);
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		offset = off;
+	}
+
+	// Append with writev() (current offset).
+	struct iovec iov[2];
+	char tail[2] = {data(kFileSize), data(kFileSize + 1)};
+	iov[0].iov_base = &tail[0];
+	iov[0].iov_len = 1;
+	iov[1].iov_base = &tail[1];
+	iov[1].iov_len = 1;
+
+	if ((f.seek(0, SEEK_END) != static_cast<off_t>(kFileSize)) || (f.writev(iov, 2) != 2)) {
+		fprintf(stderr, "Error writing to file %s.\n", kFilename);
+
+		free(buf);
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// Write to a non-blocking pipe: when the pipe is full, writev()
+	// returns what has been written.
+	int pipefd[2];
+	if (pipe2(pipefd, O_NONBLOCK) < 0) {
+		fprintf(stderr, "Couldn't create pipe.\n");
+
+		free(buf);
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	fs::file p(pipefd[1]);
+
+	ssize_t written = -1;
+	size_t pending = 0;
+	for (unsigned i = 0; i < 16; i++) {
+		iov[0].iov_base = buf;
+		iov[0].iov_len = kMaxBuffer - 1;
+		iov[1].iov_base = buf;
+		iov[1].iov_len = kMaxBuffer + 1;
+
+		// Stop when the pipe is full (or almost).
+		if ((written = p.writev(iov, 2)) != static_cast<ssize_t>(2 * kMaxBuffer)) {
+			if (written > 0) {
+				pending += written;
+			}
+
+			break;
+		}
+
+		pending += written;
+	}
+
+	// Count the bytes in the pipe.
+	ssize_t ret;
+	while ((ret = read(pipefd[0], buf, kMaxBuffer)) > 0) {
+		pending -= ret;
+	}
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+	if ((written < 0) || (pending != 0)) {
+		fprintf(stderr, "writev() to a non-blocking pipe failed.\n");
+
+		free(buf);
+		f.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	// Read the file back with preadv(); the data is in the page cache,
+	// so RWF_NOWAIT should not fail (unless it is not supported).
+	for (offset = 0; offset < kFileSize + 2; ) {
+		iov[0].iov_base = buf;
+		iov[0].iov_len = kMaxBuffer / 2;
+		iov[1].iov_base = buf + kMaxBuffer / 2;
+		iov[1].iov_len = kMaxBuffer / 2;
+
+		ssize_t ret;
+		if ((ret = f.preadv(iov, 2, offset, RWF_NOWAIT)) < 0) {
+			if ((errno != EAGAIN) && (errno != EOPNOTSUPP)) {
+				fprintf(stderr, "Error reading from file %s.\n", kFilename);
+
+				free(buf);
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+
+			ret = f.preadv(iov, 2, offset);
+		}
+
+		if (ret <= 0) {
+			fprintf(stderr, "Error reading from file %s.\n", kFilename);
+
+			free(buf);
+			f.close();
+			unlink(kFilename);
+
+			return -1;
+		}
+
+		for (ssize_t i = 0; i < ret; i++) {
+			if (buf[i] != data(offset + i)) {
+				fprintf(stderr, "Invalid data at offset %lu.\n", offset + i);
+
+				free(buf);
+				f.close();
+				unlink(kFilename);
+
+				return -1;
+			}
+		}
+
+		offset += ret;
+	}
+
+	free(buf);
+	f.close();
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_copy()
+{
+	unlink(kFilename);
+	unlink(kCopyFilename);
+
+	fs::file in;
+	if ((!in.open(kFilename, O_CREAT | O_RDWR, 0644)) || (!create_file(in, kFileSize))) {
+		fprintf(stderr, "Couldn't create file %s.\n", kFilename);
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	fs::file out;
+	if (!out.open(kCopyFilename, O_CREAT | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s.\n", kCopyFilename);
+
+		in.close();
+		unlink(kFilename);
+
+		return -1;
+	}
+
+	int ret = -1;
+
+	do {
+		// Copy the file in two halves: the second half with explicit
+		// offsets, the first one with the file offsets.
+		off_t offset = kFileSize / 2;
+		off_t out_offset = kFileSize / 2;
+		if ((in.copy_range(&offset, out.fd(), &out_offset, kFileSize) != static_cast<ssize_t>(kFileSize - kFileSize / 2)) ||
+		    (offset != static_cast<off_t>(kFileSize)) ||
+		    (out_offset != static_cast<off_t>(kFileSize))) {
+			fprintf(stderr, "copy_range() failed.\n");
+			break;
+		}
+
+		if ((in.seek(0, SEEK_SET) != 0) ||
+		    (out.seek(0, SEEK_SET) != 0) ||
+		    (in.copy_range(NULL, out.fd(), NULL, kFileSize / 2) != static_cast<ssize_t>(kFileSize / 2))) {
+			fprintf(stderr, "copy_range() failed.\n");
+			break;
+		}
+
+		if (!check_file(kCopyFilename, kFileSize)) {
+			break;
+		}
+
+		// Copy the file to another file system (copy_file_range()
+		// fails with EXDEV, sendfile() is used), the offset of the
+		// output file is not modified.
+		int fd;
+		if ((fd = memfd_create(kCopyFilename, 0)) < 0) {
+			fprintf(stderr, "Couldn't create memory file.\n");
+			break;
+		}
+
+		fs::file mem(fd);
+
+		offset = 0;
+		out_offset = 0;
+		if ((mem.seek(7, SEEK_SET) != 7) ||
+		    (in.copy_range(&offset, fd, &out_offset, kFileSize) != static_cast<ssize_t>(kFileSize)) ||
+		    (offset != static_cast<off_t>(kFileSize)) ||
+		    (out_offset != static_cast<off_t>(kFileSize)) ||
+		    (mem.offset() != 7)) {
+			fprintf(stderr, "copy_range() to another file system failed.\n");
+
+			mem.close();
+			break;
+		}
+
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+		bool valid = check_file(path, kFileSize);
+
+		mem.close();
+
+		if (!valid) {
+			break;
+		}
+
+		// Copy the file with sendfile().
+		if ((!out.truncate(0)) || (out.seek(0, SEEK_SET) != 0)) {
+			fprintf(stderr, "Couldn't truncate file %s.\n", kCopyFilename);
+			break;
+		}
+
+		offset = 0;
+		if (in.sendfile(out.fd(), &offset, kFileSize + 100) != static_cast<ssize_t>(kFileSize)) {
+			fprintf(stderr, "sendfile() failed.\n");
+			break;
+		}
+
+		if (!check_file(kCopyFilename, kFileSize)) {
+			break;
+		}
+
+		// Copy the file through a pipe with splice().
+		if (!out.truncate(0)) {
+			fprintf(stderr, "Couldn't truncate file %s.\n", kCopyFilename);
+			break;
+		}
+
+		int pipefd[2];
+		if (pipe(pipefd) < 0) {
+			fprintf(stderr, "Couldn't create pipe.\n");
+			break;
+		}
+
+		offset = 0;
+		out_offset = 0;
+
+		while (offset < static_cast<off_t>(kFileSize)) {
+			ssize_t n;
+			if ((n = in.splice_to(pipefd[1], &offset, kFileSize - offset)) <= 0) {
+				break;
+			}
+
+			while (n > 0) {
+				ssize_t m;
+				if ((m = out.splice_from(pipefd[0], &out_offset, n)) <= 0) {
+					break;
+				}
+
+				n -= m;
+			}
+
+			if (n > 0) {
+				break;
+			}
+		}
+
+		close(pipefd[0]);
+		close(pipefd[1]);
+
+		if ((offset != static_cast<off_t>(kFileSize)) || (out_offset != static_cast<off_t>(kFileSize))) {
+			fprintf(stderr, "splice() failed.\n");
+			break;
+		}
+
+		if (!check_file(kCopyFilename, kFileSize)) {
+			break;
+		}
+
+		ret = 0;
+	} while (false);
+
+	in.close();
+	out.close();
+
+	unlink(kFilename);
+	unlink(kCopyFilename);
+
+	if (ret == 0) {
+		printf("Success.\n");
+	}
+
+	return ret;
+}
+
+struct chunk_checker {
+	size_t offset;
+	size_t chunks;
+
+	bool operator()(const char* buf, size_t len)
+	{
+		for (size_t i = 0; i < len; i++) {
+			if (buf[i] != data(offset + i)) {
+				fprintf(stderr, "Invalid data at offset %lu.\n", offset + i);
+				return false;
+			}
+		}
+
+		offset += len;
+		chunks++;
+
+		return true;
+	}
+};
+
+int test_read_all()
+{
+	unlink(kFilename);
+
+	fs::file f;
+	if ((!f.open(kFilename, O_CREAT | O_RDWR, 0644)) || (!create_file(f, kFileSize))) {
+		fprintf(stderr, "Couldn't create file %s.\n", kFilename);
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	f.close();
+
+	// Read the file in chunks.
+	chunk_checker checker;
+	checker.offset = 0;
+	checker.chunks = 0;
+
+	if ((!fs::file::read_all(kFilename, checker)) || (checker.offset != kFileSize)) {
+		fprintf(stderr, "read_all() failed.\n");
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	printf("read_all(): %lu chunks.\n", checker.chunks);
+
+	// Read the file in small chunks with a lambda.
+	size_t size = 0;
+	if ((!fs::file::read_all(kFilename, [&size](const char* buf, size_t len) { size += len; return true; }, 4096)) ||
+	    (size != kFileSize)) {
+		fprintf(stderr, "read_all() with a lambda failed.\n");
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	// Map the file.
+	fs::file_view view;
+	if ((!fs::file::mmap_all(kFilename, view)) || (view.size() != kFileSize)) {
+		fprintf(stderr, "mmap_all() failed.\n");
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	for (size_t i = 0; i < view.size(); i++) {
+		if (view.data()[i] != data(i)) {
+			fprintf(stderr, "Invalid data at offset %lu.\n", i);
+
+			unlink(kFilename);
+			return -1;
+		}
+	}
+
+	// Empty file.
+	if ((!f.open(kFilename, O_TRUNC | O_RDWR)) || (!f.close())) {
+		fprintf(stderr, "Couldn't truncate file %s.\n", kFilename);
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	checker.offset = 0;
+	checker.chunks = 0;
+
+	if ((!fs::file::read_all(kFilename, checker)) || (checker.chunks != 0) ||
+	    (!fs::file::mmap_all(kFilename, view)) || (view.size() != 0)) {
+		fprintf(stderr, "Empty file: read_all() / mmap_all() failed.\n");
+
+		unlink(kFilename);
+		return -1;
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+static const unsigned kInFlight = 32;
+static const size_t kBlockSize = 64 * 1024;
+
+struct async_state;
+
+struct async_op {
+	async_state* state;
+
+	// Index of the buffer (and of the registered buffer).
+	unsigned idx;
+
+	off_t offset;
+	unsigned count;
+};
+
+struct async_state {
+	fs::async_file* file;
+
+	char* buffers;
+	bool registered;
+
+	async_op ops[kInFlight];
+
+	// Offset of the next block.
+	off_t next;
+
+	bool writing;
+	bool error;
+};
+
+static bool queue_block(async_op* op);
+static void on_complete(int res, void* arg);
+static void on_fsync(int res, void* arg);
+
+int test_async()
+{
+	for (unsigned registered = 0; registered < 2; registered++) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if (!async_copy(registered)) {
+			unlink(kFilename);
+			return -1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		printf("%s: %8.2f ms.\n",
+		       registered ? "Registered file and buffers" : "Not registered            ",
+		       ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0);
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool async_copy(bool registered)
+{
+	unlink(kFilename);
+
+	fs::io_engine engine;
+	if (!engine.init(kInFlight, registered ? fs::io_engine::kDefaultMaxFiles : 0)) {
+		fprintf(stderr, "Couldn't initialize I/O engine.\n");
+		return false;
+	}
+
+	void* p;
+	if (posix_memalign(&p, 4096, kInFlight * kBlockSize) != 0) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+		return false;
+	}
+
+	async_state state;
+	state.buffers = reinterpret_cast<char*>(p);
+	state.registered = registered;
+
+	if (registered) {
+		struct iovec iov[kInFlight];
+		for (unsigned i = 0; i < kInFlight; i++) {
+			iov[i].iov_base = state.buffers + (i * kBlockSize);
+			iov[i].iov_len = kBlockSize;
+		}
+
+		if (!engine.register_buffers(iov, kInFlight)) {
+			fprintf(stderr, "Couldn't register buffers.\n");
+
+			free(p);
+			return false;
+		}
+	}
+
+	fs::async_file f(engine);
+	if (!f.open(kFilename, O_CREAT | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s.\n", kFilename);
+
+		free(p);
+		return false;
+	}
+
+	if (f.fixed() != registered) {
+		fprintf(stderr, "The file should %sbe registered.\n", registered ? "" : "not ");
+
+		free(p);
+		return false;
+	}
+
+	state.file = &f;
+
+	// Write the file and then read it back, with up to kInFlight
+	// operations in flight.
+	for (unsigned pass = 0; pass < 2; pass++) {
+		state.next = 0;
+		state.writing = (pass == 0);
+		state.error = false;
+
+		for (unsigned i = 0; i < kInFlight; i++) {
+			state.ops[i].state = &state;
+			state.ops[i].idx = i;
+
+			if (!queue_block(&state.ops[i])) {
+				state.error = true;
+				break;
+			}
+		}
+
+		while ((!state.error) && (engine.in_flight() > 0)) {
+			if (engine.poll() < 0) {
+				state.error = true;
+			}
+		}
+
+		if ((!state.error) && (state.writing)) {
+			if ((!f.fsync(true, on_fsync, &state)) || (engine.poll() != 1)) {
+				state.error = true;
+			}
+		}
+
+		if (state.error) {
+			fprintf(stderr, "Error %s file %s.\n", state.writing ? "writing" : "reading", kFilename);
+
+			// Wait for the operations in flight.
+			while ((engine.in_flight() > 0) && (engine.poll() >= 0));
+
+			free(p);
+			return false;
+		}
+	}
+
+	f.close();
+	free(p);
+
+	return check_file(kFilename, kFileSize);
+}
+
+bool queue_block(async_op* op)
+{
+	async_state* state = op->state;
+
+	// If there are no more blocks...
+	if (state->next >= static_cast<off_t>(kFileSize)) {
+		return true;
+	}
+
+	op->offset = state->next;
+	op->count = (kFileSize - op->offset < kBlockSize) ? kFileSize - op->offset : kBlockSize;
+
+	state->next += op->count;
+
+	char* buf = state->buffers + (op->idx * kBlockSize);
+	int buf_index = state->registered ? static_cast<int>(op->idx) : -1;
+
+	if (state->writing) {
+		for (unsigned i = 0; i < op->count; i++) {
+			buf[i] = data(op->offset + i);
+		}
+
+		return state->file->write(buf, op->count, op->offset, on_complete, op, buf_index);
+	} else {
+		return state->file->read(buf, op->count, op->offset, on_complete, op, buf_index);
+	}
+}
+
+void on_complete(int res, void* arg)
+{
+	async_op* op = reinterpret_cast<async_op*>(arg);
+	async_state* state = op->state;
+
+	// Short reads / writes are not expected on a regular file.
+	if (res != static_cast<int>(op->count)) {
+		state->error = true;
+		return;
+	}
+
+	if (!state->writing) {
+		const char* buf = state->buffers + (op->idx * kBlockSize);
+
+		for (unsigned i = 0; i < op->count; i++) {
+			if (buf[i] != data(op->offset + i)) {
+				fprintf(stderr, "Invalid data at offset %lu.\n", op->offset + i);
+
+				state->error = true;
+				return;
+			}
+		}
+	}
+
+	// Reuse the buffer for the next block.
+	if (!queue_block(op)) {
+		state->error = true;
+	}
+}
+
+void on_fsync(int res, void* arg)
+{
+	if (res < 0) {
+		reinterpret_cast<async_state*>(arg)->error = true;
+	}
+}
+
+int test_io_engine()
+{
+	unlink(kFilename);
+
+	static const unsigned kMaxFiles = 2;
+
+	fs::io_engine engine;
+	if ((!engine.init(4, kMaxFiles)) || (engine.init(4, kMaxFiles))) {
+		fprintf(stderr, "Couldn't initialize I/O engine (or initialized twice).\n");
+		return -1;
+	}
+
+	// Register a single buffer; the second half of the memory is not
+	// registered.
+	void* p;
+	if (posix_memalign(&p, 4096, 2 * 4096) != 0) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+		return -1;
+	}
+
+	char* buf = reinterpret_cast<char*>(p);
+
+	struct iovec iov;
+	iov.iov_base = buf;
+	iov.iov_len = 4096;
+
+	if (!engine.register_buffers(&iov, 1)) {
+		fprintf(stderr, "Couldn't register buffers.\n");
+
+		free(p);
+		return -1;
+	}
+
+	fs::async_file f(engine);
+	if (!f.open(kFilename, O_CREAT | O_RDWR, 0644)) {
+		fprintf(stderr, "Couldn't open file %s.\n", kFilename);
+
+		free(p);
+		return -1;
+	}
+
+	int ret = -1;
+
+	do {
+		// The file uses the first slot of the table.
+		if (!f.fixed()) {
+			fprintf(stderr, "The file should be registered.\n");
+			break;
+		}
+
+		for (unsigned i = 0; i < 4096; i++) {
+			buf[i] = data(i);
+		}
+
+		// Write and read back through the fixed file and the fixed
+		// buffer.
+		if ((engine_op(engine, true, 0, true, buf, 4096, 0) != 4096) ||
+		    (memset(buf, 0, 4096) == NULL) ||
+		    (engine_op(engine, false, 0, true, buf, 4096, 0) != 4096)) {
+			fprintf(stderr, "Error using the fixed file and buffer.\n");
+			break;
+		}
+
+		unsigned i;
+		for (i = 0; (i < 4096) && (buf[i] == data(i)); i++);
+
+		if (i != 4096) {
+			fprintf(stderr, "Invalid data at offset %u.\n", i);
+			break;
+		}
+
+		// The buffer is outside of the registered buffer.
+		if (engine_op(engine, false, 0, true, buf + 4096, 4096, 0) != -EFAULT) {
+			fprintf(stderr, "The fixed buffer has not been used.\n");
+			break;
+		}
+
+		// The second slot is empty.
+		if (engine_op(engine, false, 1, true, buf, 4096, 0) != -EBADF) {
+			fprintf(stderr, "The fixed file has not been used.\n");
+			break;
+		}
+
+		// Fill the table.
+		int fd = dup(f.fd());
+		if ((fd < 0) || (engine.register_file(fd) != 1) || (engine.register_file(fd) != -1) || (errno != ENFILE)) {
+			fprintf(stderr, "Error registering files.\n");
+
+			if (fd >= 0) {
+				close(fd);
+			}
+
+			break;
+		}
+
+		bool unregistered = engine.unregister_file(1);
+
+		close(fd);
+
+		if ((!unregistered) || (engine.unregister_file(1))) {
+			fprintf(stderr, "Error unregistering file.\n");
+			break;
+		}
+
+		// poll() returns after 'timeout' milliseconds if nothing
+		// completes (reading from an empty pipe), even if it is
+		// interrupted by signals (every 10 ms).
+		int pipefd[2];
+		if (pipe(pipefd) < 0) {
+			fprintf(stderr, "Couldn't create pipe.\n");
+			break;
+		}
+
+		struct sigaction act;
+		memset(&act, 0, sizeof(struct sigaction));
+		act.sa_handler = on_alarm;
+		sigemptyset(&act.sa_mask);
+		sigaction(SIGALRM, &act, NULL);
+
+		struct itimerval timer;
+		timer.it_interval.tv_sec = 0;
+		timer.it_interval.tv_usec = 10 * 1000;
+		timer.it_value = timer.it_interval;
+		setitimer(ITIMER_REAL, &timer, NULL);
+
+		int res = 1;
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		int n = engine.read(pipefd[0], false, buf, 1, -1, -1, on_result, &res) ? engine.poll(1, 200) : -1;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		memset(&timer, 0, sizeof(struct itimerval));
+		setitimer(ITIMER_REAL, &timer, NULL);
+
+		double ms = ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0;
+
+		// Complete the read.
+		bool completed = ((write(pipefd[1], "x", 1) == 1) && (engine.poll(1, 1000) == 1) && (res == 1));
+
+		close(pipefd[0]);
+		close(pipefd[1]);
+
+		if ((n != 0) || (ms < 190) || (ms > 1000) || (!completed)) {
+			fprintf(stderr, "Invalid poll() timeout (%d, %.2f ms).\n", n, ms);
+			break;
+		}
+
+		ret = 0;
+	} while (false);
+
+	if (!f.close()) {
+		fprintf(stderr, "Error closing file %s.\n", kFilename);
+		ret = -1;
+	}
+
+	free(p);
+
+	// If the table of files cannot be registered (too many files), the
+	// files are not registered.
+	if (ret == 0) {
+		fs::io_engine other;
+		fs::async_file g(other);
+
+		if ((!other.init(4, (1 << 20) + 1)) || (!g.open(kFilename, O_RDONLY)) || (g.fixed())) {
+			fprintf(stderr, "The file table should not be registered.\n");
+			ret = -1;
+		}
+	}
+
+	unlink(kFilename);
+
+	if (ret == 0) {
+		printf("Success.\n");
+	}
+
+	return ret;
+}
+
+int engine_op(fs::io_engine& engine, bool write, int fd, bool fixed, void* buf, unsigned count, int buf_index)
+{
+	int res = 0;
+
+	if (!(write ? engine.write(fd, fixed, buf, count, 0, buf_index, on_result, &res) :
+	              engine.read(fd, fixed, buf, count, 0, buf_index, on_result, &res))) {
+		return -1;
+	}
+
+	if (engine.poll() != 1) {
+		return -1;
+	}
+
+	return res;
+}
+
+void on_result(int res, void* arg)
+{
+	*reinterpret_cast<int*>(arg) = res;
+}
+
+void on_alarm(int nsignal)
+{
+}
+
+bool create_file(fs::file& f, size_t size)
+{
+	char buf[8 * 1024];
+	size_t offset = 0;
+
+	while (offset < size) {
+		size_t len = size - offset;
+		if (len > sizeof(buf)) {
+			len = sizeof(buf);
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			buf[i] = data(offset + i);
+		}
+
+		if (f.write(buf, len) != static_cast<ssize_t>(len)) {
+			return false;
+		}
+
+		offset += len;
+	}
+
+	return true;
+}
+
+bool check_file(const char* filename, size_t size)
+{
+	fs::file f;
+	if (!f.open(filename, O_RDONLY)) {
+		fprintf(stderr, "Couldn't open file %s.\n", filename);
+		return false;
+	}
+
+	char buf[8 * 1024];
+	size_t offset = 0;
+
+	do {
+		ssize_t ret;
+		if ((ret = f.read(buf, sizeof(buf))) < 0) {
+			fprintf(stderr, "Error reading from file %s.\n", filename);
+
+			f.close();
+			return false;
+		} else if (ret == 0) {
+			break;
+		}
+
+		for (ssize_t i = 0; i < ret; i++) {
+			if (buf[i] != data(offset + i)) {
+				fprintf(stderr, "Invalid data at offset %lu of file %s.\n", offset + i, filename);
+
+				f.close();
+				return false;
+			}
+		}
+
+		offset += ret;
+	} while (true);
+
+	f.close();
+
+	if (offset != size) {
+		fprintf(stderr, "Invalid size of file %s (%lu, expected: %lu).\n", filename, offset, size);
+		return false;
+	}
+
+	return true;
+}
+
+char data(size_t n)
+{
+	return static_cast<char>((n * 31) ^ (n >> 12));
+}
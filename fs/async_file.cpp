@@ -0,0 +1,52 @@
+#include "fs/async_file.h"
+
+bool fs::async_file::open(const char* pathname, int flags)
+{
+	if (!file::open(pathname, flags)) {
+		return false;
+	}
+
+	register_file();
+
+	return true;
+}
+
+bool fs::async_file::open(const char* pathname, int flags, mode_t mode)
+{
+	if (!file::open(pathname, flags, mode)) {
+		return false;
+	}
+
+	register_file();
+
+	return true;
+}
+
+bool fs::async_file::close()
+{
+	bool ret = true;
+
+	// If the file cannot be unregistered, it is closed anyway.
+	if (_M_index != -1) {
+		if (!_M_engine.unregister_file(_M_index)) {
+			ret = false;
+		}
+
+		_M_index = -1;
+	}
+
+	if (!file::close()) {
+		return false;
+	}
+
+	_M_fd = -1;
+
+	return ret;
+}
+
+void fs::async_file::register_file()
+{
+	// If the file cannot be registered (no free slots...), it is used
+	// through its file descriptor.
+	_M_index = _M_engine.register_file(_M_fd);
+}
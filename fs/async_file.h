@@ -0,0 +1,89 @@
+#ifndef FS_ASYNC_FILE_H
+#define FS_ASYNC_FILE_H
+
+// File with asynchronous reads, writes and fsyncs (see fs::io_engine).
+// The synchronous operations of fs::file remain available.
+
+#include "fs/file.h"
+#include "fs/io_engine.h"
+
+namespace fs {
+	class async_file : public file {
+		public:
+			// Constructor.
+			async_file(io_engine& engine);
+
+			// Destructor.
+			~async_file();
+
+			// Open file (and register it with the engine, if
+			// possible).
+			bool open(const char* pathname, int flags);
+			bool open(const char* pathname, int flags, mode_t mode);
+
+			// Close file (there must be no operations in flight).
+			bool close();
+
+			using file::read;
+			using file::write;
+
+			// Queue read / write. If 'buf_index' is not -1, 'buf' must
+			// be within the registered buffer 'buf_index'.
+			bool read(void* buf, unsigned count, off_t offset, io_engine::callback fn, void* arg, int buf_index = -1);
+			bool write(const void* buf, unsigned count, off_t offset, io_engine::callback fn, void* arg, int buf_index = -1);
+
+			// Queue fsync (fdatasync() if 'datasync' is true).
+			bool fsync(bool datasync, io_engine::callback fn, void* arg);
+
+			// Is the file registered with the engine?
+			bool fixed() const;
+
+		private:
+			io_engine& _M_engine;
+
+			// Index of the registered file (-1: not registered).
+			int _M_index;
+
+			// Register file with the engine.
+			void register_file();
+	};
+
+	inline async_file::async_file(io_engine& engine)
+		: _M_engine(engine),
+		  _M_index(-1)
+	{
+		_M_fd = -1;
+	}
+
+	inline async_file::~async_file()
+	{
+		if (_M_fd != -1) {
+			close();
+		}
+	}
+
+	inline bool async_file::read(void* buf, unsigned count, off_t offset, io_engine::callback fn, void* arg, int buf_index)
+	{
+		return (_M_index != -1) ? _M_engine.read(_M_index, true, buf, count, offset, buf_index, fn, arg) :
+		                          _M_engine.read(_M_fd, false, buf, count, offset, buf_index, fn, arg);
+	}
+
+	inline bool async_file::write(const void* buf, unsigned count, off_t offset, io_engine::callback fn, void* arg, int buf_index)
+	{
+		return (_M_index != -1) ? _M_engine.write(_M_index, true, buf, count, offset, buf_index, fn, arg) :
+		                          _M_engine.write(_M_fd, false, buf, count, offset, buf_index, fn, arg);
+	}
+
+	inline bool async_file::fsync(bool datasync, io_engine::callback fn, void* arg)
+	{
+		return (_M_index != -1) ? _M_engine.fsync(_M_index, true, datasync, fn, arg) :
+		                          _M_engine.fsync(_M_fd, false, datasync, fn, arg);
+	}
+
+	inline bool async_file::fixed() const
+	{
+		return (_M_index != -1);
+	}
+}
+
+#endif // FS_ASYNC_FILE_H
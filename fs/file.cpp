@@ -1,5 +1,6 @@
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <limits.h>
 #include <errno.h>
 #include "fs/file.h"
@@ -72,6 +73,17 @@ ssize_t fs::file::readv(const struct iovec* iov, unsigned iovcnt)
 	return ret;
 }
 
+ssize_t fs::file::preadv(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags)
+{
+	ssize_t ret;
+
+	do {
+		ret = ::preadv2(_M_fd, iov, iovcnt, offset, flags);
+	} while ((ret < 0) && (errno == EINTR));
+
+	return ret;
+}
+
 bool fs::file::read_all(const char* pathname, string::buffer& buf, off_t max)
 {
 	struct stat status;
@@ -116,6 +128,44 @@ bool fs::file::read_all(const char* pathname, string::buffer& buf, off_t max)
 	return true;
 }
 
+bool fs::file::mmap_all(const char* pathname, file_view& view, int advice)
+{
+	view.unmap();
+
+	file f;
+	if (!f.open(pathname, O_RDONLY)) {
+		return false;
+	}
+
+	struct stat status;
+	if ((fstat(f.fd(), &status) < 0) || (!S_ISREG(status.st_mode))) {
+		f.close();
+		return false;
+	}
+
+	// If the file is empty...
+	if (status.st_size == 0) {
+		f.close();
+		return true;
+	}
+
+	// The mapping remains valid after closing the file.
+	void* p = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, f.fd(), 0);
+
+	f.close();
+
+	if (p == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(p, status.st_size, advice);
+
+	view._M_data = p;
+	view._M_size = status.st_size;
+
+	return true;
+}
+
 ssize_t fs::file::write(const void* buf, size_t count)
 {
 	const char* b = reinterpret_cast<const char*>(buf);
@@ -169,48 +219,116 @@ ssize_t fs::file::pwrite(const void* buf, size_t count, off_t offset)
 
 ssize_t fs::file::writev(const struct iovec* iov, unsigned iovcnt)
 {
-	if (iovcnt > IOV_MAX) {
-		errno = EINVAL;
-		return -1;
-	}
-
-	struct iovec vec[IOV_MAX];
-	size_t total = 0;
-
-	for (unsigned i = 0; i < iovcnt; i++) {
-		vec[i].iov_base = iov[i].iov_base;
-		vec[i].iov_len = iov[i].iov_len;
+	return write_all(iov, iovcnt, -1, 0);
+}
 
-		total += vec[i].iov_len;
-	}
+ssize_t fs::file::pwritev(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags)
+{
+	return write_all(iov, iovcnt, offset, flags);
+}
 
-	struct iovec* v = vec;
-	size_t written = 0;
+ssize_t fs::file::copy_range(off_t* offset, int out, off_t* out_offset, size_t count)
+{
+	size_t copied = 0;
 
-	do {
+	while (copied < count) {
 		ssize_t ret;
-		if ((ret = ::writev(_M_fd, v, iovcnt)) < 0) {
-			if (errno != EINTR) {
-				return -1;
+		if ((ret = copy_file_range(_M_fd, offset, out, out_offset, count - copied, 0)) < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
-		} else if (ret > 0) {
-			if ((written += ret) == total) {
-				return total;
+
+			// If copy_file_range() cannot be used between these
+			// files, use sendfile().
+			if ((copied == 0) && ((errno == EXDEV) || (errno == EINVAL) || (errno == ENOSYS) || (errno == EOPNOTSUPP))) {
+				if (!out_offset) {
+					return sendfile(out, offset, count);
+				}
+
+				// sendfile() writes at the offset of 'out', move it
+				// to '*out_offset' and restore it afterwards.
+				off_t saved;
+				if (((saved = lseek(out, 0, SEEK_CUR)) < 0) || (lseek(out, *out_offset, SEEK_SET) != *out_offset)) {
+					return -1;
+				}
+
+				ret = sendfile(out, offset, count);
+
+				int error = errno;
+
+				if (lseek(out, saved, SEEK_SET) != saved) {
+					return -1;
+				}
+
+				if (ret > 0) {
+					*out_offset += ret;
+				}
+
+				errno = error;
+
+				return ret;
 			}
 
-			while ((size_t) ret >= v->iov_len) {
-				ret -= v->iov_len;
+			return -1;
+		} else if (ret == 0) {
+			// End of file.
+			break;
+		}
+
+		copied += ret;
+	}
+
+	return copied;
+}
+
+ssize_t fs::file::sendfile(int out, off_t* offset, size_t count)
+{
+	size_t sent = 0;
 
-				v++;
-				iovcnt--;
+	while (sent < count) {
+		ssize_t ret;
+		if ((ret = ::sendfile(out, _M_fd, offset, count - sent)) < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
 
-			if (ret > 0) {
-				v->iov_base = (char*) v->iov_base + ret;
-				v->iov_len -= ret;
+			// If 'out' would block, return what has been sent.
+			if ((errno == EAGAIN) && (sent > 0)) {
+				break;
 			}
+
+			return -1;
+		} else if (ret == 0) {
+			// End of file.
+			break;
 		}
-	} while (true);
+
+		sent += ret;
+	}
+
+	return sent;
+}
+
+ssize_t fs::file::splice_to(int pipe, off_t* offset, size_t count, unsigned flags)
+{
+	ssize_t ret;
+
+	do {
+		ret = ::splice(_M_fd, offset, pipe, NULL, count, flags);
+	} while ((ret < 0) && (errno == EINTR));
+
+	return ret;
+}
+
+ssize_t fs::file::splice_from(int pipe, off_t* offset, size_t count, unsigned flags)
+{
+	ssize_t ret;
+
+	do {
+		ret = ::splice(pipe, NULL, _M_fd, offset, count, flags);
+	} while ((ret < 0) && (errno == EINTR));
+
+	return ret;
 }
 
 off_t fs::file::seek(off_t offset, int whence)
@@ -238,3 +356,74 @@ bool fs::file::truncate(off_t length)
 
 	return (ret == 0);
 }
+
+bool fs::file::advise(off_t offset, off_t len, int advice)
+{
+	return (posix_fadvise(_M_fd, offset, len, advice) == 0);
+}
+
+ssize_t fs::file::write_all(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags)
+{
+	size_t written = 0;
+
+	// Bytes of the first buffer which have already been written.
+	size_t skip = 0;
+
+	while (iovcnt > 0) {
+		const struct iovec* vec = iov;
+		unsigned count = iovcnt;
+
+		// If the first buffer has been partially written, write the rest
+		// of it on its own (the caller's array is neither copied nor
+		// modified).
+		struct iovec rest;
+		if (skip > 0) {
+			rest.iov_base = reinterpret_cast<char*>(iov->iov_base) + skip;
+			rest.iov_len = iov->iov_len - skip;
+
+			vec = &rest;
+			count = 1;
+		}
+
+		ssize_t ret;
+		if ((ret = ::pwritev2(_M_fd, vec, count, offset, flags)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			// If the write would block (RWF_NOWAIT, non-blocking
+			// file), return what has been written.
+			if ((errno == EAGAIN) && (written > 0)) {
+				break;
+			}
+
+			return -1;
+		}
+
+		written += ret;
+
+		if (offset != -1) {
+			offset += ret;
+		}
+
+		// Skip the buffers which have been written.
+		size_t n = skip + ret;
+		while ((iovcnt > 0) && (n >= iov->iov_len)) {
+			n -= iov->iov_len;
+
+			iov++;
+			iovcnt--;
+		}
+
+		skip = n;
+
+		// If nothing has been written (the buffers left are not empty),
+		// retrying would loop forever.
+		if ((ret == 0) && (iovcnt > 0)) {
+			errno = EIO;
+			return -1;
+		}
+	}
+
+	return written;
+}
@@ -1,12 +1,75 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include <stdlib.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include "string/buffer.h"
 
 namespace fs {
+	// Read-only view of a file mapped in memory (unmapped by the
+	// destructor).
+	class file_view {
+		friend class file;
+
+		public:
+			// Constructor.
+			file_view();
+
+			// Destructor.
+			~file_view();
+
+			// Get data.
+			const char* data() const;
+
+			// Get size.
+			size_t size() const;
+
+			// Unmap.
+			void unmap();
+
+		private:
+			void* _M_data;
+			size_t _M_size;
+
+			// Disable copy constructor and assignment operator.
+			file_view(const file_view&);
+			file_view& operator=(const file_view&);
+	};
+
+	inline file_view::file_view()
+		: _M_data(NULL),
+		  _M_size(0)
+	{
+	}
+
+	inline file_view::~file_view()
+	{
+		unmap();
+	}
+
+	inline const char* file_view::data() const
+	{
+		return reinterpret_cast<const char*>(_M_data);
+	}
+
+	inline size_t file_view::size() const
+	{
+		return _M_size;
+	}
+
+	inline void file_view::unmap()
+	{
+		if (_M_data) {
+			munmap(_M_data, _M_size);
+
+			_M_data = NULL;
+			_M_size = 0;
+		}
+	}
+
 	class file {
 		public:
 			// Constructor.
@@ -29,9 +92,28 @@ namespace fs {
 			// Read into multiple buffers.
 			ssize_t readv(const struct iovec* iov, unsigned iovcnt);
 
+			// Read into multiple buffers at a given offset (-1: current
+			// offset) with preadv2() flags (RWF_NOWAIT, RWF_HIPRI...).
+			ssize_t preadv(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags = 0);
+
+			static const size_t kDefaultChunkSize = 256 * 1024;
+
 			// Read file.
 			static bool read_all(const char* pathname, string::buffer& buf, off_t max = 1024 * 1024);
 
+			// Read file in chunks of up to 'chunk_size' bytes, without
+			// loading the whole file in memory. For every chunk, 'fn' is
+			// called as: bool fn(const char* data, size_t len); if it
+			// returns false, the reading stops (and false is returned).
+			// 'fn' can be a function object, a lambda or a temporary.
+			template<typename _Fn>
+			static bool read_all(const char* pathname, _Fn&& fn, size_t chunk_size = kDefaultChunkSize);
+
+			// Map file in memory (read-only, no size limit).
+			// 'advice' is passed to madvise() (MADV_SEQUENTIAL,
+			// MADV_RANDOM, MADV_WILLNEED...).
+			static bool mmap_all(const char* pathname, file_view& view, int advice = MADV_SEQUENTIAL);
+
 			// Write.
 			ssize_t write(const void* buf, size_t count);
 
@@ -39,8 +121,36 @@ namespace fs {
 			ssize_t pwrite(const void* buf, size_t count, off_t offset);
 
 			// Write from multiple buffers.
+			// Returns the number of bytes written (less than the total
+			// if the write would block, e.g. RWF_NOWAIT or a
+			// non-blocking file) or -1.
 			ssize_t writev(const struct iovec* iov, unsigned iovcnt);
 
+			// Write from multiple buffers at a given offset (-1:
+			// current offset) with pwritev2() flags (RWF_DSYNC,
+			// RWF_HIPRI, RWF_NOWAIT...).
+			ssize_t pwritev(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags = 0);
+
+			// Copy 'count' bytes to 'out' without user-space buffers
+			// (copy_file_range(), sendfile() if not supported).
+			// If 'offset' / 'out_offset' are not NULL, they are used and
+			// updated instead of the file offsets (which are not
+			// modified).
+			// Returns the number of bytes copied (less than 'count' at
+			// the end of the file) or -1.
+			ssize_t copy_range(off_t* offset, int out, off_t* out_offset, size_t count);
+
+			// Send 'count' bytes to 'out' (socket, pipe, file...) with
+			// sendfile(). If 'offset' is not NULL, it is used and
+			// updated instead of the file offset.
+			// Returns the number of bytes sent (less than 'count' at
+			// the end of the file or if 'out' would block) or -1.
+			ssize_t sendfile(int out, off_t* offset, size_t count);
+
+			// Move up to 'count' bytes to / from a pipe (splice()).
+			ssize_t splice_to(int pipe, off_t* offset, size_t count, unsigned flags = SPLICE_F_MOVE);
+			ssize_t splice_from(int pipe, off_t* offset, size_t count, unsigned flags = SPLICE_F_MOVE);
+
 			// Seek.
 			off_t seek(off_t offset, int whence);
 
@@ -50,6 +160,9 @@ namespace fs {
 			// Truncate file.
 			bool truncate(off_t length);
 
+			// Announce an access pattern (posix_fadvise()).
+			bool advise(off_t offset, off_t len, int advice);
+
 			// Get file descriptor.
 			int fd() const;
 
@@ -58,6 +171,10 @@ namespace fs {
 
 		protected:
 			int _M_fd;
+
+		private:
+			// Write all the buffers (offset -1: current offset).
+			ssize_t write_all(const struct iovec* iov, unsigned iovcnt, off_t offset, int flags);
 	};
 
 	inline file::file()
@@ -78,6 +195,45 @@ namespace fs {
 	{
 		_M_fd = descriptor;
 	}
+
+	template<typename _Fn>
+	bool file::read_all(const char* pathname, _Fn&& fn, size_t chunk_size)
+	{
+		file f;
+		if (!f.open(pathname, O_RDONLY)) {
+			return false;
+		}
+
+		char* buf;
+		if ((buf = reinterpret_cast<char*>(malloc(chunk_size))) == NULL) {
+			f.close();
+			return false;
+		}
+
+		f.advise(0, 0, POSIX_FADV_SEQUENTIAL);
+
+		bool ret = true;
+
+		do {
+			ssize_t n;
+			if ((n = f.read(buf, chunk_size)) < 0) {
+				ret = false;
+				break;
+			} else if (n == 0) {
+				break;
+			}
+
+			if (!fn(buf, n)) {
+				ret = false;
+				break;
+			}
+		} while (true);
+
+		free(buf);
+		f.close();
+
+		return ret;
+	}
 }
 
 #endif // FILE_H
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "fs/io_engine.h"
+
+fs::io_engine::~io_engine()
+{
+	free(_M_requests);
+	free(_M_files);
+}
+
+bool fs::io_engine::init(unsigned entries, unsigned max_files)
+{
+	// If the engine has already been initialized...
+	if ((_M_requests) || (entries == 0)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	// At most 'entries' operations are in flight, so the completion
+	// queue (2 * 'entries' entries) cannot overflow.
+	if ((_M_requests = reinterpret_cast<request*>(malloc(entries * sizeof(request)))) == NULL) {
+		return false;
+	}
+
+	if ((max_files > 0) && ((_M_files = reinterpret_cast<int*>(malloc(max_files * sizeof(int)))) == NULL)) {
+		free(_M_requests);
+		_M_requests = NULL;
+
+		return false;
+	}
+
+	if (!_M_ring.init(entries)) {
+		free(_M_requests);
+		_M_requests = NULL;
+
+		free(_M_files);
+		_M_files = NULL;
+
+		return false;
+	}
+
+	for (unsigned i = 0; i < entries; i++) {
+		_M_requests[i].next = i + 1;
+	}
+
+	_M_requests[entries - 1].next = -1;
+	_M_free = 0;
+
+	_M_nrequests = entries;
+
+	if (max_files > 0) {
+		// Register a table of empty slots.
+		for (unsigned i = 0; i < max_files; i++) {
+			_M_files[i] = -1;
+		}
+
+		// If the table cannot be registered (sparse tables require
+		// Linux 5.5, too many files...), the files are used through
+		// their descriptors.
+		if (_M_ring.register_files(_M_files, max_files)) {
+			_M_max_files = max_files;
+		} else {
+			free(_M_files);
+			_M_files = NULL;
+		}
+	}
+
+	return true;
+}
+
+bool fs::io_engine::register_buffers(const struct iovec* iov, unsigned nr)
+{
+	return _M_ring.register_buffers(iov, nr);
+}
+
+int fs::io_engine::register_file(int fd)
+{
+	for (unsigned i = 0; i < _M_max_files; i++) {
+		if (_M_files[i] == -1) {
+			if (!_M_ring.update_files(i, &fd, 1)) {
+				return -1;
+			}
+
+			_M_files[i] = fd;
+
+			return i;
+		}
+	}
+
+	errno = ENFILE;
+	return -1;
+}
+
+bool fs::io_engine::unregister_file(int index)
+{
+	if ((index < 0) || (static_cast<unsigned>(index) >= _M_max_files) || (_M_files[index] == -1)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	int fd = -1;
+	if (!_M_ring.update_files(index, &fd, 1)) {
+		return false;
+	}
+
+	_M_files[index] = -1;
+
+	return true;
+}
+
+bool fs::io_engine::read(int fd, bool fixed, void* buf, unsigned count, off_t offset, int buf_index, callback fn, void* arg)
+{
+	return queue((buf_index < 0) ? IORING_OP_READ : IORING_OP_READ_FIXED, fd, fixed, buf, count, offset, buf_index, 0, fn, arg);
+}
+
+bool fs::io_engine::write(int fd, bool fixed, const void* buf, unsigned count, off_t offset, int buf_index, callback fn, void* arg)
+{
+	return queue((buf_index < 0) ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED, fd, fixed, buf, count, offset, buf_index, 0, fn, arg);
+}
+
+bool fs::io_engine::fsync(int fd, bool fixed, bool datasync, callback fn, void* arg)
+{
+	return queue(IORING_OP_FSYNC, fd, fixed, NULL, 0, 0, -1, datasync ? IORING_FSYNC_DATASYNC : 0, fn, arg);
+}
+
+bool fs::io_engine::submit()
+{
+	return _M_ring.submit();
+}
+
+int fs::io_engine::poll(unsigned min, int timeout)
+{
+	if (!_M_ring.submit()) {
+		return -1;
+	}
+
+	// The timeout is not restarted after every completion.
+	uint64_t deadline = (timeout > 0) ? uring::now() + timeout : 0;
+
+	unsigned n = 0;
+
+	do {
+		struct io_uring_cqe* cqe;
+		while ((cqe = _M_ring.peek()) != NULL) {
+			request* req = &_M_requests[cqe->user_data];
+			int res = cqe->res;
+
+			callback fn = req->fn;
+			void* arg = req->arg;
+
+			// Release the request before calling the callback, so
+			// the callback can queue new operations.
+			_M_ring.seen();
+			release_request(cqe->user_data);
+
+			fn(res, arg);
+
+			n++;
+		}
+
+		if ((n >= min) || (_M_in_flight == 0)) {
+			return n;
+		}
+
+		int ms = timeout;
+		if (timeout > 0) {
+			uint64_t t = uring::now();
+			if (t >= deadline) {
+				return n;
+			}
+
+			ms = static_cast<int>(deadline - t);
+		}
+
+		if (!_M_ring.wait(ms)) {
+			return (errno == ETIMEDOUT) ? static_cast<int>(n) : -1;
+		}
+	} while (true);
+}
+
+int fs::io_engine::get_request(callback fn, void* arg)
+{
+	int idx;
+	if ((idx = _M_free) == -1) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	_M_free = _M_requests[idx].next;
+
+	_M_requests[idx].fn = fn;
+	_M_requests[idx].arg = arg;
+
+	_M_in_flight++;
+
+	return idx;
+}
+
+void fs::io_engine::release_request(int idx)
+{
+	_M_requests[idx].next = _M_free;
+	_M_free = idx;
+
+	_M_in_flight--;
+}
+
+bool fs::io_engine::queue(unsigned char opcode, int fd, bool fixed, const void* buf, unsigned count, off_t offset, int buf_index, unsigned fsync_flags, callback fn, void* arg)
+{
+	int idx;
+	if ((idx = get_request(fn, arg)) == -1) {
+		return false;
+	}
+
+	unsigned char flags = fixed ? IOSQE_FIXED_FILE : 0;
+
+	// If the submission queue is full, submit it and retry.
+	for (unsigned i = 0; i < 2; i++) {
+		bool ret;
+
+		switch (opcode) {
+			case IORING_OP_READ:
+				ret = _M_ring.read(fd, const_cast<void*>(buf), count, offset, idx, flags);
+				break;
+			case IORING_OP_WRITE:
+				ret = _M_ring.write(fd, buf, count, offset, idx, flags);
+				break;
+			case IORING_OP_READ_FIXED:
+				ret = _M_ring.read_fixed(fd, const_cast<void*>(buf), count, offset, buf_index, idx, flags);
+				break;
+			case IORING_OP_WRITE_FIXED:
+				ret = _M_ring.write_fixed(fd, buf, count, offset, buf_index, idx, flags);
+				break;
+			default:
+				ret = _M_ring.fsync(fd, fsync_flags, idx, flags);
+		}
+
+		if (ret) {
+			return true;
+		}
+
+		if ((i == 0) && (!_M_ring.submit())) {
+			break;
+		}
+	}
+
+	release_request(idx);
+
+	return false;
+}
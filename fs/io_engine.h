@@ -0,0 +1,126 @@
+#ifndef FS_IO_ENGINE_H
+#define FS_IO_ENGINE_H
+
+// Asynchronous I/O engine (io_uring).
+//
+// Reads, writes and fsyncs are queued in the submission queue and
+// submitted in batches (by submit() or poll()); when an operation
+// completes, its callback is called from poll() as:
+// void fn(int res, void* arg), where 'res' is the result of the operation
+// (number of bytes transferred or -errno; reads and writes might be
+// short). Files can be registered (fixed files) to avoid the file lookup
+// on every operation, and buffers can be registered to avoid mapping the
+// user pages on every read / write.
+//
+// The engine is not thread-safe: it is meant to be used by a single
+// storage thread which keeps many operations in flight.
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "fs/uring.h"
+
+namespace fs {
+	class io_engine {
+		public:
+			typedef void (*callback)(int res, void* arg);
+
+			static const unsigned kDefaultEntries = 64;
+			static const unsigned kDefaultMaxFiles = 64;
+
+			// Constructor.
+			io_engine();
+
+			// Destructor.
+			~io_engine();
+
+			// Initialize: up to 'entries' operations can be in flight
+			// and up to 'max_files' files can be registered (none if
+			// the kernel doesn't support it).
+			bool init(unsigned entries = kDefaultEntries, unsigned max_files = kDefaultMaxFiles);
+
+			// Register buffers (must be called before queueing
+			// operations on them).
+			bool register_buffers(const struct iovec* iov, unsigned nr);
+
+			// Register file.
+			// Returns the index of the file or -1.
+			int register_file(int fd);
+
+			// Unregister file.
+			bool unregister_file(int index);
+
+			// Queue read / write.
+			// 'fd' is the index of a registered file if 'fixed' is
+			// true; if 'buf_index' is not -1, 'buf' must be within the
+			// registered buffer 'buf_index'.
+			// Returns false if too many operations are in flight
+			// (errno = EBUSY).
+			bool read(int fd, bool fixed, void* buf, unsigned count, off_t offset, int buf_index, callback fn, void* arg);
+			bool write(int fd, bool fixed, const void* buf, unsigned count, off_t offset, int buf_index, callback fn, void* arg);
+
+			// Queue fsync (fdatasync() if 'datasync' is true).
+			bool fsync(int fd, bool fixed, bool datasync, callback fn, void* arg);
+
+			// Submit the queued operations.
+			bool submit();
+
+			// Submit the queued operations and process the completions
+			// (calls the callbacks), waiting until at least 'min'
+			// operations have completed (or there are no operations
+			// in flight) or 'timeout' milliseconds have elapsed (-1:
+			// infinite).
+			// Returns the number of completed operations or -1.
+			int poll(unsigned min = 1, int timeout = -1);
+
+			// Get number of operations in flight.
+			unsigned in_flight() const;
+
+		private:
+			uring _M_ring;
+
+			struct request {
+				callback fn;
+				void* arg;
+
+				// Next free request.
+				int next;
+			};
+
+			request* _M_requests;
+			unsigned _M_nrequests;
+			int _M_free;
+
+			unsigned _M_in_flight;
+
+			// Registered files.
+			int* _M_files;
+			unsigned _M_max_files;
+
+			// Get a free request.
+			int get_request(callback fn, void* arg);
+
+			// Release request.
+			void release_request(int idx);
+
+			// Queue operation.
+			bool queue(unsigned char opcode, int fd, bool fixed, const void* buf, unsigned count, off_t offset, int buf_index, unsigned fsync_flags, callback fn, void* arg);
+	};
+
+	inline io_engine::io_engine()
+		: _M_requests(NULL),
+		  _M_nrequests(0),
+		  _M_free(-1),
+		  _M_in_flight(0),
+		  _M_files(NULL),
+		  _M_max_files(0)
+	{
+	}
+
+	inline unsigned io_engine::in_flight() const
+	{
+		return _M_in_flight;
+	}
+}
+
+#endif // FS_IO_ENGINE_H
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "fs/uring.h"
+#include "util/concurrent/atomic/atomic.h"
+#include "macros/macros.h"
+
+fs::uring::~uring()
+{
+	destroy();
+}
+
+bool fs::uring::init(unsigned entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(struct io_uring_params));
+
+	if ((_M_fd = syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+		_M_fd = -1;
+		return false;
+	}
+
+	_M_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_M_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	// If both rings can be mapped with a single mmap()...
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		_M_sq_ring_size = MAX(_M_sq_ring_size, _M_cq_ring_size);
+		_M_cq_ring_size = _M_sq_ring_size;
+	}
+
+	void* p;
+	if ((p = mmap(NULL, _M_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _M_fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+		destroy();
+		return false;
+	}
+
+	_M_sq_ring = p;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		_M_cq_ring = _M_sq_ring;
+	} else {
+		if ((p = mmap(NULL, _M_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _M_fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+			destroy();
+			return false;
+		}
+
+		_M_cq_ring = p;
+	}
+
+	_M_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	if ((p = mmap(NULL, _M_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _M_fd, IORING_OFF_SQES)) == MAP_FAILED) {
+		destroy();
+		return false;
+	}
+
+	_M_sqes = reinterpret_cast<struct io_uring_sqe*>(p);
+
+	unsigned char* sq = reinterpret_cast<unsigned char*>(_M_sq_ring);
+	_M_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	_M_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	_M_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	_M_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	_M_sq_entries = params.sq_entries;
+
+	_M_sqe_tail = *_M_sq_tail;
+
+	unsigned char* cq = reinterpret_cast<unsigned char*>(_M_cq_ring);
+	_M_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	_M_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	_M_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	_M_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	return true;
+}
+
+struct io_uring_sqe* fs::uring::get_sqe()
+{
+	// If the submission queue is full...
+	if (_M_sqe_tail - util::concurrent::atomic::acquire_load(_M_sq_head) >= _M_sq_entries) {
+		return NULL;
+	}
+
+	unsigned idx = _M_sqe_tail++ & _M_sq_mask;
+	_M_sq_array[idx] = idx;
+
+	struct io_uring_sqe* sqe = &_M_sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	return sqe;
+}
+
+bool fs::uring::read(int fd, void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags)
+{
+	return prep(IORING_OP_READ, fd, buf, count, offset, user_data, flags);
+}
+
+bool fs::uring::write(int fd, const void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags)
+{
+	return prep(IORING_OP_WRITE, fd, buf, count, offset, user_data, flags);
+}
+
+bool fs::uring::read_fixed(int fd, void* buf, unsigned count, off_t offset, unsigned buf_index, uint64_t user_data, unsigned char flags)
+{
+	if (!prep(IORING_OP_READ_FIXED, fd, buf, count, offset, user_data, flags)) {
+		return false;
+	}
+
+	_M_sqes[(_M_sqe_tail - 1) & _M_sq_mask].buf_index = buf_index;
+
+	return true;
+}
+
+bool fs::uring::write_fixed(int fd, const void* buf, unsigned count, off_t offset, unsigned buf_index, uint64_t user_data, unsigned char flags)
+{
+	if (!prep(IORING_OP_WRITE_FIXED, fd, buf, count, offset, user_data, flags)) {
+		return false;
+	}
+
+	_M_sqes[(_M_sqe_tail - 1) & _M_sq_mask].buf_index = buf_index;
+
+	return true;
+}
+
+bool fs::uring::fsync(int fd, unsigned fsync_flags, uint64_t user_data, unsigned char flags)
+{
+	if (!prep(IORING_OP_FSYNC, fd, NULL, 0, 0, user_data, flags)) {
+		return false;
+	}
+
+	_M_sqes[(_M_sqe_tail - 1) & _M_sq_mask].fsync_flags = fsync_flags;
+
+	return true;
+}
+
+bool fs::uring::register_buffers(const struct iovec* iov, unsigned nr)
+{
+	return (syscall(__NR_io_uring_register, _M_fd, IORING_REGISTER_BUFFERS, iov, nr) == 0);
+}
+
+bool fs::uring::register_files(const int* fds, unsigned nr)
+{
+	return (syscall(__NR_io_uring_register, _M_fd, IORING_REGISTER_FILES, fds, nr) == 0);
+}
+
+bool fs::uring::update_files(unsigned offset, const int* fds, unsigned nr)
+{
+	struct io_uring_files_update update;
+	memset(&update, 0, sizeof(struct io_uring_files_update));
+
+	update.offset = offset;
+	update.fds = reinterpret_cast<uintptr_t>(fds);
+
+	return (syscall(__NR_io_uring_register, _M_fd, IORING_REGISTER_FILES_UPDATE, &update, nr) == static_cast<long>(nr));
+}
+
+bool fs::uring::submit(unsigned wait)
+{
+	// Make the entries visible to the kernel.
+	util::concurrent::atomic::release_store(_M_sq_tail, _M_sqe_tail);
+
+	// Entries not consumed by the kernel yet (including the ones left
+	// by a previous short submission).
+	unsigned to_submit = _M_sqe_tail - util::concurrent::atomic::acquire_load(_M_sq_head);
+
+	if ((to_submit == 0) && (wait == 0)) {
+		return true;
+	}
+
+	do {
+		int ret;
+		if ((ret = enter(to_submit, wait, (wait > 0) ? IORING_ENTER_GETEVENTS : 0)) < 0) {
+			return false;
+		}
+
+		// If no entries have been consumed (the entries stay in the
+		// submission queue for the next call)...
+		if ((ret == 0) && (to_submit > 0)) {
+			errno = EBUSY;
+			return false;
+		}
+
+		to_submit -= ret;
+	} while (to_submit > 0);
+
+	return true;
+}
+
+struct io_uring_cqe* fs::uring::peek()
+{
+	unsigned head = *_M_cq_head;
+	if (head == util::concurrent::atomic::acquire_load(_M_cq_tail)) {
+		return NULL;
+	}
+
+	return &_M_cqes[head & _M_cq_mask];
+}
+
+void fs::uring::seen()
+{
+	util::concurrent::atomic::release_store(_M_cq_head, *_M_cq_head + 1);
+}
+
+bool fs::uring::wait(int timeout)
+{
+	// The timeout is not restarted after a signal or a wakeup without
+	// completions.
+	uint64_t deadline = (timeout > 0) ? now() + timeout : 0;
+
+	while (!peek()) {
+		if (timeout < 0) {
+			if (!submit(1)) {
+				return false;
+			}
+		} else {
+			// Let the kernel post pending completions (and consume
+			// the entries left by a short submission).
+			unsigned to_submit = *_M_sq_tail - util::concurrent::atomic::acquire_load(_M_sq_head);
+
+			if (enter(to_submit, 0, IORING_ENTER_GETEVENTS) < 0) {
+				return false;
+			}
+
+			if (peek()) {
+				break;
+			}
+
+			int ms = timeout;
+			if (timeout > 0) {
+				uint64_t t = now();
+				if (t >= deadline) {
+					errno = ETIMEDOUT;
+					return false;
+				}
+
+				ms = static_cast<int>(deadline - t);
+			}
+
+			struct pollfd pfd;
+			pfd.fd = _M_fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+
+			int ret;
+			if ((ret = poll(&pfd, 1, ms)) == 0) {
+				errno = ETIMEDOUT;
+				return false;
+			} else if ((ret < 0) && (errno != EINTR)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+uint64_t fs::uring::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (static_cast<uint64_t>(ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
+
+void fs::uring::destroy()
+{
+	int error = errno;
+
+	if (_M_sqes) {
+		munmap(_M_sqes, _M_sqes_size);
+		_M_sqes = NULL;
+	}
+
+	if ((_M_cq_ring) && (_M_cq_ring != _M_sq_ring)) {
+		munmap(_M_cq_ring, _M_cq_ring_size);
+	}
+
+	_M_cq_ring = NULL;
+
+	if (_M_sq_ring) {
+		munmap(_M_sq_ring, _M_sq_ring_size);
+		_M_sq_ring = NULL;
+	}
+
+	if (_M_fd != -1) {
+		close(_M_fd);
+		_M_fd = -1;
+	}
+
+	errno = error;
+}
+
+int fs::uring::enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, _M_fd, to_submit, min_complete, flags, NULL, 0);
+	} while ((ret < 0) && (errno == EINTR));
+
+	return ret;
+}
+
+bool fs::uring::prep(unsigned char opcode, int fd, const void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags)
+{
+	struct io_uring_sqe* sqe;
+	if ((sqe = get_sqe()) == NULL) {
+		return false;
+	}
+
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uintptr_t>(buf);
+	sqe->len = count;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+
+	return true;
+}
@@ -0,0 +1,123 @@
+#ifndef FS_URING_H
+#define FS_URING_H
+
+// Minimal io_uring interface (raw system calls, no liburing).
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+namespace fs {
+	class uring {
+		public:
+			// Constructor.
+			uring();
+
+			// Destructor.
+			~uring();
+
+			// Initialize with (at least) 'entries' submission queue
+			// entries (on error, the ring is released).
+			bool init(unsigned entries);
+
+			// Get a submission queue entry (NULL if the queue is full).
+			struct io_uring_sqe* get_sqe();
+
+			// Queue read / write ('flags': IOSQE_* flags, e.g.
+			// IOSQE_FIXED_FILE if 'fd' is the index of a registered
+			// file).
+			bool read(int fd, void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags = 0);
+			bool write(int fd, const void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags = 0);
+
+			// Queue read / write from / to the registered buffer
+			// 'buf_index' ('buf' must be within the buffer).
+			bool read_fixed(int fd, void* buf, unsigned count, off_t offset, unsigned buf_index, uint64_t user_data, unsigned char flags = 0);
+			bool write_fixed(int fd, const void* buf, unsigned count, off_t offset, unsigned buf_index, uint64_t user_data, unsigned char flags = 0);
+
+			// Queue fsync ('fsync_flags': 0 or IORING_FSYNC_DATASYNC).
+			bool fsync(int fd, unsigned fsync_flags, uint64_t user_data, unsigned char flags = 0);
+
+			// Register buffers (for read_fixed() / write_fixed()).
+			bool register_buffers(const struct iovec* iov, unsigned nr);
+
+			// Register files (-1: empty slot).
+			bool register_files(const int* fds, unsigned nr);
+
+			// Replace the registered files [offset, offset + nr).
+			bool update_files(unsigned offset, const int* fds, unsigned nr);
+
+			// Submit the queued entries (and the ones left by a previous short
+			// submission) and wait for 'wait' completions.
+			bool submit(unsigned wait = 0);
+
+			// Get next completion (NULL if there are no completions).
+			struct io_uring_cqe* peek();
+
+			// Mark the completion returned by peek() as consumed.
+			void seen();
+
+			// Wait for a completion ('timeout' in milliseconds, -1:
+			// infinite). On timeout, errno is set to ETIMEDOUT.
+			bool wait(int timeout);
+
+			// Get file descriptor of the ring.
+			int fd() const;
+
+			// Get current time (milliseconds, monotonic clock).
+			static uint64_t now();
+
+		private:
+			int _M_fd;
+
+			// Submission queue.
+			unsigned* _M_sq_head;
+			unsigned* _M_sq_tail;
+			unsigned _M_sq_mask;
+			unsigned* _M_sq_array;
+			struct io_uring_sqe* _M_sqes;
+			unsigned _M_sq_entries;
+
+			// Local tail (entries queued but not submitted yet).
+			unsigned _M_sqe_tail;
+
+			// Completion queue.
+			unsigned* _M_cq_head;
+			unsigned* _M_cq_tail;
+			unsigned _M_cq_mask;
+			struct io_uring_cqe* _M_cqes;
+
+			void* _M_sq_ring;
+			size_t _M_sq_ring_size;
+
+			void* _M_cq_ring;
+			size_t _M_cq_ring_size;
+
+			size_t _M_sqes_size;
+
+			// Release the rings and close the file descriptor.
+			void destroy();
+
+			// Enter the kernel.
+			int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+			// Queue operation.
+			bool prep(unsigned char opcode, int fd, const void* buf, unsigned count, off_t offset, uint64_t user_data, unsigned char flags);
+	};
+
+	inline uring::uring()
+		: _M_fd(-1),
+		  _M_sqes(NULL),
+		  _M_sqe_tail(0),
+		  _M_sq_ring(NULL),
+		  _M_cq_ring(NULL)
+	{
+	}
+
+	inline int uring::fd() const
+	{
+		return _M_fd;
+	}
+}
+
+#endif // FS_URING_H
@@ -4,12 +4,16 @@
 #include <pthread.h>
 #include <signal.h>
 #include <sched.h>
+#include <time.h>
 #include "util/concurrent/insert_only_skiplist.h"
+#include "util/concurrent/arena_allocator.h"
 #include "util/concurrent/locks/spinlock.h"
 
 static const unsigned kNumberReaders = 33;
 static const unsigned kNumberWriters = 33;
 static const unsigned kNumberIterators = 33;
+static const unsigned kNumberInserters = 8;
+static const unsigned kNumberKeys = 1024 * 1024;
 static const unsigned kHighestRandom = 4 * 1024 * 1024;
 
 struct longcmp {
@@ -39,6 +43,14 @@ static void* iterator(void* arg);
 static void test_concurrent_skiplist_iterators();
 static void print_list(const util::concurrent::insert_only_skiplist<long, longcmp>& list, bool forward);
 
+template<typename _Allocator>
+static void test_allocator(const char* name);
+
+template<typename _Allocator>
+static void* inserter(void* arg);
+
+static int test_bulk_load();
+
 int main(int argc, char** argv)
 {
 	if (argc != 2) {
@@ -48,7 +60,8 @@ int main(int argc, char** argv)
 		fprintf(stderr, "\t\t%u writers, %u\n", kNumberWriters);
 		fprintf(stderr, "\t\t%u iterators.\n", kNumberIterators);
 		fprintf(stderr, "\t1: Test iterators in concurrent skip list.\n");
-		fprintf(stderr, "\t2: Test skip list (one thread).\n");
+		fprintf(stderr, "\t2: Compare malloc and arena node allocation (%u inserters).\n", kNumberInserters);
+		fprintf(stderr, "\t3: Test bulk load.\n");
 
 		return -1;
 	}
@@ -60,6 +73,12 @@ int main(int argc, char** argv)
 		case 1:
 			test_concurrent_skiplist_iterators();
 			break;
+		case 2:
+			test_allocator<util::malloc_allocator>("malloc");
+			test_allocator<util::concurrent::arena_allocator>("arena");
+			break;
+		case 3:
+			return test_bulk_load();
 		default:
 			fprintf(stderr, "Wrong test number %s.\n", argv[1]);
 			return -1;
@@ -323,3 +342,166 @@ void print_list(const util::concurrent::insert_only_skiplist<long, longcmp>& lis
 		}
 	}
 }
+
+template<typename _Allocator>
+struct inserter_arg {
+	util::concurrent::insert_only_skiplist<long, longcmp, _Allocator>* list;
+	unsigned id;
+};
+
+template<typename _Allocator>
+void test_allocator(const char* name)
+{
+	util::concurrent::insert_only_skiplist<long, longcmp, _Allocator> list;
+
+	if (!list.init()) {
+		fprintf(stderr, "Couldn't initialize skip list.\n");
+		return;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Create inserters.
+	pthread_t inserters[kNumberInserters];
+	inserter_arg<_Allocator> args[kNumberInserters];
+	for (unsigned i = 0; i < kNumberInserters; i++) {
+		args[i].list = &list;
+		args[i].id = i;
+
+		if (pthread_create(&inserters[i], NULL, inserter<_Allocator>, &args[i]) != 0) {
+			fprintf(stderr, "Couldn't create inserter %u.\n", i);
+			return;
+		}
+	}
+
+	// Wait for inserters.
+	for (unsigned i = 0; i < kNumberInserters; i++) {
+		pthread_join(inserters[i], NULL);
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (long i = 0; i < kNumberKeys; i++) {
+		if (!list.contains(i)) {
+			fprintf(stderr, "%ld not found.\n", i);
+			return;
+		}
+	}
+
+	double elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+	printf("[%s] %u keys inserted in %.3f seconds (%.0f inserts/second).\n", name, kNumberKeys, elapsed, kNumberKeys / elapsed);
+}
+
+template<typename _Allocator>
+void* inserter(void* arg)
+{
+	inserter_arg<_Allocator>* a = reinterpret_cast<inserter_arg<_Allocator>*>(arg);
+
+	// Insert keys in an interleaved order.
+	for (long i = a->id; i < kNumberKeys; i += kNumberInserters) {
+		long n = (i * 2654435761u) % kNumberKeys;
+		if (!a->list->insert(n)) {
+			fprintf(stderr, "Couldn't insert %ld.\n", n);
+		}
+	}
+
+	return NULL;
+}
+
+int test_bulk_load()
+{
+	long* keys;
+	if ((keys = reinterpret_cast<long*>(malloc(kNumberKeys * sizeof(long)))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory for the keys.\n");
+		return -1;
+	}
+
+	for (unsigned i = 0; i < kNumberKeys; i++) {
+		keys[i] = i * 2;
+	}
+
+	util::concurrent::insert_only_skiplist<long, longcmp> list;
+
+	if (!list.init()) {
+		fprintf(stderr, "Couldn't initialize skip list.\n");
+		free(keys);
+		return -1;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (!list.bulk_load(keys, keys + kNumberKeys)) {
+		fprintf(stderr, "Couldn't bulk load keys.\n");
+		free(keys);
+		return -1;
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+	printf("%u keys loaded in %.3f seconds.\n", kNumberKeys, elapsed);
+
+	// Insert the odd keys.
+	for (unsigned i = 0; i < kNumberKeys; i++) {
+		if (!list.insert((i * 2) + 1)) {
+			fprintf(stderr, "Couldn't insert %u.\n", (i * 2) + 1);
+			free(keys);
+			return -1;
+		}
+	}
+
+	util::concurrent::insert_only_skiplist<long, longcmp>::iterator it;
+	long count = 0;
+	if (list.begin(it)) {
+		do {
+			if (it.key() != count) {
+				fprintf(stderr, "Wrong key %ld (expected %ld).\n", it.key(), count);
+				free(keys);
+				return -1;
+			}
+
+			count++;
+		} while (list.next(it));
+	}
+
+	if (count != kNumberKeys * 2) {
+		fprintf(stderr, "Wrong number of keys %ld (expected %u).\n", count, kNumberKeys * 2);
+		free(keys);
+		return -1;
+	}
+
+	// Unsorted keys: the keys loaded are removed.
+	util::concurrent::insert_only_skiplist<long, longcmp> unsorted;
+	if (!unsorted.init()) {
+		fprintf(stderr, "Couldn't initialize skip list.\n");
+		free(keys);
+		return -1;
+	}
+
+	keys[kNumberKeys / 2] = -1;
+
+	if ((unsorted.bulk_load(keys, keys + kNumberKeys)) || (unsorted.begin(it)) || (unsorted.contains(0))) {
+		fprintf(stderr, "Bulk load of unsorted keys left keys in the list.\n");
+		free(keys);
+		return -1;
+	}
+
+	// The list can be loaded again.
+	if ((!unsorted.bulk_load(keys, keys + (kNumberKeys / 2))) || (!unsorted.contains(0)) || (!unsorted.contains(((kNumberKeys / 2) - 1) * 2))) {
+		fprintf(stderr, "Couldn't bulk load keys after a failed bulk load.\n");
+		free(keys);
+		return -1;
+	}
+
+	free(keys);
+
+	printf("Success.\n");
+
+	return 0;
+}
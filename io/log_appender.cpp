@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "io/log_appender.h"
+#include "util/concurrent/atomic/atomic.h"
+#include "macros/macros.h"
+
+static inline void futex_wait(int* addr, int val, const struct timespec* timeout)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline void futex_wake(int* addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+io::log_appender::log_appender(size_t buffer_size, unsigned flush_interval)
+	: _M_buf(NULL),
+	  _M_published(NULL),
+	  _M_flush_interval(flush_interval),
+	  _M_reserved(0),
+	  _M_written(0),
+	  _M_sleeping(kAwake),
+	  _M_room(0),
+	  _M_waiters(0),
+	  _M_running(false),
+	  _M_stop(false),
+	  _M_error(false)
+{
+	// Round up to a power of two.
+	_M_size = 2 * kChunkSize;
+	while (_M_size < buffer_size) {
+		_M_size <<= 1;
+	}
+
+	_M_mask = _M_size - 1;
+}
+
+bool io::log_appender::open(const char* filename)
+{
+	if ((!_M_buf) && ((_M_buf = reinterpret_cast<char*>(malloc(_M_size))) == NULL)) {
+		return false;
+	}
+
+	if ((!_M_published) && ((_M_published = reinterpret_cast<uint32_t*>(malloc((_M_size / kChunkSize) * sizeof(uint32_t)))) == NULL)) {
+		return false;
+	}
+
+	if (!_M_file.open(filename)) {
+		return false;
+	}
+
+	memset(_M_published, 0, (_M_size / kChunkSize) * sizeof(uint32_t));
+
+	_M_reserved = 0;
+	_M_written = 0;
+
+	_M_sleeping = kAwake;
+
+	_M_stop = false;
+	_M_error = false;
+
+	if (pthread_create(&_M_thread, NULL, run, this) != 0) {
+		_M_file.close();
+		return false;
+	}
+
+	_M_running = true;
+
+	return true;
+}
+
+bool io::log_appender::close()
+{
+	if (!_M_running) {
+		return true;
+	}
+
+	// Stop flusher (it writes the pending records first).
+	util::concurrent::atomic::bool_compare_and_swap(&_M_stop, false, true);
+	wake_flusher();
+
+	pthread_join(_M_thread, NULL);
+
+	_M_running = false;
+
+	return ((_M_file.close()) && (!_M_error));
+}
+
+bool io::log_appender::append(const void* buf, size_t len)
+{
+	if ((len == 0) || (len > _M_size - kChunkSize)) {
+		return (len == 0);
+	}
+
+	// Reserve space.
+	uint64_t begin = util::concurrent::atomic::add(&_M_reserved, static_cast<uint64_t>(len));
+	uint64_t end = begin + len;
+
+	// Wait until the chunks of the previous lap where the record goes
+	// have been written.
+	if (!wait((end - _M_size + kChunkSize - 1) & ~static_cast<uint64_t>(kChunkSize - 1))) {
+		return false;
+	}
+
+	// Copy record (it might wrap around).
+	size_t pos = begin & _M_mask;
+	size_t n = _M_size - pos;
+
+	if (n >= len) {
+		memcpy(_M_buf + pos, buf, len);
+	} else {
+		memcpy(_M_buf + pos, buf, n);
+		memcpy(_M_buf, reinterpret_cast<const char*>(buf) + n, len - n);
+	}
+
+	// Publish record in every chunk it spans.
+	uint64_t offset = begin;
+	do {
+		uint64_t chunk_end = (offset | (kChunkSize - 1)) + 1;
+		uint32_t count = static_cast<uint32_t>(MIN(end, chunk_end) - offset);
+
+		util::concurrent::atomic::add(&_M_published[(offset & _M_mask) / kChunkSize], count);
+
+		offset += count;
+	} while (offset < end);
+
+	// The flusher checks for appended records after announcing that it
+	// is going to sleep.
+	switch (util::concurrent::atomic::acquire_load(&_M_sleeping)) {
+		case kIdle:
+			wake_flusher();
+			break;
+		case kBatching:
+			// If a batch is ready or a thread is waiting...
+			if ((end - util::concurrent::atomic::acquire_load(&_M_written) >= _M_size / 4) ||
+			    (util::concurrent::atomic::acquire_load(&_M_waiters) > 0)) {
+				wake_flusher();
+			}
+
+			break;
+	}
+
+	return true;
+}
+
+bool io::log_appender::flush()
+{
+	return wait(util::concurrent::atomic::acquire_load(&_M_reserved));
+}
+
+bool io::log_appender::sync()
+{
+	return ((flush()) && (_M_file.sync()));
+}
+
+void* io::log_appender::run(void* arg)
+{
+	reinterpret_cast<log_appender*>(arg)->run();
+	return NULL;
+}
+
+void io::log_appender::run()
+{
+	uint64_t written = 0;
+
+	// Set when the batch has to be written.
+	bool due = false;
+
+	do {
+		bool stop = util::concurrent::atomic::acquire_load(&_M_stop);
+
+		uint64_t end = published(written);
+
+		if ((end > written) && ((due) || (urgent(written, end)))) {
+			due = false;
+
+			if (!write(written, end)) {
+				util::concurrent::atomic::release_store(&_M_error, true);
+				wake_producers();
+
+				return;
+			}
+
+			// Reset the counters of the chunks which have been
+			// written completely.
+			for (uint64_t chunk = written & ~static_cast<uint64_t>(kChunkSize - 1); chunk + kChunkSize <= end; chunk += kChunkSize) {
+				_M_published[(chunk & _M_mask) / kChunkSize] = 0;
+			}
+
+			written = end;
+
+			// Make room for the producers.
+			util::concurrent::atomic::release_store(&_M_written, written);
+			wake_producers();
+		} else if (stop) {
+			// If all the records have been written...
+			if (written == util::concurrent::atomic::acquire_load(&_M_reserved)) {
+				return;
+			}
+
+			sched_yield();
+		} else {
+			due = sleep(written, end);
+		}
+	} while (true);
+}
+
+uint64_t io::log_appender::published(uint64_t written) const
+{
+	uint64_t end = written;
+	uint64_t first = written & ~static_cast<uint64_t>(kChunkSize - 1);
+
+	// Every chunk of the ring buffer at most once (the counter of the
+	// first one also counts the bytes before 'written').
+	for (uint64_t chunk = first; chunk - first < _M_size; chunk += kChunkSize) {
+		uint32_t count = util::concurrent::atomic::acquire_load(&_M_published[(chunk & _M_mask) / kChunkSize]);
+
+		// If the whole chunk has been published...
+		if (count == kChunkSize) {
+			end = chunk + kChunkSize;
+			continue;
+		}
+
+		// The counter is read before the reserved offset, so it only
+		// counts bytes below the reserved offset: if it matches, all the
+		// bytes reserved in the chunk have been published.
+		uint64_t reserved = util::concurrent::atomic::acquire_load(&_M_reserved);
+		uint64_t limit = MIN(reserved, chunk + kChunkSize);
+
+		if (count == limit - chunk) {
+			end = limit;
+		}
+
+		break;
+	}
+
+	return end;
+}
+
+bool io::log_appender::write(uint64_t begin, uint64_t end)
+{
+	size_t pos = begin & _M_mask;
+	size_t len = end - begin;
+
+	struct iovec iov[2];
+	unsigned iovcnt = 1;
+
+	iov[0].iov_base = _M_buf + pos;
+
+	// If the region wraps around...
+	if (pos + len > _M_size) {
+		iov[0].iov_len = _M_size - pos;
+
+		iov[1].iov_base = _M_buf;
+		iov[1].iov_len = len - iov[0].iov_len;
+
+		iovcnt = 2;
+	} else {
+		iov[0].iov_len = len;
+	}
+
+	return _M_file.write(iov, iovcnt);
+}
+
+bool io::log_appender::urgent(uint64_t written, uint64_t end) const
+{
+	// A quarter of the ring buffer is ready, a thread is waiting or the
+	// appender is being closed.
+	return ((end - written >= _M_size / 4) ||
+	        (util::concurrent::atomic::acquire_load(&_M_waiters) > 0) ||
+	        (util::concurrent::atomic::acquire_load(&_M_stop)));
+}
+
+bool io::log_appender::sleep(uint64_t written, uint64_t end)
+{
+	// If nothing has been reserved, sleep until a record is appended;
+	// otherwise, until the batch is ready (a producer might be copying the
+	// next record, the records published after it can't be written yet).
+	int state = (util::concurrent::atomic::acquire_load(&_M_reserved) != written) ? kBatching : kIdle;
+
+	// Announce that the flusher is going to sleep (full barrier) and check
+	// again: a producer which appends a record (or a thread which starts
+	// waiting) afterwards wakes it up.
+	util::concurrent::atomic::bool_compare_and_swap(&_M_sleeping, static_cast<int>(kAwake), state);
+
+	if (state == kIdle) {
+		if ((util::concurrent::atomic::acquire_load(&_M_reserved) == written) &&
+		    (!util::concurrent::atomic::acquire_load(&_M_stop))) {
+			futex_wait(&_M_sleeping, state, NULL);
+		}
+	} else {
+		// If there is nothing to write or the batch is not ready...
+		if (((end = published(written)) == written) || (!urgent(written, end))) {
+			struct timespec timeout;
+			timeout.tv_sec = _M_flush_interval / 1000000;
+			timeout.tv_nsec = (_M_flush_interval % 1000000) * 1000;
+
+			futex_wait(&_M_sleeping, state, &timeout);
+		}
+	}
+
+	util::concurrent::atomic::release_store(&_M_sleeping, static_cast<int>(kAwake));
+
+	// After batching, write what has been published.
+	return (state == kBatching);
+}
+
+void io::log_appender::wake_flusher()
+{
+	int state = util::concurrent::atomic::acquire_load(&_M_sleeping);
+
+	if ((state != kAwake) && (util::concurrent::atomic::bool_compare_and_swap(&_M_sleeping, state, static_cast<int>(kAwake)))) {
+		futex_wake(&_M_sleeping, 1);
+	}
+}
+
+void io::log_appender::wake_producers()
+{
+	// The producers check the written offset after announcing that they
+	// are going to sleep (full barrier).
+	util::concurrent::atomic::add(&_M_room, 1);
+
+	if (util::concurrent::atomic::acquire_load(&_M_waiters) > 0) {
+		futex_wake(&_M_room, INT_MAX);
+	}
+}
+
+bool io::log_appender::wait(uint64_t offset)
+{
+	while (static_cast<int64_t>(offset - util::concurrent::atomic::acquire_load(&_M_written)) > 0) {
+		if (util::concurrent::atomic::acquire_load(&_M_error)) {
+			return false;
+		}
+
+		int room = util::concurrent::atomic::acquire_load(&_M_room);
+
+		util::concurrent::atomic::add(&_M_waiters, 1u);
+
+		// Don't wait for the batch to be ready.
+		wake_flusher();
+
+		// If the flusher hasn't written in the meantime...
+		if ((static_cast<int64_t>(offset - util::concurrent::atomic::acquire_load(&_M_written)) > 0) &&
+		    (!util::concurrent::atomic::acquire_load(&_M_error))) {
+			futex_wait(&_M_room, room, NULL);
+		}
+
+		util::concurrent::atomic::sub(&_M_waiters, 1u);
+	}
+
+	return true;
+}
@@ -0,0 +1,156 @@
+#ifndef IO_LOG_APPENDER_H
+#define IO_LOG_APPENDER_H
+
+// Log to which several threads can append concurrently.
+//
+// The records are copied into a ring buffer: a producer reserves space by
+// incrementing the reserved offset (atomic fetch-and-add), copies its record
+// in parallel with the other producers and publishes it by adding its length
+// to the counter of the chunk (kChunkSize bytes) of the ring buffer where it
+// lies. A single flusher thread writes the chunks whose bytes have all been
+// published (and, at the end of the reserved data, the part of the chunk
+// which has been reserved and published), so it only writes contiguous
+// regions of complete records, straight from the ring buffer (a slow
+// producer doesn't block the others, only the write of the records which
+// follow it).
+//
+// The records are written in batches: the flusher sleeps (futex) until a
+// quarter of the ring buffer has been published, a thread waits for the
+// records to be written (flush() or the ring buffer is full) or
+// 'flush_interval' microseconds have elapsed. When nothing has been reserved,
+// it sleeps until a record is appended. Producers only sleep when the ring
+// buffer is full, until the flusher makes room.
+
+#include <stdint.h>
+#include <pthread.h>
+#include "io/sequential_write_only_file.h"
+
+namespace io {
+	class log_appender {
+		public:
+			static const size_t kDefaultBufferSize = 1024 * 1024;
+			static const unsigned kDefaultFlushInterval = 1000;
+
+			// Size of the chunks of the ring buffer.
+			static const size_t kChunkSize = 4096;
+
+			// Constructor.
+			// 'buffer_size' is rounded up to a power of two (at least
+			// two chunks); the records are written at most
+			// 'flush_interval' microseconds after being appended.
+			log_appender(size_t buffer_size = kDefaultBufferSize, unsigned flush_interval = kDefaultFlushInterval);
+
+			// Destructor.
+			~log_appender();
+
+			// Open (starts the flusher thread).
+			bool open(const char* filename);
+
+			// Close (the records appended so far are written). Must be
+			// called when no other thread is appending.
+			bool close();
+
+			// Append record (thread-safe). The record must not be
+			// bigger than the buffer minus one chunk.
+			bool append(const void* buf, size_t len);
+
+			// Wait until the records appended so far (by all the
+			// threads) have been written.
+			bool flush();
+
+			// Flush and flush data to disk (fdatasync()).
+			bool sync();
+
+			// Get number of bytes written to the file.
+			uint64_t written() const;
+
+		private:
+			sequential_write_only_file _M_file;
+
+			// Ring buffer.
+			char* _M_buf;
+			size_t _M_size;
+			size_t _M_mask;
+
+			// Number of bytes published in every chunk of the ring
+			// buffer.
+			uint32_t* _M_published;
+
+			unsigned _M_flush_interval;
+
+			// Offsets (relative to the offset of the file when it was
+			// opened).
+			uint64_t _M_reserved;
+			uint64_t _M_written;
+
+			// Futex on which the flusher sleeps.
+			enum sleep_state {
+				kAwake,
+
+				// Until a record is appended.
+				kIdle,
+
+				// Until a batch is ready (or the flush interval).
+				kBatching
+			};
+
+			int _M_sleeping;
+
+			// Futex on which the threads waiting for the records to
+			// be written sleep (incremented when the flusher writes)
+			// and number of waiting threads.
+			int _M_room;
+			unsigned _M_waiters;
+
+			bool _M_running;
+			bool _M_stop;
+			bool _M_error;
+
+			pthread_t _M_thread;
+
+			// Flusher thread.
+			static void* run(void* arg);
+			void run();
+
+			// Get end of the region which can be written from
+			// 'written'.
+			uint64_t published(uint64_t written) const;
+
+			// Write the region [begin, end) of the ring buffer.
+			bool write(uint64_t begin, uint64_t end);
+
+			// Write now the records published up to 'end'?
+			bool urgent(uint64_t written, uint64_t end) const;
+
+			// Sleep until a record is appended (if nothing has been
+			// reserved) or until the batch has to be written. Returns
+			// true if the batch has to be written.
+			bool sleep(uint64_t written, uint64_t end);
+
+			// Wake up the flusher (if it is sleeping).
+			void wake_flusher();
+
+			// Wake up the producers waiting for room.
+			void wake_producers();
+
+			// Wait until the written offset reaches 'offset'.
+			bool wait(uint64_t offset);
+	};
+
+	inline log_appender::~log_appender()
+	{
+		if (_M_running) {
+			close();
+		}
+
+		free(_M_buf);
+		free(_M_published);
+	}
+
+	inline uint64_t log_appender::written() const
+	{
+		return _M_written;
+	}
+}
+
+#endif // IO_LOG_APPENDER_H
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "io/mmap_write_only_file.h"
+
+io::mmap_write_only_file::mmap_write_only_file(size_t window_size)
+	: _M_base(NULL),
+	  _M_map_offset(0),
+	  _M_filesize(0),
+	  _M_flushed(0)
+{
+	_M_fd = -1;
+
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+
+	if (window_size == 0) {
+		window_size = kDefaultWindowSize;
+	}
+
+	_M_window_size = (window_size + pagesize - 1) & ~(pagesize - 1);
+}
+
+bool io::mmap_write_only_file::open(const char* filename)
+{
+	// The file has to be opened for reading and writing to be mapped
+	// with PROT_WRITE.
+	if ((_M_fd = ::open(filename, O_CREAT | O_RDWR, 0644)) < 0) {
+		return false;
+	}
+
+	off_t offset;
+	if ((offset = lseek(_M_fd, 0, SEEK_END)) < 0) {
+		::close(_M_fd);
+		_M_fd = -1;
+
+		return false;
+	}
+
+	_M_filesize = offset;
+	_M_offset = offset;
+	_M_flushed = offset;
+
+	if (!map(offset & ~(static_cast<off_t>(sysconf(_SC_PAGESIZE)) - 1))) {
+		::close(_M_fd);
+		_M_fd = -1;
+
+		return false;
+	}
+
+	return true;
+}
+
+bool io::mmap_write_only_file::close()
+{
+	unmap();
+
+	// If the file cannot be truncated, the error is reported but the file
+	// is closed anyway.
+	bool ret = true;
+
+	if (_M_filesize != _M_offset) {
+		if (ftruncate(_M_fd, _M_offset) < 0) {
+			ret = false;
+		}
+
+		_M_filesize = _M_offset;
+	}
+
+	if (::close(_M_fd) < 0) {
+		ret = false;
+	}
+
+	_M_fd = -1;
+
+	return ret;
+}
+
+bool io::mmap_write_only_file::write(const void* buf, size_t count)
+{
+	const char* b = reinterpret_cast<const char*>(buf);
+
+	while (count > 0) {
+		size_t pos = _M_offset - _M_map_offset;
+
+		// If the window is full...
+		if (pos == _M_window_size) {
+			if (!map(_M_offset)) {
+				return false;
+			}
+
+			pos = 0;
+		}
+
+		size_t n = _M_window_size - pos;
+		if (n > count) {
+			n = count;
+		}
+
+		memcpy(_M_base + pos, b, n);
+
+		_M_offset += n;
+
+		b += n;
+		count -= n;
+	}
+
+	return true;
+}
+
+bool io::mmap_write_only_file::flush()
+{
+	if (_M_offset > _M_flushed) {
+		// The pages written through the mapping are dirty in the page
+		// cache (msync(MS_ASYNC) is a no-op on Linux).
+		if (sync_file_range(_M_fd, _M_flushed, _M_offset - _M_flushed, SYNC_FILE_RANGE_WRITE) < 0) {
+			return false;
+		}
+
+		_M_flushed = _M_offset;
+	}
+
+	return true;
+}
+
+bool io::mmap_write_only_file::sync()
+{
+	if (fdatasync(_M_fd) < 0) {
+		return false;
+	}
+
+	_M_flushed = _M_offset;
+
+	return true;
+}
+
+bool io::mmap_write_only_file::map(uint64_t offset)
+{
+	if (_M_base) {
+		// Start the write-back of the current window.
+		if (!flush()) {
+			return false;
+		}
+
+		unmap();
+	}
+
+	// Extend the file and allocate its blocks.
+	uint64_t end = offset + _M_window_size;
+	if (end > _M_filesize) {
+		if (fallocate(_M_fd, 0, _M_filesize, end - _M_filesize) < 0) {
+			// If the file system doesn't support fallocate()...
+			if (((errno != EOPNOTSUPP) && (errno != ENOSYS)) || (ftruncate(_M_fd, end) < 0)) {
+				return false;
+			}
+		}
+
+		_M_filesize = end;
+	}
+
+	void* p;
+	if ((p = mmap(NULL, _M_window_size, PROT_READ | PROT_WRITE, MAP_SHARED, _M_fd, offset)) == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(p, _M_window_size, MADV_SEQUENTIAL);
+
+	_M_base = reinterpret_cast<char*>(p);
+	_M_map_offset = offset;
+
+	return true;
+}
+
+void io::mmap_write_only_file::unmap()
+{
+	if (_M_base) {
+		munmap(_M_base, _M_window_size);
+		_M_base = NULL;
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef IO_MMAP_WRITE_ONLY_FILE_H
+#define IO_MMAP_WRITE_ONLY_FILE_H
+
+// Write-only file which maps the file in memory.
+//
+// The data is copied into a window of 'window_size' bytes mapped from the
+// file; write() only makes system calls when the window has to be moved.
+// Before a window is mapped, the file is extended and its blocks are
+// allocated (fallocate()), so running out of disk space is reported by
+// write() instead of raising SIGBUS. The write-back of the data is started
+// asynchronously (sync_file_range()) when the window is moved and by
+// flush(). close() truncates the file to the size of the data.
+
+#include "io/write_only_file.h"
+
+namespace io {
+	class mmap_write_only_file : public write_only_file {
+		public:
+			static const size_t kDefaultWindowSize = 64 * 1024 * 1024;
+
+			// Constructor.
+			mmap_write_only_file(size_t window_size = kDefaultWindowSize);
+
+			// Destructor.
+			~mmap_write_only_file();
+
+			// Open.
+			bool open(const char* filename);
+
+			// Close.
+			bool close();
+
+			// Write.
+			bool write(const void* buf, size_t count);
+
+			// Start the write-back of the data written so far (doesn't
+			// wait).
+			bool flush();
+
+			// Flush data to disk (fdatasync()).
+			bool sync();
+
+		private:
+			size_t _M_window_size;
+
+			// Mapping.
+			char* _M_base;
+			uint64_t _M_map_offset;
+
+			// Size of the file (including the current window).
+			uint64_t _M_filesize;
+
+			// Offset up to which the write-back has been started.
+			uint64_t _M_flushed;
+
+			// Map window at 'offset' (page aligned).
+			bool map(uint64_t offset);
+
+			// Unmap window.
+			void unmap();
+	};
+
+	inline mmap_write_only_file::~mmap_write_only_file()
+	{
+		if (_M_fd != -1) {
+			close();
+		}
+	}
+}
+
+#endif // IO_MMAP_WRITE_ONLY_FILE_H
@@ -1,12 +1,41 @@
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <errno.h>
 #include "io/sequential_write_only_file.h"
+#include "macros/macros.h"
 
 bool io::sequential_write_only_file::open(const char* filename)
 {
-	if ((_M_fd = ::open(filename, O_CREAT | O_WRONLY, 0644)) < 0) {
+	int flags = O_CREAT | O_WRONLY;
+
+	if (_M_direct) {
+		// Round up the buffer size to a multiple of the alignment.
+		if (_M_size > 0) {
+			_M_size = (_M_size + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+		} else {
+			_M_size = kDefaultDirectBufferSize;
+		}
+
+		void* p;
+		if (posix_memalign(&p, kDirectAlignment, _M_size) != 0) {
+			return false;
+		}
+
+		_M_buf = reinterpret_cast<char*>(p);
+
+		// The last partial block of the file has to be read.
+		flags = O_CREAT | O_RDWR | O_DIRECT;
+	} else if ((_M_size > 0) && ((_M_buf = reinterpret_cast<char*>(malloc(_M_size))) == NULL)) {
+		return false;
+	}
+
+	if ((_M_fd = ::open(filename, flags, 0644)) < 0) {
+		free(_M_buf);
+		_M_buf = NULL;
+
 		return false;
 	}
 
@@ -17,58 +46,369 @@ bool io::sequential_write_only_file::open(const char* filename)
 
 	_M_filesize = offset;
 	_M_offset = offset;
+	_M_written = offset;
+
+	_M_used = 0;
+
+	if (_M_direct) {
+		// Load the last partial block (if any), the buffer has to
+		// start at an aligned offset.
+		size_t partial = offset & (kDirectAlignment - 1);
+		if (partial > 0) {
+			if (pread(_M_fd, _M_buf, kDirectAlignment, offset - partial) != static_cast<ssize_t>(partial)) {
+				::close(_M_fd);
+				_M_fd = -1;
+
+				free(_M_buf);
+				_M_buf = NULL;
+
+				return false;
+			}
+
+			_M_used = partial;
+		}
+	}
 
 	return true;
 }
 
 bool io::sequential_write_only_file::close()
 {
-	if (_M_filesize != _M_offset) {
-		if (ftruncate(_M_fd, _M_offset) < 0) {
-			return false;
+	// If the buffered data cannot be written, it is discarded (the file
+	// is closed anyway).
+	bool ret = flush();
+
+	// End of the data written to the file.
+	uint64_t end = (_M_direct) ? _M_written : _M_offset - _M_used;
+
+	if (_M_filesize != end) {
+		if (ftruncate(_M_fd, end) < 0) {
+			ret = false;
 		}
 
-		_M_filesize = _M_offset;
+		_M_filesize = end;
 	}
 
 	if (::close(_M_fd) < 0) {
-		return false;
+		ret = false;
 	}
 
 	_M_fd = -1;
+	_M_offset = end;
+	_M_used = 0;
 
-	return true;
+	free(_M_buf);
+	_M_buf = NULL;
+
+	return ret;
 }
 
 bool io::sequential_write_only_file::write(const void* buf, size_t count)
+{
+	if (_M_direct) {
+		return write_direct(buf, count);
+	}
+
+	// If the data fits in the buffer...
+	if ((_M_buf) && (count <= _M_size - _M_used)) {
+		memcpy(_M_buf + _M_used, buf, count);
+		_M_used += count;
+
+		_M_offset += count;
+
+		return true;
+	}
+
+	if (!reserve(_M_offset + count)) {
+		return false;
+	}
+
+	// Write the buffered data and 'buf' with a single system call.
+	struct iovec iov[2];
+	unsigned iovcnt = 0;
+
+	if (_M_used > 0) {
+		iov[iovcnt].iov_base = _M_buf;
+		iov[iovcnt++].iov_len = _M_used;
+	}
+
+	iov[iovcnt].iov_base = const_cast<void*>(buf);
+	iov[iovcnt++].iov_len = count;
+
+	size_t written = 0;
+	bool ret = writev(iov, iovcnt, written);
+
+	// Account for the data written (even if the write failed).
+	advance(written);
+
+	return ret;
+}
+
+bool io::sequential_write_only_file::write(const struct iovec* iov, unsigned iovcnt)
+{
+	if (_M_direct) {
+		for (unsigned i = 0; i < iovcnt; i++) {
+			if (!write_direct(iov[i].iov_base, iov[i].iov_len)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_t total = 0;
+	for (unsigned i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+
+	// If the data fits in the buffer...
+	if ((_M_buf) && (total <= _M_size - _M_used)) {
+		for (unsigned i = 0; i < iovcnt; i++) {
+			memcpy(_M_buf + _M_used, iov[i].iov_base, iov[i].iov_len);
+			_M_used += iov[i].iov_len;
+		}
+
+		_M_offset += total;
+
+		return true;
+	}
+
+	if (!reserve(_M_offset + total)) {
+		return false;
+	}
+
+	// Write the buffered data and the buffers, IOV_MAX buffers per
+	// system call.
+	struct iovec vec[IOV_MAX];
+	unsigned n = 0;
+
+	if (_M_used > 0) {
+		vec[n].iov_base = _M_buf;
+		vec[n++].iov_len = _M_used;
+	}
+
+	for (unsigned i = 0; i < iovcnt; i++) {
+		if (n == IOV_MAX) {
+			size_t written = 0;
+			bool ret = writev(vec, n, written);
+
+			advance(written);
+
+			if (!ret) {
+				return false;
+			}
+
+			n = 0;
+		}
+
+		vec[n++] = iov[i];
+	}
+
+	size_t written = 0;
+	bool ret = writev(vec, n, written);
+
+	advance(written);
+
+	return ret;
+}
+
+bool io::sequential_write_only_file::flush()
+{
+	if (_M_direct) {
+		if (!flush_direct()) {
+			return false;
+		}
+
+		// If the last block has been padded or the file has been
+		// extended with ftruncate(), set the size of the file to the
+		// size of the data (otherwise, if the process doesn't call
+		// close(), open() would append after the zeros).
+		if ((_M_used > 0) || ((_M_preallocation == kTruncate) && (_M_filesize != _M_offset))) {
+			if (ftruncate(_M_fd, _M_offset) < 0) {
+				return false;
+			}
+
+			// The blocks allocated after the end of the data have
+			// been released.
+			_M_filesize = _M_offset;
+		}
+
+		return true;
+	}
+
+	if (_M_used == 0) {
+		return true;
+	}
+
+	if (!reserve(_M_offset)) {
+		return false;
+	}
+
+	struct iovec iov;
+	iov.iov_base = _M_buf;
+	iov.iov_len = _M_used;
+
+	size_t written = 0;
+	bool ret = writev(&iov, 1, written);
+
+	advance(written);
+
+	return ret;
+}
+
+bool io::sequential_write_only_file::sync()
+{
+	return ((flush()) && (fdatasync(_M_fd) == 0));
+}
+
+bool io::sequential_write_only_file::reserve(uint64_t size)
 {
 	// If we have to increment the size of the file...
-	uint64_t filesize;
-	if ((filesize = _M_offset + count) > _M_filesize) {
+	if (size > _M_filesize) {
+		uint64_t filesize = _M_filesize;
 		do {
-			_M_filesize += kFileIncrement;
-		} while (filesize > _M_filesize);
+			filesize += _M_increment;
+		} while (size > filesize);
+
+		if (_M_preallocation == kAllocate) {
+			if (fallocate(_M_fd, FALLOC_FL_KEEP_SIZE, _M_filesize, filesize - _M_filesize) == 0) {
+				_M_filesize = filesize;
+				return true;
+			}
+
+			if ((errno != EOPNOTSUPP) && (errno != ENOSYS)) {
+				return false;
+			}
+
+			// The file system doesn't support fallocate().
+			_M_preallocation = kTruncate;
+		}
 
-		if (ftruncate(_M_fd, _M_filesize) < 0) {
+		if (ftruncate(_M_fd, filesize) < 0) {
 			return false;
 		}
+
+		_M_filesize = filesize;
+	}
+
+	return true;
+}
+
+bool io::sequential_write_only_file::writev(struct iovec* iov, unsigned iovcnt, size_t& written)
+{
+	while (iovcnt > 0) {
+		ssize_t ret;
+		if ((ret = ::writev(_M_fd, iov, iovcnt)) < 0) {
+			if ((errno != EINTR) && (errno != EAGAIN)) {
+				return false;
+			}
+		} else {
+			written += ret;
+
+			// Skip the buffers which have been written.
+			while ((iovcnt > 0) && (static_cast<size_t>(ret) >= iov->iov_len)) {
+				ret -= iov->iov_len;
+
+				iov++;
+				iovcnt--;
+			}
+
+			if (ret > 0) {
+				iov->iov_base = reinterpret_cast<char*>(iov->iov_base) + ret;
+				iov->iov_len -= ret;
+			}
+		}
+	}
+
+	return true;
+}
+
+void io::sequential_write_only_file::advance(size_t written)
+{
+	// If only part of the buffered data (already counted in '_M_offset')
+	// has been written...
+	if (written < _M_used) {
+		memmove(_M_buf, _M_buf + written, _M_used - written);
+		_M_used -= written;
+	} else {
+		_M_offset += written - _M_used;
+		_M_used = 0;
 	}
+}
 
+bool io::sequential_write_only_file::write_direct(const void* buf, size_t count)
+{
 	const char* b = reinterpret_cast<const char*>(buf);
 
 	while (count > 0) {
+		size_t n = _M_size - _M_used;
+		if (n > count) {
+			n = count;
+		}
+
+		memcpy(_M_buf + _M_used, b, n);
+		_M_used += n;
+
+		_M_offset += n;
+
+		b += n;
+		count -= n;
+
+		// If the buffer is full...
+		if ((_M_used == _M_size) && (!flush_direct())) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool io::sequential_write_only_file::flush_direct()
+{
+	if (_M_used == 0) {
+		return true;
+	}
+
+	// The buffer starts at an aligned offset.
+	off_t offset = _M_offset - _M_used;
+
+	size_t len = (_M_used + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+
+	// Pad the last block with zeros.
+	memset(_M_buf + _M_used, 0, len - _M_used);
+
+	if (!reserve(offset + len)) {
+		return false;
+	}
+
+	const char* b = _M_buf;
+
+	while (len > 0) {
 		ssize_t ret;
-		if ((ret = ::write(_M_fd, b, count)) < 0) {
+		if ((ret = pwrite(_M_fd, b, len, offset)) < 0) {
 			if ((errno != EINTR) && (errno != EAGAIN)) {
 				return false;
 			}
-		} else if (ret > 0) {
+		} else {
 			b += ret;
-			count -= ret;
+			len -= ret;
 
-			_M_offset += ret;
+			offset += ret;
+
+			// The padding is not data.
+			if (static_cast<uint64_t>(offset) > _M_written) {
+				_M_written = MIN(static_cast<uint64_t>(offset), _M_offset);
+			}
 		}
 	}
 
+	// Keep the last partial block, it will be written again.
+	size_t partial = _M_used & (kDirectAlignment - 1);
+	if ((partial > 0) && (partial < _M_used)) {
+		memmove(_M_buf, _M_buf + _M_used - partial, partial);
+	}
+
+	_M_used = partial;
+
 	return true;
 }
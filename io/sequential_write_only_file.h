@@ -1,17 +1,50 @@
 #ifndef IO_SEQUENTIAL_WRITE_ONLY_FILE_H
 #define IO_SEQUENTIAL_WRITE_ONLY_FILE_H
 
+#include <stdlib.h>
+#include <sys/uio.h>
 #include "io/write_only_file.h"
 
 namespace io {
 	class sequential_write_only_file : public write_only_file {
 		public:
+			// How to make room for the data.
+			enum preallocation_mode {
+				// Extend the file with ftruncate() (sparse file).
+				kTruncate,
+
+				// Allocate blocks with fallocate(FALLOC_FL_KEEP_SIZE),
+				// the size of the file is not changed (falls back to
+				// ftruncate() if the file system doesn't support it).
+				kAllocate
+			};
+
+			static const uint64_t kFileIncrement = 4 * 1024 * 1024;
+
+			// Alignment of the O_DIRECT writes.
+			static const size_t kDirectAlignment = 4096;
+
+			// Buffer size in O_DIRECT mode, if none was given.
+			static const size_t kDefaultDirectBufferSize = 1024 * 1024;
+
 			// Constructor.
-			sequential_write_only_file();
+			// If 'buffer_size' is not 0, small writes are accumulated
+			// in a buffer of 'buffer_size' bytes.
+			sequential_write_only_file(size_t buffer_size = 0);
 
 			// Destructor.
 			~sequential_write_only_file();
 
+			// Set preallocation mode and increment (before open()).
+			void preallocation(preallocation_mode mode, uint64_t increment = kFileIncrement);
+
+			// Enable / disable O_DIRECT (before open()).
+			// All the writes go through an aligned buffer (its size is
+			// rounded up to a multiple of kDirectAlignment). The last
+			// block is padded with zeros, flush() and sync() set the
+			// size of the file to the size of the data.
+			void direct_io(bool enable);
+
 			// Open.
 			bool open(const char* filename);
 
@@ -21,13 +54,60 @@ namespace io {
 			// Write.
 			bool write(const void* buf, size_t count);
 
+			// Write from multiple buffers.
+			bool write(const struct iovec* iov, unsigned iovcnt);
+
+			// Write buffered data.
+			bool flush();
+
+			// Flush data to disk (fdatasync()).
+			bool sync();
+
 		protected:
-			static const uint64_t kFileIncrement = 4 * 1024 * 1024;
+			preallocation_mode _M_preallocation;
+			uint64_t _M_increment;
 
+			bool _M_direct;
+
+			// Size of the file (kTruncate) or of the allocated space
+			// (kAllocate).
 			uint64_t _M_filesize;
+
+			char* _M_buf;
+			size_t _M_size;
+			size_t _M_used;
+
+			// Offset up to which the data has been written (O_DIRECT).
+			uint64_t _M_written;
+
+			// Make sure that the file has at least 'size' bytes.
+			bool reserve(uint64_t size);
+
+			// Write all the buffers (modifies 'iov'); 'written' is
+			// incremented by the number of bytes written (also on
+			// error).
+			bool writev(struct iovec* iov, unsigned iovcnt, size_t& written);
+
+			// Account for 'written' bytes written from the buffer
+			// followed by the data passed to write().
+			void advance(size_t written);
+
+			// Write through the aligned buffer (O_DIRECT).
+			bool write_direct(const void* buf, size_t count);
+
+			// Write the aligned buffer (O_DIRECT); the last partial
+			// block is kept in the buffer.
+			bool flush_direct();
 	};
 
-	inline sequential_write_only_file::sequential_write_only_file()
+	inline sequential_write_only_file::sequential_write_only_file(size_t buffer_size)
+		: _M_preallocation(kAllocate),
+		  _M_increment(kFileIncrement),
+		  _M_direct(false),
+		  _M_buf(NULL),
+		  _M_size(buffer_size),
+		  _M_used(0),
+		  _M_written(0)
 	{
 		_M_fd = -1;
 	}
@@ -37,6 +117,22 @@ namespace io {
 		if (_M_fd != -1) {
 			close();
 		}
+
+		free(_M_buf);
+	}
+
+	inline void sequential_write_only_file::preallocation(preallocation_mode mode, uint64_t increment)
+	{
+		_M_preallocation = mode;
+
+		if (increment > 0) {
+			_M_increment = increment;
+		}
+	}
+
+	inline void sequential_write_only_file::direct_io(bool enable)
+	{
+		_M_direct = enable;
 	}
 }
 
@@ -15,10 +15,18 @@ namespace io {
 			// Write.
 			virtual bool write(const void* buf, size_t count) = 0;
 
+			// Get offset.
+			uint64_t offset() const;
+
 		protected:
 			int _M_fd;
 			uint64_t _M_offset;
 	};
+
+	inline uint64_t write_only_file::offset() const
+	{
+		return _M_offset;
+	}
 }
 
 #endif // IO_WRITE_ONLY_FILE_H
@@ -1,13 +1,82 @@
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 #include "io/sequential_write_only_file.h"
+#include "io/mmap_write_only_file.h"
+#include "io/log_appender.h"
+#include "macros/macros.h"
 
-int main()
+static const char* kFilename = "test.dat";
+
+static int test_big_file();
+
+static int test_small_writes();
+static int test_preallocation();
+static int test_mmap();
+static bool write_records_mmap(size_t window_size, size_t from, size_t to);
+static bool write_records(size_t buffer_size, bool vectored, io::sequential_write_only_file::preallocation_mode mode = io::sequential_write_only_file::kAllocate, bool direct = false, size_t from = 0, size_t to = 0);
+static bool check_file();
+static size_t make_record(size_t n, char* buf);
+
+static int test_write_error();
+static bool write_until_error(size_t buffer_size, bool vectored, off_t limit);
+static bool check_prefix(off_t size);
+
+static int test_reopen_after_sync();
+static bool write_records_no_close(io::sequential_write_only_file::preallocation_mode mode, size_t to);
+
+static int test_log_appender();
+static bool append_records(unsigned nthreads, bool mutex);
+static void* producer(void* arg);
+static bool check_log(unsigned nthreads);
+
+int main(int argc, char** argv)
 {
-	static const char* kFilename = "test.dat";
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
+		fprintf(stderr, "\t0: Write a file of 2 GiB.\n");
+		fprintf(stderr, "\t1: Test small writes (unbuffered, buffered and vectored).\n");
+		fprintf(stderr, "\t2: Test preallocation modes and O_DIRECT.\n");
+		fprintf(stderr, "\t3: Test io::mmap_write_only_file.\n");
+		fprintf(stderr, "\t4: Test io::log_appender (compared to a mutex).\n");
+		fprintf(stderr, "\t5: Test write errors (the data written is kept).\n");
+		fprintf(stderr, "\t6: Test reopening after sync() without close() (O_DIRECT).\n");
 
+		return -1;
+	}
+
+	switch (atoi(argv[1])) {
+		case 0:
+			return test_big_file();
+		case 1:
+			return test_small_writes();
+		case 2:
+			return test_preallocation();
+		case 3:
+			return test_mmap();
+		case 4:
+			return test_log_appender();
+		case 5:
+			return test_write_error();
+		case 6:
+			return test_reopen_after_sync();
+		default:
+			fprintf(stderr, "Invalid test number %s.\n", argv[1]);
+			return -1;
+	}
+}
+
+int test_big_file()
+{
 	// Remove file (if exists).
 	unlink(kFilename);
 
@@ -36,3 +105,818 @@ int main()
 
 	return 0;
 }
+
+static const size_t kNumberRecords = 1000 * 1000;
+
+int test_small_writes()
+{
+	static const size_t buffer_sizes[] = {0, 4 * 1024, 64 * 1024, 1024 * 1024};
+
+	for (size_t i = 0; i < sizeof(buffer_sizes) / sizeof(size_t); i++) {
+		for (unsigned vectored = 0; vectored < 2; vectored++) {
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
+			if (!write_records(buffer_sizes[i], vectored)) {
+				unlink(kFilename);
+				return -1;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			printf("Buffer size: %7lu, %s: %8.2f ms.\n",
+			       buffer_sizes[i],
+			       vectored ? "vectored" : "single  ",
+			       ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0);
+
+			if (!check_file()) {
+				unlink(kFilename);
+				return -1;
+			}
+		}
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_preallocation()
+{
+	static const char* modes[] = {"ftruncate", "fallocate"};
+
+	for (unsigned mode = 0; mode < 2; mode++) {
+		for (unsigned direct = 0; direct < 2; direct++) {
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
+			// Write the second half of the records after reopening
+			// the file (the file size is not aligned).
+			if ((!write_records(64 * 1024, false, static_cast<io::sequential_write_only_file::preallocation_mode>(mode), direct, 0, kNumberRecords / 2)) ||
+			    (!write_records(64 * 1024, false, static_cast<io::sequential_write_only_file::preallocation_mode>(mode), direct, kNumberRecords / 2, kNumberRecords))) {
+				unlink(kFilename);
+				return -1;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			struct stat status;
+			if (stat(kFilename, &status) < 0) {
+				fprintf(stderr, "Couldn't stat file %s.\n", kFilename);
+
+				unlink(kFilename);
+				return -1;
+			}
+
+			printf("%s, %s: %8.2f ms, size: %ld, allocated: %ld.\n",
+			       modes[mode],
+			       direct ? "O_DIRECT" : "buffered",
+			       ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0,
+			       status.st_size,
+			       status.st_blocks * 512);
+
+			if (!check_file()) {
+				unlink(kFilename);
+				return -1;
+			}
+		}
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+int test_mmap()
+{
+	// Small windows (the window is moved many times) and the default.
+	static const size_t window_sizes[] = {64 * 1024, 1024 * 1024, io::mmap_write_only_file::kDefaultWindowSize};
+
+	for (size_t i = 0; i < sizeof(window_sizes) / sizeof(size_t); i++) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		// Write the second half of the records after reopening the
+		// file.
+		if ((!write_records_mmap(window_sizes[i], 0, kNumberRecords / 2)) ||
+		    (!write_records_mmap(window_sizes[i], kNumberRecords / 2, kNumberRecords))) {
+			unlink(kFilename);
+			return -1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		printf("Window size: %8lu: %8.2f ms.\n",
+		       window_sizes[i],
+		       ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0);
+
+		if (!check_file()) {
+			unlink(kFilename);
+			return -1;
+		}
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool write_records_mmap(size_t window_size, size_t from, size_t to)
+{
+	if (from == 0) {
+		unlink(kFilename);
+	}
+
+	io::mmap_write_only_file file(window_size);
+	if (!file.open(kFilename)) {
+		fprintf(stderr, "Couldn't open file %s for writing.\n", kFilename);
+		return false;
+	}
+
+	char buf[128];
+
+	for (size_t i = from; i < to; i++) {
+		size_t len = make_record(i, buf);
+
+		if ((!file.write(&len, sizeof(size_t))) || (!file.write(buf, len))) {
+			fprintf(stderr, "Error writing to file %s.\n", kFilename);
+			return false;
+		}
+
+		// Start the write-back from time to time.
+		if ((i % 100000) == 0) {
+			if (!file.flush()) {
+				fprintf(stderr, "Error flushing file %s.\n", kFilename);
+				return false;
+			}
+		}
+	}
+
+	if (!file.close()) {
+		fprintf(stderr, "Error closing file %s.\n", kFilename);
+		return false;
+	}
+
+	return true;
+}
+
+bool write_records(size_t buffer_size, bool vectored, io::sequential_write_only_file::preallocation_mode mode, bool direct, size_t from, size_t to)
+{
+	if (from == 0) {
+		unlink(kFilename);
+	}
+
+	if (to == 0) {
+		to = kNumberRecords;
+	}
+
+	io::sequential_write_only_file file(buffer_size);
+	file.preallocation(mode);
+	file.direct_io(direct);
+
+	if (!file.open(kFilename)) {
+		fprintf(stderr, "Couldn't open file %s for writing.\n", kFilename);
+		return false;
+	}
+
+	char buf[128];
+
+	for (size_t i = from; i < to; i++) {
+		size_t len = make_record(i, buf);
+
+		if (vectored) {
+			// Length + record.
+			struct iovec iov[2];
+			iov[0].iov_base = &len;
+			iov[0].iov_len = sizeof(size_t);
+			iov[1].iov_base = buf;
+			iov[1].iov_len = len;
+
+			if (!file.write(iov, 2)) {
+				fprintf(stderr, "Error writing to file %s.\n", kFilename);
+				return false;
+			}
+		} else {
+			if ((!file.write(&len, sizeof(size_t))) || (!file.write(buf, len))) {
+				fprintf(stderr, "Error writing to file %s.\n", kFilename);
+				return false;
+			}
+		}
+
+		// Flush from time to time.
+		if ((i % 100000) == 0) {
+			if (!file.flush()) {
+				fprintf(stderr, "Error flushing file %s.\n", kFilename);
+				return false;
+			}
+
+			// With fallocate(), the size of the file is the size of
+			// the data.
+			if ((mode == io::sequential_write_only_file::kAllocate) && (!direct)) {
+				struct stat status;
+				if ((stat(kFilename, &status) < 0) || (static_cast<uint64_t>(status.st_size) != file.offset())) {
+					fprintf(stderr, "Invalid size of file %s.\n", kFilename);
+					return false;
+				}
+			}
+		}
+	}
+
+	if (!file.close()) {
+		fprintf(stderr, "Error closing file %s.\n", kFilename);
+		return false;
+	}
+
+	return true;
+}
+
+bool check_file()
+{
+	int fd;
+	if ((fd = open(kFilename, O_RDONLY)) < 0) {
+		fprintf(stderr, "Couldn't open file %s for reading.\n", kFilename);
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) < 0) {
+		fprintf(stderr, "Couldn't stat file %s.\n", kFilename);
+
+		close(fd);
+		return false;
+	}
+
+	char* data;
+	if ((data = reinterpret_cast<char*>(malloc(status.st_size))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+
+		close(fd);
+		return false;
+	}
+
+	if (read(fd, data, status.st_size) != status.st_size) {
+		fprintf(stderr, "Error reading file %s.\n", kFilename);
+
+		free(data);
+		close(fd);
+
+		return false;
+	}
+
+	close(fd);
+
+	const char* ptr = data;
+	const char* end = data + status.st_size;
+	char buf[128];
+
+	for (size_t i = 0; i < kNumberRecords; i++) {
+		size_t len = make_record(i, buf);
+
+		if ((static_cast<size_t>(end - ptr) < sizeof(size_t) + len) || (memcmp(ptr, &len, sizeof(size_t)) != 0) || (memcmp(ptr + sizeof(size_t), buf, len) != 0)) {
+			fprintf(stderr, "Invalid record %lu.\n", i);
+
+			free(data);
+			return false;
+		}
+
+		ptr += sizeof(size_t) + len;
+	}
+
+	ssize_t extra = end - ptr;
+
+	free(data);
+
+	if (extra != 0) {
+		fprintf(stderr, "File has %ld extra bytes.\n", extra);
+		return false;
+	}
+
+	return true;
+}
+
+int test_write_error()
+{
+	static const size_t buffer_sizes[] = {0, 4 * 1024, 64 * 1024};
+
+	// Limit (not aligned) of the file size; the writes beyond it fail
+	// with EFBIG.
+	static const off_t kLimit = 1000 * 1000 + 3;
+
+	struct rlimit old;
+	if (getrlimit(RLIMIT_FSIZE, &old) < 0) {
+		fprintf(stderr, "Couldn't get the file size limit.\n");
+		return -1;
+	}
+
+	struct rlimit rlim;
+	rlim.rlim_cur = kLimit;
+	rlim.rlim_max = old.rlim_max;
+
+	signal(SIGXFSZ, SIG_IGN);
+
+	if (setrlimit(RLIMIT_FSIZE, &rlim) < 0) {
+		fprintf(stderr, "Couldn't set the file size limit.\n");
+		return -1;
+	}
+
+	int ret = 0;
+
+	for (size_t i = 0; (i < sizeof(buffer_sizes) / sizeof(size_t)) && (ret == 0); i++) {
+		for (unsigned vectored = 0; vectored < 2; vectored++) {
+			if ((!write_until_error(buffer_sizes[i], vectored, kLimit)) || (!check_prefix(kLimit))) {
+				fprintf(stderr, "Buffer size: %lu, %s.\n", buffer_sizes[i], vectored ? "vectored" : "single");
+
+				ret = -1;
+				break;
+			}
+		}
+	}
+
+	setrlimit(RLIMIT_FSIZE, &old);
+
+	unlink(kFilename);
+
+	if (ret == 0) {
+		printf("Success.\n");
+	}
+
+	return ret;
+}
+
+bool write_until_error(size_t buffer_size, bool vectored, off_t limit)
+{
+	unlink(kFilename);
+
+	// Lowest free file descriptor.
+	int fd;
+	if ((fd = dup(0)) < 0) {
+		fprintf(stderr, "Couldn't duplicate file descriptor.\n");
+		return false;
+	}
+
+	close(fd);
+
+	// fallocate(FALLOC_FL_KEEP_SIZE) doesn't change the size of the
+	// file, the writes fail when they reach the limit.
+	io::sequential_write_only_file file(buffer_size);
+	file.preallocation(io::sequential_write_only_file::kAllocate);
+
+	if (!file.open(kFilename)) {
+		fprintf(stderr, "Couldn't open file %s for writing.\n", kFilename);
+		return false;
+	}
+
+	char buf[128];
+	bool ret = true;
+
+	for (size_t i = 0; (i < kNumberRecords) && (ret); i++) {
+		size_t len = make_record(i, buf);
+
+		if (vectored) {
+			struct iovec iov[2];
+			iov[0].iov_base = &len;
+			iov[0].iov_len = sizeof(size_t);
+			iov[1].iov_base = buf;
+			iov[1].iov_len = len;
+
+			ret = file.write(iov, 2);
+		} else {
+			ret = ((file.write(&len, sizeof(size_t))) && (file.write(buf, len)));
+		}
+	}
+
+	if (ret) {
+		fprintf(stderr, "The writes to file %s didn't fail.\n", kFilename);
+		return false;
+	}
+
+	// The buffered data cannot be written, but the file has to be
+	// closed anyway.
+	file.close();
+
+	if (file.offset() != static_cast<uint64_t>(limit)) {
+		fprintf(stderr, "Invalid offset %lu (expected: %ld).\n", file.offset(), limit);
+		return false;
+	}
+
+	int next;
+	if ((next = dup(0)) < 0) {
+		fprintf(stderr, "Couldn't duplicate file descriptor.\n");
+		return false;
+	}
+
+	close(next);
+
+	if (next != fd) {
+		fprintf(stderr, "The file descriptor of %s has not been closed.\n", kFilename);
+		return false;
+	}
+
+	return true;
+}
+
+bool check_prefix(off_t size)
+{
+	int fd;
+	if ((fd = open(kFilename, O_RDONLY)) < 0) {
+		fprintf(stderr, "Couldn't open file %s for reading.\n", kFilename);
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) < 0) {
+		fprintf(stderr, "Couldn't stat file %s.\n", kFilename);
+
+		close(fd);
+		return false;
+	}
+
+	if (status.st_size != size) {
+		fprintf(stderr, "Invalid size of file %s: %ld (expected: %ld).\n", kFilename, status.st_size, size);
+
+		close(fd);
+		return false;
+	}
+
+	char* data;
+	if ((data = reinterpret_cast<char*>(malloc(size))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory.\n");
+
+		close(fd);
+		return false;
+	}
+
+	if (read(fd, data, size) != size) {
+		fprintf(stderr, "Error reading file %s.\n", kFilename);
+
+		free(data);
+		close(fd);
+
+		return false;
+	}
+
+	close(fd);
+
+	// The file contains the first records (the last one might be
+	// truncated).
+	const char* ptr = data;
+	const char* end = data + size;
+	char buf[sizeof(size_t) + 128];
+
+	for (size_t i = 0; ptr < end; i++) {
+		size_t len = make_record(i, buf + sizeof(size_t));
+		memcpy(buf, &len, sizeof(size_t));
+
+		len = MIN(sizeof(size_t) + len, static_cast<size_t>(end - ptr));
+
+		if (memcmp(ptr, buf, len) != 0) {
+			fprintf(stderr, "Invalid record %lu.\n", i);
+
+			free(data);
+			return false;
+		}
+
+		ptr += len;
+	}
+
+	free(data);
+
+	return true;
+}
+
+int test_reopen_after_sync()
+{
+	static const char* modes[] = {"ftruncate", "fallocate"};
+
+	// Size of the first half of the records.
+	char buf[128];
+	off_t size = 0;
+	for (size_t i = 0; i < kNumberRecords / 2; i++) {
+		size += sizeof(size_t) + make_record(i, buf);
+	}
+
+	for (unsigned mode = 0; mode < 2; mode++) {
+		// Write the first half of the records in a child process
+		// which exits without closing the file.
+		pid_t pid;
+		if ((pid = fork()) < 0) {
+			fprintf(stderr, "Couldn't create process.\n");
+			return -1;
+		} else if (pid == 0) {
+			_exit(write_records_no_close(static_cast<io::sequential_write_only_file::preallocation_mode>(mode), kNumberRecords / 2) ? 0 : 1);
+		}
+
+		int status;
+		if ((waitpid(pid, &status, 0) < 0) || (!WIFEXITED(status)) || (WEXITSTATUS(status) != 0)) {
+			unlink(kFilename);
+			return -1;
+		}
+
+		// The file contains only the data.
+		struct stat st;
+		if (stat(kFilename, &st) < 0) {
+			fprintf(stderr, "Couldn't stat file %s.\n", kFilename);
+
+			unlink(kFilename);
+			return -1;
+		}
+
+		if (st.st_size != size) {
+			fprintf(stderr, "%s: invalid size of file %s: %ld (expected: %ld).\n", modes[mode], kFilename, st.st_size, size);
+
+			unlink(kFilename);
+			return -1;
+		}
+
+		// Reopen the file and append the second half.
+		if ((!write_records(64 * 1024, false, static_cast<io::sequential_write_only_file::preallocation_mode>(mode), true, kNumberRecords / 2, kNumberRecords)) ||
+		    (!check_file())) {
+			fprintf(stderr, "%s: invalid file %s.\n", modes[mode], kFilename);
+
+			unlink(kFilename);
+			return -1;
+		}
+	}
+
+	unlink(kFilename);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool write_records_no_close(io::sequential_write_only_file::preallocation_mode mode, size_t to)
+{
+	unlink(kFilename);
+
+	// The object is not destroyed (the process exits without closing the
+	// file).
+	io::sequential_write_only_file* file = new io::sequential_write_only_file(64 * 1024);
+	file->preallocation(mode);
+	file->direct_io(true);
+
+	if (!file->open(kFilename)) {
+		fprintf(stderr, "Couldn't open file %s for writing.\n", kFilename);
+		return false;
+	}
+
+	char buf[128];
+
+	for (size_t i = 0; i < to; i++) {
+		size_t len = make_record(i, buf);
+
+		if ((!file->write(&len, sizeof(size_t))) || (!file->write(buf, len))) {
+			fprintf(stderr, "Error writing to file %s.\n", kFilename);
+			return false;
+		}
+
+		// Sync from time to time (the last block is padded).
+		if ((i % 100000) == 0) {
+			if (!file->sync()) {
+				fprintf(stderr, "Error syncing file %s.\n", kFilename);
+				return false;
+			}
+		}
+	}
+
+	if (!file->sync()) {
+		fprintf(stderr, "Error syncing file %s.\n", kFilename);
+		return false;
+	}
+
+	return true;
+}
+
+size_t make_record(size_t n, char* buf)
+{
+	return sprintf(buf, "record %lu: %.*s", n, static_cast<int>(n % 64), "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl");
+}
+
+static const size_t kRecordsPerThread = 200 * 1000;
+
+struct log_record {
+	uint32_t len;
+	uint32_t thread;
+	uint64_t seq;
+	char data[48];
+};
+
+struct log_producer {
+	pthread_t thread;
+
+	unsigned id;
+
+	io::log_appender* appender;
+
+	io::sequential_write_only_file* file;
+	pthread_mutex_t* mutex;
+
+	bool ret;
+};
+
+int test_log_appender()
+{
+	static const unsigned nthreads[] = {1, 2, 4, 8};
+
+	// Number of runs per configuration (the best time is taken, the runs
+	// of the appender and of the mutex are interleaved).
+	static const unsigned kRuns = 5;
+
+	// The producers only run in parallel if there are enough CPUs.
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (size_t i = 0; i < sizeof(nthreads) / sizeof(unsigned); i++) {
+		double best[2];
+
+		for (unsigned run = 0; run < kRuns; run++) {
+			for (unsigned mutex = 0; mutex < 2; mutex++) {
+				struct timespec start, end;
+				clock_gettime(CLOCK_MONOTONIC, &start);
+
+				if (!append_records(nthreads[i], mutex)) {
+					unlink(kFilename);
+					return -1;
+				}
+
+				clock_gettime(CLOCK_MONOTONIC, &end);
+
+				if (!check_log(nthreads[i])) {
+					unlink(kFilename);
+					return -1;
+				}
+
+				double ms = ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / 1000000.0;
+				if ((run == 0) || (ms < best[mutex])) {
+					best[mutex] = ms;
+				}
+			}
+		}
+
+		printf("%u thread(s), log_appender: %8.2f ms, mutex: %8.2f ms.\n", nthreads[i], best[0], best[1]);
+
+		// With several threads running in parallel, the appender must be
+		// faster than the mutex.
+		if ((nthreads[i] >= 4) && (static_cast<long>(nthreads[i]) <= ncpus) && (best[0] >= best[1])) {
+			fprintf(stderr, "%u thread(s): log_appender is not faster than the mutex.\n", nthreads[i]);
+
+			unlink(kFilename);
+			return -1;
+		}
+	}
+
+	unlink(kFilename);
+
+	if (ncpus < 4) {
+		printf("Only %ld CPU(s), the times haven't been compared.\n", ncpus);
+	}
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+bool append_records(unsigned nthreads, bool mutex)
+{
+	unlink(kFilename);
+
+	io::log_appender appender;
+	io::sequential_write_only_file file(64 * 1024);
+	pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+	if (((!mutex) && (!appender.open(kFilename))) || ((mutex) && (!file.open(kFilename)))) {
+		fprintf(stderr, "Couldn't open file %s for writing.\n", kFilename);
+		return false;
+	}
+
+	log_producer producers[8];
+
+	unsigned i;
+	for (i = 0; i < nthreads; i++) {
+		producers[i].id = i;
+		producers[i].appender = mutex ? NULL : &appender;
+		producers[i].file = &file;
+		producers[i].mutex = &m;
+
+		if (pthread_create(&producers[i].thread, NULL, producer, &producers[i]) != 0) {
+			fprintf(stderr, "Error creating thread.\n");
+			break;
+		}
+	}
+
+	bool ret = (i == nthreads);
+
+	for (unsigned j = 0; j < i; j++) {
+		pthread_join(producers[j].thread, NULL);
+
+		if (!producers[j].ret) {
+			ret = false;
+		}
+	}
+
+	if (((!mutex) && (!appender.close())) || ((mutex) && (!file.close()))) {
+		fprintf(stderr, "Error closing file %s.\n", kFilename);
+		return false;
+	}
+
+	if (!ret) {
+		fprintf(stderr, "Error writing to file %s.\n", kFilename);
+	}
+
+	return ret;
+}
+
+void* producer(void* arg)
+{
+	log_producer* p = reinterpret_cast<log_producer*>(arg);
+
+	p->ret = false;
+
+	log_record record;
+	record.thread = p->id;
+
+	for (size_t i = 0; i < kRecordsPerThread; i++) {
+		record.seq = i;
+		record.len = offsetof(log_record, data) + (i % sizeof(record.data));
+		memset(record.data, 'a' + p->id, sizeof(record.data));
+
+		if (p->appender) {
+			if (!p->appender->append(&record, record.len)) {
+				return NULL;
+			}
+		} else {
+			pthread_mutex_lock(p->mutex);
+			bool ret = p->file->write(&record, record.len);
+			pthread_mutex_unlock(p->mutex);
+
+			if (!ret) {
+				return NULL;
+			}
+		}
+	}
+
+	p->ret = true;
+
+	return NULL;
+}
+
+bool check_log(unsigned nthreads)
+{
+	FILE* file;
+	if ((file = fopen(kFilename, "r")) == NULL) {
+		fprintf(stderr, "Couldn't open file %s for reading.\n", kFilename);
+		return false;
+	}
+
+	uint64_t next[8];
+	memset(next, 0, sizeof(next));
+
+	log_record record;
+	while (fread(&record, 1, offsetof(log_record, data), file) == offsetof(log_record, data)) {
+		// Check header.
+		if ((record.thread >= nthreads) ||
+		    (record.seq != next[record.thread]) ||
+		    (record.len != offsetof(log_record, data) + (record.seq % sizeof(record.data)))) {
+			fprintf(stderr, "Invalid record (thread: %u, seq: %lu).\n", record.thread, record.seq);
+
+			fclose(file);
+			return false;
+		}
+
+		// Check data.
+		size_t len = record.len - offsetof(log_record, data);
+		if (fread(record.data, 1, len, file) != len) {
+			fprintf(stderr, "Truncated record (thread: %u, seq: %lu).\n", record.thread, record.seq);
+
+			fclose(file);
+			return false;
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			if (record.data[i] != static_cast<char>('a' + record.thread)) {
+				fprintf(stderr, "Invalid data (thread: %u, seq: %lu).\n", record.thread, record.seq);
+
+				fclose(file);
+				return false;
+			}
+		}
+
+		next[record.thread]++;
+	}
+
+	fclose(file);
+
+	for (unsigned i = 0; i < nthreads; i++) {
+		if (next[i] != kRecordsPerThread) {
+			fprintf(stderr, "Thread %u: %lu records (expected: %lu).\n", i, next[i], kRecordsPerThread);
+			return false;
+		}
+	}
+
+	return true;
+}
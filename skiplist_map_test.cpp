@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "util/concurrent/skiplist_map.h"
+
+static const unsigned kNumberIncrementers = 8;
+static const unsigned kNumberUpdaters = 8;
+static const unsigned kNumberCounters = 1024;
+static const unsigned kNumberIncrements = 256 * 1024;
+static const unsigned kNumberUpdates = 256 * 1024;
+static const unsigned kNumberRounds = 16 * 1024;
+static const unsigned kNumberKeys = 64;
+
+struct longcmp {
+	int operator()(long x, long y) const
+	{
+		return x - y;
+	}
+};
+
+typedef util::concurrent::skiplist_map<long, long, longcmp> map;
+
+static void test_single_thread();
+static void test_concurrent_counters();
+static void test_assign_erase();
+static void* incrementer(void* arg);
+static void* updater(void* arg);
+static void* assigner(void* arg);
+static void* eraser(void* arg);
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <test-number>\n", argv[0]);
+		fprintf(stderr, "\t0: Test skip list map (one thread).\n");
+		fprintf(stderr, "\t1: Test concurrent counters with:\n");
+		fprintf(stderr, "\t\t%u incrementers\n", kNumberIncrementers);
+		fprintf(stderr, "\t\t%u updaters.\n", kNumberUpdaters);
+		fprintf(stderr, "\t2: Test concurrent assign / erase of the same keys.\n");
+
+		return -1;
+	}
+
+	switch (atoi(argv[1])) {
+		case 0:
+			test_single_thread();
+			break;
+		case 1:
+			test_concurrent_counters();
+			break;
+		case 2:
+			test_assign_erase();
+			break;
+		default:
+			fprintf(stderr, "Wrong test number %s.\n", argv[1]);
+			return -1;
+	}
+
+	return 0;
+}
+
+struct add {
+	long n;
+
+	bool operator()(const long& oldval, long& newval)
+	{
+		newval = oldval + n;
+		return true;
+	}
+};
+
+struct print {
+	bool operator()(long k, long v)
+	{
+		printf("\t%ld => %ld\n", k, v);
+		return true;
+	}
+};
+
+void test_single_thread()
+{
+	map m;
+
+	if (!m.init()) {
+		fprintf(stderr, "Couldn't initialize skip list map.\n");
+		return;
+	}
+
+	printf("Inserting from 1 to 10 (value = key * 10)...\n");
+	for (long i = 10; i > 0; i--) {
+		if (!m.insert(i, i * 10)) {
+			fprintf(stderr, "Couldn't insert %ld.\n", i);
+			return;
+		}
+	}
+
+	if (m.insert(5, 0)) {
+		fprintf(stderr, "Key 5 inserted twice.\n");
+		return;
+	}
+
+	bool inserted;
+	if ((!m.insert_or_assign(5, 500, &inserted)) || (inserted)) {
+		fprintf(stderr, "Couldn't assign key 5.\n");
+		return;
+	}
+
+	if ((!m.insert_or_assign(11, 110, &inserted)) || (!inserted)) {
+		fprintf(stderr, "Couldn't insert key 11.\n");
+		return;
+	}
+
+	add a;
+	a.n = 1;
+	if (!m.compute_if_present(1, a)) {
+		fprintf(stderr, "Key 1 not found.\n");
+		return;
+	}
+
+	if (m.compute_if_present(12, a)) {
+		fprintf(stderr, "Key 12 found.\n");
+		return;
+	}
+
+	printf("Erasing 10...\n");
+	if (!m.erase(10)) {
+		fprintf(stderr, "Couldn't erase 10.\n");
+		return;
+	}
+
+	long v;
+	if (m.get(10, v)) {
+		fprintf(stderr, "Key 10 found after erasing it.\n");
+		return;
+	}
+
+	if ((!m.get(5, v)) || (v != 500)) {
+		fprintf(stderr, "Wrong value for key 5.\n");
+		return;
+	}
+
+	printf("From 1 to 11...\n");
+	m.scan(1, 11, print());
+}
+
+void test_concurrent_counters()
+{
+	map m;
+
+	if (!m.init()) {
+		fprintf(stderr, "Couldn't initialize skip list map.\n");
+		return;
+	}
+
+	// Counters use the even keys.
+	for (unsigned i = 0; i < kNumberCounters; i++) {
+		if (!m.insert(i * 2, 0)) {
+			fprintf(stderr, "Couldn't insert %u.\n", i * 2);
+			return;
+		}
+	}
+
+	// Create incrementers.
+	pthread_t incrementers[kNumberIncrementers];
+	for (unsigned i = 0; i < kNumberIncrementers; i++) {
+		if (pthread_create(&incrementers[i], NULL, incrementer, &m) != 0) {
+			fprintf(stderr, "Couldn't create incrementer %u.\n", i);
+			return;
+		}
+	}
+
+	// Create updaters.
+	pthread_t updaters[kNumberUpdaters];
+	for (unsigned i = 0; i < kNumberUpdaters; i++) {
+		if (pthread_create(&updaters[i], NULL, updater, &m) != 0) {
+			fprintf(stderr, "Couldn't create updater %u.\n", i);
+			return;
+		}
+	}
+
+	// Wait for incrementers.
+	for (unsigned i = 0; i < kNumberIncrementers; i++) {
+		pthread_join(incrementers[i], NULL);
+	}
+
+	// Wait for updaters.
+	for (unsigned i = 0; i < kNumberUpdaters; i++) {
+		pthread_join(updaters[i], NULL);
+	}
+
+	unsigned long total = 0;
+	for (unsigned i = 0; i < kNumberCounters; i++) {
+		long v;
+		if (!m.get(i * 2, v)) {
+			fprintf(stderr, "Counter %u not found.\n", i * 2);
+			return;
+		}
+
+		total += v;
+	}
+
+	if (total != static_cast<unsigned long>(kNumberIncrementers) * kNumberIncrements) {
+		fprintf(stderr, "Wrong total %lu (expected %lu).\n", total, static_cast<unsigned long>(kNumberIncrementers) * kNumberIncrements);
+		return;
+	}
+
+	printf("Total: %lu.\n", total);
+}
+
+void* incrementer(void* arg)
+{
+	map* m = reinterpret_cast<map*>(arg);
+
+	struct drand48_data data;
+	srand48_r(pthread_self(), &data);
+
+	add a;
+	a.n = 1;
+
+	for (unsigned i = 0; i < kNumberIncrements; i++) {
+		long n;
+		lrand48_r(&data, &n);
+
+		if (!m->compute_if_present((n % kNumberCounters) * 2, a)) {
+			fprintf(stderr, "Counter %ld not found.\n", (n % kNumberCounters) * 2);
+		}
+	}
+
+	return NULL;
+}
+
+void* updater(void* arg)
+{
+	map* m = reinterpret_cast<map*>(arg);
+
+	struct drand48_data data;
+	srand48_r(pthread_self(), &data);
+
+	// Insert, assign and erase the odd keys.
+	for (unsigned i = 0; i < kNumberUpdates; i++) {
+		long n;
+		lrand48_r(&data, &n);
+
+		long k = ((n % kNumberCounters) * 2) + 1;
+
+		switch (n % 3) {
+			case 0:
+				m->insert_or_assign(k, n);
+				break;
+			case 1:
+				m->insert(k, n);
+				break;
+			default:
+				m->erase(k);
+		}
+	}
+
+	return NULL;
+}
+
+struct race {
+	map m;
+	pthread_barrier_t barrier;
+	unsigned round;
+
+	bool inserted[kNumberKeys];
+	bool erased[kNumberKeys];
+};
+
+void test_assign_erase()
+{
+	race r;
+
+	if (!r.m.init()) {
+		fprintf(stderr, "Couldn't initialize skip list map.\n");
+		return;
+	}
+
+	pthread_barrier_init(&r.barrier, NULL, 3);
+
+	pthread_t threads[2];
+	if ((pthread_create(&threads[0], NULL, assigner, &r) != 0) ||
+	    (pthread_create(&threads[1], NULL, eraser, &r) != 0)) {
+		fprintf(stderr, "Couldn't create threads.\n");
+		return;
+	}
+
+	unsigned assigned = 0;
+
+	for (r.round = 0; r.round < kNumberRounds; r.round++) {
+		for (unsigned i = 0; i < kNumberKeys; i++) {
+			if (!r.m.insert(i, -1)) {
+				fprintf(stderr, "Couldn't insert %u.\n", i);
+				exit(-1);
+			}
+		}
+
+		// Start round.
+		pthread_barrier_wait(&r.barrier);
+
+		// Wait for the end of the round.
+		pthread_barrier_wait(&r.barrier);
+
+		for (unsigned i = 0; i < kNumberKeys; i++) {
+			// The key was present, it must have been erased.
+			if (!r.erased[i]) {
+				fprintf(stderr, "Key %u not erased in round %u.\n", i, r.round);
+				exit(-1);
+			}
+
+			long v;
+			bool found = r.m.get(i, v);
+
+			if (r.inserted[i]) {
+				// Erased before the assignment: the key must be present.
+				if ((!found) || (v != static_cast<long>(r.round))) {
+					fprintf(stderr, "Key %u lost after assigning it in round %u.\n", i, r.round);
+					exit(-1);
+				}
+
+				r.m.erase(i);
+			} else {
+				// Assigned before the erasure.
+				if (found) {
+					fprintf(stderr, "Key %u present after erasing it in round %u.\n", i, r.round);
+					exit(-1);
+				}
+
+				assigned++;
+			}
+		}
+	}
+
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+
+	pthread_barrier_destroy(&r.barrier);
+
+	printf("Rounds: %u, assigned before erasing: %u, inserted after erasing: %u.\n",
+	       kNumberRounds,
+	       assigned,
+	       (kNumberRounds * kNumberKeys) - assigned);
+}
+
+void* assigner(void* arg)
+{
+	race* r = reinterpret_cast<race*>(arg);
+
+	for (unsigned round = 0; round < kNumberRounds; round++) {
+		pthread_barrier_wait(&r->barrier);
+
+		for (unsigned i = kNumberKeys; i > 0; i--) {
+			if (!r->m.insert_or_assign(i - 1, round, &r->inserted[i - 1])) {
+				fprintf(stderr, "Couldn't assign %u.\n", i - 1);
+				exit(-1);
+			}
+		}
+
+		pthread_barrier_wait(&r->barrier);
+	}
+
+	return NULL;
+}
+
+void* eraser(void* arg)
+{
+	race* r = reinterpret_cast<race*>(arg);
+
+	for (unsigned round = 0; round < kNumberRounds; round++) {
+		pthread_barrier_wait(&r->barrier);
+
+		for (unsigned i = 0; i < kNumberKeys; i++) {
+			r->erased[i] = r->m.erase(i);
+		}
+
+		pthread_barrier_wait(&r->barrier);
+	}
+
+	return NULL;
+}
@@ -4,15 +4,25 @@
 #include <pthread.h>
 #include <signal.h>
 #include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
 #include "util/skiplist.h"
 #include "util/concurrent/skiplist.h"
 #include "util/concurrent/locks/spinlock.h"
+#include "util/random.h"
+#include "macros/macros.h"
 
 static const unsigned kNumberReaders = 33;
 static const unsigned kNumberWriters = 33;
 static const unsigned kNumberErasers = 33;
 static const unsigned kNumberIterators = 33;
 static const unsigned kHighestRandom = 64 * 1024;
+static const unsigned kNumberBulkKeys = 1024 * 1024;
+static const unsigned kNumberScanners = 4;
+static const unsigned kNumberUpdaters = 4;
+static const unsigned kScanSeconds = 5;
+static const unsigned kNumberLevels = 100 * 1000 * 1000;
 
 struct longcmp {
 	int operator()(long x, long y) const
@@ -43,6 +53,14 @@ static void test_concurrent_skiplist_iterators();
 static void print_list(const util::concurrent::skiplist<long, longcmp>& list, bool forward);
 
 static void test_single_threaded_skiplist();
+
+static int test_bulk_load();
+
+static int test_scan();
+static void* scanner(void* arg);
+static void* updater(void* arg);
+
+static int test_random_level();
 static void print_list(const util::skiplist<long, longcmp>& list, bool forward);
 
 int main(int argc, char** argv)
@@ -56,6 +74,9 @@ int main(int argc, char** argv)
 		fprintf(stderr, "\t\t%u iterators.\n", kNumberIterators);
 		fprintf(stderr, "\t1: Test iterators in concurrent skip list.\n");
 		fprintf(stderr, "\t2: Test skip list (one thread).\n");
+		fprintf(stderr, "\t3: Test bulk load in concurrent skip list.\n");
+		fprintf(stderr, "\t4: Test range scans with %u scanners and %u updaters.\n", kNumberScanners, kNumberUpdaters);
+		fprintf(stderr, "\t5: Benchmark random level generation.\n");
 
 		return -1;
 	}
@@ -70,6 +91,12 @@ int main(int argc, char** argv)
 		case 2:
 			test_single_threaded_skiplist();
 			break;
+		case 3:
+			return test_bulk_load();
+		case 4:
+			return test_scan();
+		case 5:
+			return test_random_level();
 		default:
 			fprintf(stderr, "Wrong test number %s.\n", argv[1]);
 			return -1;
@@ -589,3 +616,384 @@ void print_list(const util::skiplist<long, longcmp>& list, bool forward)
 		}
 	}
 }
+
+int test_bulk_load()
+{
+	long* keys;
+	if ((keys = reinterpret_cast<long*>(malloc(kNumberBulkKeys * sizeof(long)))) == NULL) {
+		fprintf(stderr, "Couldn't allocate memory for the keys.\n");
+		return -1;
+	}
+
+	for (unsigned i = 0; i < kNumberBulkKeys; i++) {
+		keys[i] = i;
+	}
+
+	for (unsigned pass = 0; pass < 2; pass++) {
+		util::concurrent::skiplist<long, longcmp> list;
+
+		if (!list.init()) {
+			fprintf(stderr, "Couldn't initialize skip list.\n");
+			free(keys);
+			return -1;
+		}
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if (pass == 0) {
+			for (unsigned i = 0; i < kNumberBulkKeys; i++) {
+				if (!list.insert(keys[i])) {
+					fprintf(stderr, "Couldn't insert %ld.\n", keys[i]);
+					free(keys);
+					return -1;
+				}
+			}
+		} else {
+			if (!list.bulk_load(keys, keys + kNumberBulkKeys)) {
+				fprintf(stderr, "Couldn't bulk load keys.\n");
+				free(keys);
+				return -1;
+			}
+		}
+
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+		printf("[%s] %u keys loaded in %.3f seconds.\n", (pass == 0) ? "insert" : "bulk_load", kNumberBulkKeys, elapsed);
+
+		// Check keys.
+		util::concurrent::skiplist<long, longcmp>::iterator it;
+		unsigned count = 0;
+		if (list.begin(it)) {
+			do {
+				if (it.key() != keys[count]) {
+					fprintf(stderr, "Wrong key %ld (expected %ld).\n", it.key(), keys[count]);
+					free(keys);
+					return -1;
+				}
+
+				count++;
+			} while (list.next(it));
+		}
+
+		if (count != kNumberBulkKeys) {
+			fprintf(stderr, "Wrong number of keys %u (expected %u).\n", count, kNumberBulkKeys);
+			free(keys);
+			return -1;
+		}
+
+		// Bulk loaded nodes can be erased.
+		for (unsigned i = 0; i < kNumberBulkKeys; i += 2) {
+			if (!list.erase(keys[i])) {
+				fprintf(stderr, "Couldn't erase %ld.\n", keys[i]);
+				free(keys);
+				return -1;
+			}
+		}
+
+		// The list is not empty anymore.
+		if (list.bulk_load(keys, keys + kNumberBulkKeys)) {
+			fprintf(stderr, "Bulk load in non-empty list succeeded.\n");
+			free(keys);
+			return -1;
+		}
+	}
+
+	// Unsorted keys: the keys loaded are removed.
+	util::concurrent::skiplist<long, longcmp> list;
+	if (!list.init()) {
+		fprintf(stderr, "Couldn't initialize skip list.\n");
+		free(keys);
+		return -1;
+	}
+
+	keys[kNumberBulkKeys / 2] = -1;
+
+	util::concurrent::skiplist<long, longcmp>::iterator it;
+	if ((list.bulk_load(keys, keys + kNumberBulkKeys)) || (list.begin(it)) || (list.contains(0))) {
+		fprintf(stderr, "Bulk load of unsorted keys left keys in the list.\n");
+		free(keys);
+		return -1;
+	}
+
+	// The list can be loaded again.
+	if ((!list.bulk_load(keys, keys + (kNumberBulkKeys / 2))) || (!list.contains(0)) || (!list.contains((kNumberBulkKeys / 2) - 1))) {
+		fprintf(stderr, "Couldn't bulk load keys after a failed bulk load.\n");
+		free(keys);
+		return -1;
+	}
+
+	free(keys);
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+// Set by the scanners if a scan is wrong.
+static bool scan_failed = false;
+
+struct scan_state {
+	long last;
+	long last_even;
+};
+
+struct scan_check {
+	scan_state* state;
+
+	bool operator()(long k)
+	{
+		if (k <= state->last) {
+			fprintf(stderr, "Key %ld after %ld.\n", k, state->last);
+
+			scan_failed = true;
+			return false;
+		}
+
+		state->last = k;
+
+		// Even keys are never erased.
+		if ((k % 2) == 0) {
+			if ((state->last_even >= 0) && (k != state->last_even + 2)) {
+				fprintf(stderr, "Even keys missing between %ld and %ld.\n", state->last_even, k);
+
+				scan_failed = true;
+				return false;
+			}
+
+			state->last_even = k;
+		}
+
+		return true;
+	}
+};
+
+int test_scan()
+{
+	util::concurrent::skiplist<long, longcmp> list;
+
+	if (!list.init()) {
+		fprintf(stderr, "Couldn't initialize skip list.\n");
+		return -1;
+	}
+
+	// Insert even keys.
+	for (long i = 0; i < kHighestRandom; i += 2) {
+		if (!list.insert(i)) {
+			fprintf(stderr, "Couldn't insert %ld.\n", i);
+			return -1;
+		}
+	}
+
+	// Create updaters (insert and erase odd keys).
+	pthread_t updaters[kNumberUpdaters];
+	for (unsigned i = 0; i < kNumberUpdaters; i++) {
+		if (pthread_create(&updaters[i], NULL, updater, &list) != 0) {
+			fprintf(stderr, "Couldn't create updater %u.\n", i);
+			return -1;
+		}
+	}
+
+	// Create scanners.
+	pthread_t scanners[kNumberScanners];
+	for (unsigned i = 0; i < kNumberScanners; i++) {
+		if (pthread_create(&scanners[i], NULL, scanner, &list) != 0) {
+			fprintf(stderr, "Couldn't create scanner %u.\n", i);
+			return -1;
+		}
+	}
+
+	sleep(kScanSeconds);
+
+	running = false;
+
+	// Wait for scanners.
+	unsigned long scans = 0;
+	for (unsigned i = 0; i < kNumberScanners; i++) {
+		void* ret;
+		pthread_join(scanners[i], &ret);
+		scans += reinterpret_cast<unsigned long>(ret);
+	}
+
+	// Wait for updaters.
+	for (unsigned i = 0; i < kNumberUpdaters; i++) {
+		pthread_join(updaters[i], NULL);
+	}
+
+	printf("%lu scans in %u seconds.\n", scans, kScanSeconds);
+
+	if (scan_failed) {
+		return -1;
+	}
+
+	printf("Success.\n");
+
+	return 0;
+}
+
+void* scanner(void* arg)
+{
+	util::concurrent::skiplist<long, longcmp> *list = reinterpret_cast<util::concurrent::skiplist<long, longcmp>*>(arg);
+
+	struct drand48_data data;
+	srand48_r(0xc0c0c0c0, &data);
+
+	unsigned long scans = 0;
+
+	while (running) {
+		long from;
+		lrand48_r(&data, &from);
+
+		// Start at an even key.
+		from = (from % kHighestRandom) & ~1l;
+
+		scan_state state;
+		state.last = -1;
+		state.last_even = -1;
+
+		scan_check check;
+		check.state = &state;
+
+		list->scan(from, from + 1024, check);
+
+		// Last even key.
+		long to = MIN(from + 1024, (long) kHighestRandom - 2);
+		if (state.last_even != to) {
+			fprintf(stderr, "Scan [%ld, %ld] stopped at %ld.\n", from, from + 1024, state.last_even);
+
+			scan_failed = true;
+			break;
+		}
+
+		scans++;
+	}
+
+	return reinterpret_cast<void*>(scans);
+}
+
+void* updater(void* arg)
+{
+	util::concurrent::skiplist<long, longcmp> *list = reinterpret_cast<util::concurrent::skiplist<long, longcmp>*>(arg);
+
+	struct drand48_data data;
+	srand48_r(pthread_self(), &data);
+
+	while (running) {
+		long n;
+		lrand48_r(&data, &n);
+
+		// Odd key.
+		n = (n % kHighestRandom) | 1;
+
+		if (!list->insert(n)) {
+			list->erase(n);
+		}
+	}
+
+	return NULL;
+}
+
+int test_random_level()
+{
+	static const int kMaxLevel = 16;
+
+	for (unsigned pass = 0; pass < 2; pass++) {
+		unsigned levels[kMaxLevel + 1];
+		for (int i = 0; i <= kMaxLevel; i++) {
+			levels[i] = 0;
+		}
+
+		struct drand48_data data;
+		srand48_r(0xc0, &data);
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (unsigned i = 0; i < kNumberLevels; i++) {
+			int level;
+
+			if (pass == 0) {
+				// lrand48_r() loop.
+				level = 1;
+				long rand;
+
+				do {
+					lrand48_r(&data, &rand);
+					if ((rand % 4) == 0) {
+						level++;
+					} else {
+						break;
+					}
+				} while (level < kMaxLevel);
+			} else {
+				// xorshift and count trailing zeros.
+				level = util::random_level(kMaxLevel);
+
+				if ((level < 1) || (level > kMaxLevel)) {
+					fprintf(stderr, "Invalid level %d.\n", level);
+					return -1;
+				}
+			}
+
+			levels[level]++;
+		}
+
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+		printf("[%s] %u levels in %.3f seconds (%.1f ns/level).\n", (pass == 0) ? "lrand48_r" : "xorshift", kNumberLevels, elapsed, (elapsed * 1000000000.0) / kNumberLevels);
+
+		for (int i = 1; i <= kMaxLevel; i++) {
+			printf("\tLevel %2d: %.6f\n", i, (double) levels[i] / kNumberLevels);
+		}
+	}
+
+	// Check the distribution of util::random_level(): P(level = l) is
+	// 0.75 * 0.25^(l - 1) (the last level gets the rest).
+	unsigned levels[kMaxLevel + 1];
+	for (int i = 0; i <= kMaxLevel; i++) {
+		levels[i] = 0;
+	}
+
+	for (unsigned i = 0; i < kNumberLevels; i++) {
+		levels[util::random_level(kMaxLevel)]++;
+	}
+
+	double p = 0.75;
+	for (int i = 1; i <= kMaxLevel; i++) {
+		if (i == kMaxLevel) {
+			p /= 0.75;
+		}
+
+		double expected = p * kNumberLevels;
+
+		// Only check the levels with enough samples (6 standard deviations).
+		if (expected >= 100) {
+			double deviation = 6 * sqrt(expected * (1 - p));
+
+			if (fabs(levels[i] - expected) > deviation) {
+				fprintf(stderr, "Level %d: %u (expected %.0f +- %.0f).\n", i, levels[i], expected, deviation);
+				return -1;
+			}
+		}
+
+		p *= 0.25;
+	}
+
+	// The level is limited to 'max_level'.
+	for (unsigned i = 0; i < 1000000; i++) {
+		if (util::random_level(2) > 2) {
+			fprintf(stderr, "Level above the maximum.\n");
+			return -1;
+		}
+	}
+
+	printf("Success.\n");
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef UTIL_ALLOCATOR_H
+#define UTIL_ALLOCATOR_H
+
+// Allocator which uses malloc() / free().
+//
+// Allocator policies must provide:
+//   bool init();
+//   void* allocate(size_t size);
+//   void deallocate(void* p);
+//   kFreesAll: true if the allocator frees all the memory when it is
+//              destroyed (deallocate() is not required).
+
+#include <stdlib.h>
+
+namespace util {
+	class malloc_allocator {
+		public:
+			static const bool kFreesAll = false;
+
+			// Initialize.
+			bool init();
+
+			// Allocate.
+			void* allocate(size_t size);
+
+			// Deallocate.
+			void deallocate(void* p);
+	};
+
+	inline bool malloc_allocator::init()
+	{
+		return true;
+	}
+
+	inline void* malloc_allocator::allocate(size_t size)
+	{
+		return malloc(size);
+	}
+
+	inline void malloc_allocator::deallocate(void* p)
+	{
+		free(p);
+	}
+}
+
+#endif // UTIL_ALLOCATOR_H
@@ -1,4 +1,7 @@
+#include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
+#include <sys/mman.h>
 #include "util/arena.h"
 #include "macros/macros.h"
 
@@ -6,39 +9,102 @@ util::arena::~arena()
 {
 	while (_M_head) {
 		block* next = _M_head->next;
-		free(_M_head);
+		free_block(_M_head);
 		_M_head = next;
 	}
+
+	while (_M_free) {
+		block* next = _M_free->next;
+		free_block(_M_free);
+		_M_free = next;
+	}
 }
 
-void* util::arena::allocate(size_t size)
+void* util::arena::allocate(size_t size, size_t alignment)
 {
 	assert(size > 0);
+	assert((alignment > 0) && ((alignment & (alignment - 1)) == 0));
 
-	// Align.
-	size_t mod;
-	if ((mod = size % sizeof(void*)) != 0) {
-		size += sizeof(void*) - mod;
-	}
+	uintptr_t p;
+
+	if ((!_M_head) ||
+	    ((p = (reinterpret_cast<uintptr_t>(_M_head->data + _M_used) + alignment - 1) & ~(alignment - 1)) + size >
+	     reinterpret_cast<uintptr_t>(_M_head->data + _M_head->size))) {
+		// Blocks are at least aligned to 'kDefaultAlignment'.
+		size_t data_size = size + ((alignment > kDefaultAlignment) ? alignment - 1 : 0);
 
-	if (_M_used + size > kDataSize) {
-		if (!create_block(MAX(kDataSize, size))) {
+		if (!get_block(data_size)) {
 			return NULL;
 		}
+
+		p = (reinterpret_cast<uintptr_t>(_M_head->data) + alignment - 1) & ~(alignment - 1);
 	}
 
-	char* p = _M_head->data + _M_used;
-	_M_used += size;
+	_M_used = (p + size) - reinterpret_cast<uintptr_t>(_M_head->data);
 	_M_count += size;
 
-	return p;
+	return reinterpret_cast<void*>(p);
+}
+
+void util::arena::rewind(const position& pos)
+{
+	if (_M_count > _M_high_water) {
+		_M_high_water = _M_count;
+	}
+
+	// Move the blocks created after 'pos' to the free list.
+	while (_M_head != pos.head) {
+		// 'pos' must point to a block in use (not released by a previous
+		// rewind() / reset()).
+		assert(_M_head != NULL);
+
+		block* next = _M_head->next;
+
+		_M_head->next = _M_free;
+		_M_free = _M_head;
+
+		_M_head = next;
+	}
+
+	assert((!pos.head) || (pos.used <= pos.head->size));
+
+	_M_used = pos.used;
+	_M_count = pos.count;
 }
 
-bool util::arena::create_block(size_t data_size)
+void util::arena::reset()
 {
+	position pos;
+	pos.head = NULL;
+	pos.used = 0;
+	pos.count = 0;
+
+	rewind(pos);
+}
+
+bool util::arena::get_block(size_t data_size)
+{
+	// Search the free list for the first block big enough.
+	block** prev = &_M_free;
 	block* b;
-	if ((b = reinterpret_cast<block*>(malloc(sizeof(block*) + data_size))) == NULL) {
-		return false;
+	while (((b = *prev) != NULL) && (b->size < data_size)) {
+		prev = &b->next;
+	}
+
+	if (b) {
+		*prev = b->next;
+	} else {
+		// '_M_block_size' includes the block header.
+		size_t block_data_size = _M_block_size - offsetof(block, data);
+
+		if ((b = create_block(MAX(block_data_size, data_size))) == NULL) {
+			return false;
+		}
+
+		// Geometric growth.
+		if (_M_block_size < _M_max_block_size) {
+			_M_block_size = MIN(_M_block_size * 2, _M_max_block_size);
+		}
 	}
 
 	b->next = _M_head;
@@ -48,3 +114,55 @@ bool util::arena::create_block(size_t data_size)
 
 	return true;
 }
+
+struct util::arena::block* util::arena::create_block(size_t data_size)
+{
+	size_t size = offsetof(block, data) + data_size;
+
+	block* b;
+	if (_M_huge_pages) {
+		// Round to the huge page size.
+		size = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+		// Map one more huge page to be able to align the block.
+		void* p;
+		if ((p = mmap(NULL, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+			return NULL;
+		}
+
+		uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+		uintptr_t aligned = (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+		// Unmap the unaligned head and the tail.
+		if (aligned > begin) {
+			munmap(p, aligned - begin);
+		}
+
+		munmap(reinterpret_cast<void*>(aligned + size), kHugePageSize - (aligned - begin));
+
+#ifdef MADV_HUGEPAGE
+		madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+
+		b = reinterpret_cast<block*>(aligned);
+	} else {
+		if ((b = reinterpret_cast<block*>(malloc(size))) == NULL) {
+			return NULL;
+		}
+	}
+
+	b->size = size - offsetof(block, data);
+
+	_M_size += size;
+
+	return b;
+}
+
+void util::arena::free_block(block* b)
+{
+	if (_M_huge_pages) {
+		munmap(b, offsetof(block, data) + b->size);
+	} else {
+		free(b);
+	}
+}
@@ -2,14 +2,29 @@
 #define UTIL_ARENA_H
 
 // Simple allocator.
+//
+// Blocks start with 'block_size' bytes (block header included) and double their size up to
+// 'max_block_size'. If 'huge_pages' is set, blocks are mapped with mmap()
+// and the kernel is advised to back them with transparent huge pages.
+//
+// rewind() and reset() don't free the blocks, they are kept for later
+// allocations. A position returned by mark() is invalidated by a rewind() /
+// reset() to an earlier position.
 
 #include <stdlib.h>
 
 namespace util {
 	class arena {
 		public:
+			static const size_t kDefaultBlockSize = 4 * 1024;
+			static const size_t kMinBlockSize = 64;
+			static const size_t kDefaultAlignment = sizeof(void*);
+			static const size_t kHugePageSize = 2 * 1024 * 1024;
+
 			// Constructor.
-			arena();
+			arena(size_t block_size = kDefaultBlockSize,
+			      size_t max_block_size = kDefaultBlockSize,
+			      bool huge_pages = false);
 
 			// Destructor.
 			~arena();
@@ -17,37 +32,114 @@ namespace util {
 			// Allocate.
 			void* allocate(size_t size);
 
+			// Allocate with alignment (power of 2).
+			void* allocate(size_t size, size_t alignment);
+
 			// Get count.
 			size_t count() const;
 
-		private:
-			static const size_t kBlockSize = 4 * 1024;
-			static const size_t kDataSize = kBlockSize - sizeof(void*);
+			// Get highest count since the arena was created.
+			size_t high_water() const;
+
+			// Get number of bytes held in blocks (used and free).
+			size_t size() const;
 
+		private:
 			struct block {
 				struct block* next;
+				size_t size;
 				char data[1];
 			};
 
+		public:
+			struct position {
+				block* head;
+				size_t used;
+				size_t count;
+			};
+
+			// Get current position.
+			position mark() const;
+
+			// Release all allocations done after 'pos'.
+			void rewind(const position& pos);
+
+			// Release all allocations.
+			void reset();
+
+		private:
 			block* _M_head;
 			size_t _M_used;
 			size_t _M_count;
 
+			// Blocks released by rewind() / reset().
+			block* _M_free;
+
+			size_t _M_high_water;
+			size_t _M_size;
+
+			size_t _M_block_size;
+			size_t _M_max_block_size;
+			bool _M_huge_pages;
+
+			// Get block (from the free list or a new one).
+			bool get_block(size_t data_size);
+
 			// Create block.
-			bool create_block(size_t data_size);
+			block* create_block(size_t data_size);
+
+			// Free block.
+			void free_block(block* b);
 	};
 
-	inline arena::arena()
+	inline arena::arena(size_t block_size, size_t max_block_size, bool huge_pages)
 	: _M_head(NULL),
-	_M_used(kDataSize),
-	_M_count(0)
+	_M_used(0),
+	_M_count(0),
+	_M_free(NULL),
+	_M_high_water(0),
+	_M_size(0),
+	_M_block_size((block_size < kMinBlockSize) ? kMinBlockSize : block_size),
+	_M_max_block_size((max_block_size < _M_block_size) ? _M_block_size : max_block_size),
+	_M_huge_pages(huge_pages)
+	{
+	}
+
+	inline void* arena::allocate(size_t size)
 	{
+		// Align.
+		size_t mod;
+		if ((mod = size % kDefaultAlignment) != 0) {
+			size += kDefaultAlignment - mod;
+		}
+
+		return allocate(size, kDefaultAlignment);
 	}
 
 	inline size_t arena::count() const
 	{
 		return _M_count;
 	}
+
+	inline size_t arena::high_water() const
+	{
+		return (_M_count > _M_high_water) ? _M_count : _M_high_water;
+	}
+
+	inline size_t arena::size() const
+	{
+		return _M_size;
+	}
+
+	inline arena::position arena::mark() const
+	{
+		position pos;
+		pos.head = _M_head;
+		pos.used = _M_used;
+		pos.count = _M_count;
+
+		return pos;
+	}
 }
 
 #endif // UTIL_ARENA_H
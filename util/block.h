@@ -2,7 +2,11 @@
 #define UTIL_BLOCK_H
 
 #include <stdint.h>
+#include <string.h>
 #include <endian.h>
+#include "util/lz.h"
+#include "util/crc32c.h"
+#include "util/random.h"
 
 namespace util {
 	typedef uint32_t blocklen_t;
@@ -15,10 +19,55 @@ namespace util {
 
 			const unsigned char* _M_data;
 
+			// Get size (including the flags).
+			blocklen_t raw_size() const;
+
+			// Get magic of the file header.
+			static const unsigned char* file_magic();
+
 		public:
 			static const size_t kMinSize = sizeof(struct header);
 			static const size_t kMaxSize = 1024 * 1024;
 
+			// Sync blocks can be written between the blocks, so that a
+			// block boundary can be found from any offset of the file
+			// (by searching the sync block). Every file has its own
+			// random sync marker, stored in the file header (a block at
+			// the beginning of the file with the magic "BLKFILE1"
+			// followed by the sync marker); this way, a payload which
+			// contains the sync block of another file is not taken for
+			// a sync block. The file header and the sync blocks are
+			// returned as normal blocks by the sequential readers.
+			static const size_t kSyncMarkerSize = 16;
+			static const size_t kSyncSize = kMinSize + kSyncMarkerSize;
+
+			static const size_t kFileMagicSize = 8;
+			static const size_t kFileHeaderSize = kMinSize + kFileMagicSize + kSyncMarkerSize;
+
+			// Compressed blocks have the highest bit of the size set;
+			// the data is the length of the uncompressed data (uint32_t,
+			// big endian) followed by the data compressed with util::lz.
+			static const blocklen_t kCompressed = static_cast<blocklen_t>(1) << (sizeof(blocklen_t) * 8 - 1);
+			static const size_t kCompressedHeaderSize = kMinSize + sizeof(uint32_t);
+
+			// Blocks with a checksum have the second highest bit of the
+			// size set; the block ends with the CRC-32C of the header and
+			// the data (uint32_t, big endian).
+			static const blocklen_t kChecksum = kCompressed >> 1;
+			static const size_t kChecksumSize = sizeof(uint32_t);
+
+			static const blocklen_t kFlags = kCompressed | kChecksum;
+
+			// Encode header.
+			static void encode_header(unsigned char* buf, blocklen_t size, blocklen_t flags = 0);
+
+			// Make file header (kFileHeaderSize bytes) with a random
+			// sync marker.
+			static void make_file_header(unsigned char* buf);
+
+			// Make sync block (kSyncSize bytes) from the file header.
+			static void make_sync_block(const block& file_header, unsigned char* buf);
+
 			// Constructor.
 			block();
 			block(const unsigned char* data);
@@ -32,6 +81,36 @@ namespace util {
 			// Get data.
 			const unsigned char* data() const;
 			const unsigned char* data(blocklen_t& len) const;
+
+			// Is it a file header?
+			bool file_header() const;
+
+			// Get sync marker (only for file headers).
+			const unsigned char* sync_marker() const;
+
+			// Is it a sync block of the file with the sync marker
+			// 'marker'?
+			bool sync(const unsigned char* marker) const;
+
+			// Is the block compressed?
+			bool compressed() const;
+
+			// Does the block have a checksum?
+			bool checksummed() const;
+
+			// Check the header (the rest of the block might not have
+			// been read yet): the size must be at least the minimum
+			// size for the flags of the block and at most kMaxSize.
+			// If 'checksum_required' is set, blocks without checksum
+			// (except the file header and the sync blocks) are
+			// invalid.
+			bool valid_header(bool checksum_required = false) const;
+
+			// Verify checksum (true if the block has no checksum).
+			bool verify() const;
+
+			// Decompress block into 'buf' (of at least kMaxSize bytes).
+			bool decompress(unsigned char* buf, block& out) const;
 	};
 
 	inline block::block()
@@ -44,7 +123,7 @@ namespace util {
 	{
 	}
 
-	inline blocklen_t block::size() const
+	inline blocklen_t block::raw_size() const
 	{
 		const struct header* h = reinterpret_cast<const struct header*>(_M_data);
 
@@ -62,9 +141,20 @@ namespace util {
 		}
 	}
 
+	inline blocklen_t block::size() const
+	{
+		return raw_size() & ~kFlags;
+	}
+
 	inline blocklen_t block::datalen() const
 	{
-		return size() - sizeof(struct header);
+		blocklen_t size = this->size();
+
+		if (!checksummed()) {
+			return (size >= sizeof(struct header)) ? size - sizeof(struct header) : 0;
+		}
+
+		return (size >= sizeof(struct header) + kChecksumSize) ? size - sizeof(struct header) - kChecksumSize : 0;
 	}
 
 	inline const unsigned char* block::data() const
@@ -77,6 +167,134 @@ namespace util {
 		len = datalen();
 		return (len == 0) ? reinterpret_cast<const unsigned char*>("") : _M_data + sizeof(struct header);
 	}
+
+	inline bool block::file_header() const
+	{
+		return ((raw_size() == kFileHeaderSize) && (memcmp(_M_data + kMinSize, file_magic(), kFileMagicSize) == 0));
+	}
+
+	inline const unsigned char* block::sync_marker() const
+	{
+		return _M_data + kMinSize + kFileMagicSize;
+	}
+
+	inline bool block::sync(const unsigned char* marker) const
+	{
+		return ((raw_size() == kSyncSize) && (memcmp(_M_data + kMinSize, marker, kSyncMarkerSize) == 0));
+	}
+
+	inline bool block::compressed() const
+	{
+		return ((raw_size() & kCompressed) != 0);
+	}
+
+	inline bool block::checksummed() const
+	{
+		return ((raw_size() & kChecksum) != 0);
+	}
+
+	inline bool block::valid_header(bool checksum_required) const
+	{
+		blocklen_t size = this->size();
+		if ((size < kMinSize) || (size > kMaxSize)) {
+			return false;
+		}
+
+		if (checksummed()) {
+			return (size >= kMinSize + kChecksumSize);
+		}
+
+		return ((!checksum_required) || (raw_size() == kSyncSize) || (raw_size() == kFileHeaderSize));
+	}
+
+	inline bool block::verify() const
+	{
+		if (!checksummed()) {
+			return true;
+		}
+
+		blocklen_t size = this->size();
+		if (size < kMinSize + kChecksumSize) {
+			return false;
+		}
+
+		uint32_t crc;
+		memcpy(&crc, _M_data + size - kChecksumSize, sizeof(uint32_t));
+
+		return (be32toh(crc) == crc32c::compute(_M_data, size - kChecksumSize));
+	}
+
+	inline bool block::decompress(unsigned char* buf, block& out) const
+	{
+		blocklen_t datalen = this->datalen();
+		if (datalen < kCompressedHeaderSize - kMinSize) {
+			return false;
+		}
+
+		uint32_t len;
+		memcpy(&len, _M_data + kMinSize, sizeof(uint32_t));
+
+		if ((len = be32toh(len)) > kMaxSize - kMinSize) {
+			return false;
+		}
+
+		size_t n;
+		if ((!lz::decompress(_M_data + kCompressedHeaderSize, datalen - (kCompressedHeaderSize - kMinSize), buf + kMinSize, len, n)) || (n != len)) {
+			return false;
+		}
+
+		encode_header(buf, kMinSize + len);
+		out = block(buf);
+
+		return true;
+	}
+
+	inline void block::encode_header(unsigned char* buf, blocklen_t size, blocklen_t flags)
+	{
+		size |= flags;
+
+		struct header h;
+
+		switch (sizeof(blocklen_t)) {
+			case 1:
+				h.size = size;
+				break;
+			case 2:
+				h.size = htobe16(size);
+				break;
+			case 4:
+				h.size = htobe32(size);
+				break;
+			case 8:
+				h.size = htobe64(size);
+				break;
+		}
+
+		memcpy(buf, &h, sizeof(struct header));
+	}
+
+	inline void block::make_file_header(unsigned char* buf)
+	{
+		encode_header(buf, kFileHeaderSize);
+		memcpy(buf + kMinSize, file_magic(), kFileMagicSize);
+
+		unsigned char* marker = buf + kMinSize + kFileMagicSize;
+		for (size_t i = 0; i < kSyncMarkerSize; i += sizeof(uint64_t)) {
+			uint64_t n = thread_random();
+			memcpy(marker + i, &n, sizeof(uint64_t));
+		}
+	}
+
+	inline void block::make_sync_block(const block& file_header, unsigned char* buf)
+	{
+		encode_header(buf, kSyncSize);
+		memcpy(buf + kMinSize, file_header.sync_marker(), kSyncMarkerSize);
+	}
+
+	inline const unsigned char* block::file_magic()
+	{
+		return reinterpret_cast<const unsigned char*>("BLKFILE1");
+	}
 }
 
 #endif // UTIL_BLOCK_H
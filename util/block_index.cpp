@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include "util/block_index.h"
+#include "fs/file.h"
+
+const char* const util::block_index::kSuffix = ".idx";
+
+bool util::block_index::load(const char* filename)
+{
+	static const off_t kMaxSize = 1024LL * 1024 * 1024;
+
+	string::buffer name;
+	if (!index_filename(filename, name)) {
+		return false;
+	}
+
+	_M_buf.reset();
+
+	if ((!fs::file::read_all(name.data(), _M_buf, kMaxSize)) || (_M_buf.count() < sizeof(uint64_t))) {
+		return false;
+	}
+
+	uint64_t interval;
+	memcpy(&interval, _M_buf.data(), sizeof(uint64_t));
+
+	if ((_M_interval = be64toh(interval)) == 0) {
+		return false;
+	}
+
+	// Ignore incomplete entry (if any).
+	_M_count = (_M_buf.count() - sizeof(uint64_t)) / sizeof(uint64_t);
+
+	// While the index is being written, the file might be preallocated:
+	// ignore the zeroed entries (only the block 0 is at offset 0).
+	const unsigned char* entries = reinterpret_cast<const unsigned char*>(_M_buf.data()) + sizeof(uint64_t);
+	static const unsigned char zero[sizeof(uint64_t)] = {0};
+
+	while ((_M_count > 1) && (memcmp(entries + (_M_count - 1) * sizeof(uint64_t), zero, sizeof(uint64_t)) == 0)) {
+		_M_count--;
+	}
+
+	return true;
+}
+
+bool util::block_index::find(uint64_t n, off_t& offset, uint64_t& skip) const
+{
+	if (_M_count == 0) {
+		return false;
+	}
+
+	uint64_t entry = n / _M_interval;
+	if (entry >= _M_count) {
+		entry = _M_count - 1;
+	}
+
+	uint64_t off;
+	memcpy(&off, _M_buf.data() + (1 + entry) * sizeof(uint64_t), sizeof(uint64_t));
+
+	offset = be64toh(off);
+	skip = n - entry * _M_interval;
+
+	return true;
+}
+
+bool util::block_index::index_filename(const char* filename, string::buffer& buf)
+{
+	buf.reset();
+	return ((buf.append(filename)) && (buf.append_nul_terminated_string(kSuffix, strlen(kSuffix))));
+}
@@ -0,0 +1,63 @@
+#ifndef UTIL_BLOCK_INDEX_H
+#define UTIL_BLOCK_INDEX_H
+
+// Sparse index of a block file (written by util::block_writer).
+//
+// The index is stored in the file "<block file>.idx": the index interval N
+// (uint64_t, big endian) followed by the offsets of the blocks 0, N, 2N...
+// (uint64_t, big endian). Sync blocks are not counted.
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "string/buffer.h"
+
+namespace util {
+	class block_index {
+		public:
+			static const char* const kSuffix;
+
+			// Constructor.
+			block_index();
+
+			// Load index of the block file 'filename'.
+			bool load(const char* filename);
+
+			// Get the offset of the closest indexed block at or before
+			// block 'n'; 'skip' is the number of blocks to skip from
+			// there to reach block 'n'.
+			bool find(uint64_t n, off_t& offset, uint64_t& skip) const;
+
+			// Get index interval.
+			uint64_t interval() const;
+
+			// Get number of entries.
+			size_t count() const;
+
+			// Build index filename.
+			static bool index_filename(const char* filename, string::buffer& buf);
+
+		private:
+			string::buffer _M_buf;
+
+			uint64_t _M_interval;
+			size_t _M_count;
+	};
+
+	inline block_index::block_index()
+		: _M_interval(0),
+		  _M_count(0)
+	{
+	}
+
+	inline uint64_t block_index::interval() const
+	{
+		return _M_interval;
+	}
+
+	inline size_t block_index::count() const
+	{
+		return _M_count;
+	}
+}
+
+#endif // UTIL_BLOCK_INDEX_H
@@ -2,8 +2,13 @@
 #include "util/block_reader.h"
 #include "macros/macros.h"
 
-bool util::block_reader::next(block& block, string::buffer& buf, int timeout, error& err)
+bool util::block_reader::next_raw(block& block, string::buffer& buf, int timeout, error& err)
 {
+	if ((!_M_buf) && ((_M_buf = reinterpret_cast<unsigned char*>(malloc(_M_size))) == NULL)) {
+		err = kNoMemory;
+		return false;
+	}
+
 	// While we don't have a full header...
 	size_t count;
 	while ((count = _M_end - _M_block) < block::kMinSize) {
@@ -19,14 +24,15 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 		}
 
 		ssize_t ret;
-		if ((ret = read(_M_buf + _M_end, sizeof(_M_buf) - _M_end, timeout, err)) <= 0) {
+		if ((ret = read(_M_buf + _M_end, _M_size - _M_end, timeout, err)) <= 0) {
 			return false;
 		}
 
 		_M_end += ret;
 	}
 
-	blocklen_t block_size = util::block(_M_buf + _M_block).size();
+	util::block header(_M_buf + _M_block);
+	blocklen_t block_size = header.size();
 
 	// If the block is too big...
 	if (block_size > block::kMaxSize) {
@@ -34,6 +40,12 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 		return false;
 	}
 
+	// If the header is invalid (e.g. torn write)...
+	if (!header.valid_header(_M_checksums_required)) {
+		err = kCorruptBlock;
+		return false;
+	}
+
 	// If we have a full block...
 	if (block_size <= count) {
 		block = util::block(_M_buf + _M_block);
@@ -47,7 +59,7 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 	unsigned char* begin;
 
 	// If the block doesn't fit in the buffer...
-	if (block_size > sizeof(_M_buf)) {
+	if (block_size > _M_size) {
 		if (!buf.allocate(block_size)) {
 			err = kNoMemory;
 			return false;
@@ -62,7 +74,7 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 		ssize_t ret;
 		size_t n;
 		do {
-			if ((ret = read(_M_buf, sizeof(_M_buf), timeout, err)) <= 0) {
+			if ((ret = read(_M_buf, _M_size, timeout, err)) <= 0) {
 				return false;
 			}
 
@@ -87,7 +99,7 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 		// Read.
 		ssize_t ret;
 		do {
-			if ((ret = read(_M_buf + _M_end, sizeof(_M_buf) - _M_end, timeout, err)) <= 0) {
+			if ((ret = read(_M_buf + _M_end, _M_size - _M_end, timeout, err)) <= 0) {
 				return false;
 			}
 
@@ -101,3 +113,49 @@ bool util::block_reader::next(block& block, string::buffer& buf, int timeout, er
 
 	return true;
 }
+
+size_t util::block_reader::next_batch(block* blocks, size_t max, string::buffer& buf, int timeout, error& err)
+{
+	if ((max == 0) || (!next(*blocks, buf, timeout, err))) {
+		return 0;
+	}
+
+	size_t n = 1;
+
+	// Add the complete blocks in the buffer (the errors, if any, will be
+	// reported by the next call). Compressed blocks are not added, as
+	// they are decompressed into the same buffer.
+	while (n < max) {
+		size_t count = _M_end - _M_block;
+		if (count < block::kMinSize) {
+			break;
+		}
+
+		blocklen_t block_size = util::block(_M_buf + _M_block).size();
+		util::block b(_M_buf + _M_block);
+		if ((block_size > count) || (!b.valid_header(_M_checksums_required)) || (b.compressed()) || (!b.verify())) {
+			break;
+		}
+
+		blocks[n++] = b;
+
+		_M_block += block_size;
+	}
+
+	return n;
+}
+
+bool util::block_reader::decompress(block& block, error& err)
+{
+	if ((!_M_scratch) && ((_M_scratch = reinterpret_cast<unsigned char*>(malloc(block::kMaxSize))) == NULL)) {
+		err = kNoMemory;
+		return false;
+	}
+
+	if (!block.decompress(_M_scratch, block)) {
+		err = kCorruptBlock;
+		return false;
+	}
+
+	return true;
+}
@@ -3,46 +3,121 @@
 
 #include "util/block.h"
 #include "string/buffer.h"
+#include "macros/macros.h"
 
 namespace util {
 	class block_reader {
 		public:
-			static const size_t kBufferSize = 4 * 1024;
+			static const size_t kDefaultBufferSize = 1024 * 1024;
 
 			// Constructor.
-			block_reader();
+			block_reader(size_t buffer_size = kDefaultBufferSize);
 
-			// Get next block.
+			// Destructor.
+			virtual ~block_reader();
+
+			// Get buffer size (blocks bigger than the buffer are
+			// copied into the buffer passed to next()).
+			size_t buffer_size() const;
+
+			// Reject the blocks without checksum (except the file
+			// header and the sync blocks).
+			void require_checksums(bool required);
+
+			// Get next block (the checksums are verified and the
+			// compressed blocks are decompressed into an internal
+			// buffer).
 			enum error {
 				kNoMemory,
 				kBlockTooBig,
 				kReadError,
 				kEndOfFile,
-				kTimeout
+				kTimeout,
+				kCorruptBlock
 			};
 
 			bool next(block& block, string::buffer& buf, int timeout);
 			bool next(block& block, string::buffer& buf, int timeout, error& err);
 
+			// Get up to 'max' blocks: the next block plus the complete
+			// blocks which are already in the buffer (no more reads).
+			// Returns the number of blocks (0 on error).
+			size_t next_batch(block* blocks, size_t max, string::buffer& buf, int timeout);
+			size_t next_batch(block* blocks, size_t max, string::buffer& buf, int timeout, error& err);
+
 		protected:
-			unsigned char _M_buf[kBufferSize];
+			// Allocated in the first call to next().
+			unsigned char* _M_buf;
+			size_t _M_size;
+
 			size_t _M_end;
 			size_t _M_block;
 
+			// Buffer for decompressing blocks.
+			unsigned char* _M_scratch;
+
+			bool _M_checksums_required;
+
 			virtual ssize_t read(void* buf, size_t count, int timeout, error& err) = 0;
+
+			// Get next block (without decompressing it).
+			bool next_raw(block& block, string::buffer& buf, int timeout, error& err);
+
+			// Decompress block.
+			bool decompress(block& block, error& err);
 	};
 
-	inline block_reader::block_reader()
-		: _M_end(0),
-		  _M_block(0)
+	inline block_reader::block_reader(size_t buffer_size)
+		: _M_buf(NULL),
+		  _M_size(MAX(buffer_size, block::kMinSize)),
+		  _M_end(0),
+		  _M_block(0),
+		  _M_scratch(NULL),
+		  _M_checksums_required(false)
 	{
 	}
 
+	inline block_reader::~block_reader()
+	{
+		free(_M_buf);
+		free(_M_scratch);
+	}
+
+	inline size_t block_reader::buffer_size() const
+	{
+		return _M_size;
+	}
+
+	inline void block_reader::require_checksums(bool required)
+	{
+		_M_checksums_required = required;
+	}
+
 	inline bool block_reader::next(block& block, string::buffer& buf, int timeout)
 	{
 		error err;
 		return next(block, buf, timeout, err);
 	}
+
+	inline bool block_reader::next(block& block, string::buffer& buf, int timeout, error& err)
+	{
+		if (!next_raw(block, buf, timeout, err)) {
+			return false;
+		}
+
+		if (!block.verify()) {
+			err = kCorruptBlock;
+			return false;
+		}
+
+		return ((!block.compressed()) || (decompress(block, err)));
+	}
+
+	inline size_t block_reader::next_batch(block* blocks, size_t max, string::buffer& buf, int timeout)
+	{
+		error err;
+		return next_batch(blocks, max, buf, timeout, err);
+	}
 }
 
 #endif // UTIL_BLOCK_READER_H
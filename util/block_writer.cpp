@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <time.h>
+#include "util/block_writer.h"
+#include "util/block_index.h"
+#include "util/crc32c.h"
+#include "macros/macros.h"
+
+util::block_writer::block_writer(size_t buffer_size, unsigned index_interval)
+	: _M_buf(NULL),
+	  _M_size(MAX(buffer_size, block::kMinSize)),
+	  _M_used(0),
+	  _M_index_interval(index_interval),
+	  _M_commit_bytes(0),
+	  _M_commit_ms(0),
+	  _M_unsynced(0),
+	  _M_last_commit(0),
+	  _M_sync_interval(0),
+	  _M_last_sync(0),
+	  _M_offset(0),
+	  _M_count(0),
+	  _M_compress_min(0),
+	  _M_compressed(NULL),
+	  _M_checksums(false)
+{
+}
+
+bool util::block_writer::open(const char* filename)
+{
+	if ((_M_buf = reinterpret_cast<unsigned char*>(malloc(_M_size))) == NULL) {
+		return false;
+	}
+
+	if (!_M_file.open(filename)) {
+		free(_M_buf);
+		_M_buf = NULL;
+
+		return false;
+	}
+
+	// If the file is not empty...
+	if (_M_file.offset() != 0) {
+		_M_file.close();
+
+		free(_M_buf);
+		_M_buf = NULL;
+
+		errno = EEXIST;
+		return false;
+	}
+
+	if (_M_index_interval > 0) {
+		string::buffer name;
+		if (!block_index::index_filename(filename, name)) {
+			_M_file.close();
+
+			free(_M_buf);
+			_M_buf = NULL;
+
+			return false;
+		}
+
+		// Remove old index (if any).
+		unlink(name.data());
+
+		uint64_t interval = htobe64(_M_index_interval);
+
+		if ((!_M_index.open(name.data())) || (!_M_index_buf.append(reinterpret_cast<const char*>(&interval), sizeof(uint64_t)))) {
+			_M_file.close();
+
+			free(_M_buf);
+			_M_buf = NULL;
+
+			return false;
+		}
+	}
+
+	_M_used = 0;
+	_M_unsynced = 0;
+	_M_last_commit = now();
+	_M_last_sync = 0;
+	_M_offset = 0;
+	_M_count = 0;
+
+	// If sync blocks have to be written...
+	if (_M_sync_interval > 0) {
+		// Write file header (with a new sync marker).
+		unsigned char header[block::kFileHeaderSize];
+		block::make_file_header(header);
+		block::make_sync_block(block(header), _M_sync_block);
+
+		if (!append(header, sizeof(header))) {
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool util::block_writer::close()
+{
+	bool ret = write_buffers();
+
+	if (!_M_file.close()) {
+		ret = false;
+	}
+
+	if ((_M_index_interval > 0) && (!_M_index.close())) {
+		ret = false;
+	}
+
+	free(_M_buf);
+	_M_buf = NULL;
+
+	free(_M_compressed);
+	_M_compressed = NULL;
+
+	_M_index_buf.free();
+
+	return ret;
+}
+
+bool util::block_writer::write(const void* data, size_t len)
+{
+	size_t size = block::kMinSize + len;
+	if (size + ((_M_checksums) ? block::kChecksumSize : 0) > block::kMaxSize) {
+		errno = EINVAL;
+		return false;
+	}
+
+	// Sync block.
+	if ((_M_sync_interval > 0) && (_M_offset - _M_last_sync >= _M_sync_interval)) {
+		_M_last_sync = _M_offset;
+
+		if (!append(_M_sync_block, block::kSyncSize)) {
+			return false;
+		}
+	}
+
+	uint64_t offset = _M_offset;
+
+	blocklen_t flags = 0;
+	size_t trailer = 0;
+
+	if (_M_checksums) {
+		flags |= block::kChecksum;
+		trailer = block::kChecksumSize;
+	}
+
+	// If the block has to be compressed...
+	size_t compressed_size = 0;
+	if ((_M_compress_min > 0) && (len >= _M_compress_min)) {
+		if ((!_M_compressed) && ((_M_compressed = reinterpret_cast<unsigned char*>(malloc(block::kCompressedHeaderSize + lz::bound(block::kMaxSize) + block::kChecksumSize))) == NULL)) {
+			return false;
+		}
+
+		compressed_size = block::kCompressedHeaderSize + lz::compress(data, len, _M_compressed + block::kCompressedHeaderSize);
+	}
+
+	// If the compressed block is smaller...
+	if ((compressed_size > 0) && (compressed_size < size)) {
+		block::encode_header(_M_compressed, compressed_size + trailer, flags | block::kCompressed);
+
+		uint32_t l = htobe32(len);
+		memcpy(_M_compressed + block::kMinSize, &l, sizeof(uint32_t));
+
+		if (_M_checksums) {
+			uint32_t crc = htobe32(crc32c::compute(_M_compressed, compressed_size));
+			memcpy(_M_compressed + compressed_size, &crc, sizeof(uint32_t));
+		}
+
+		if (!append(_M_compressed, compressed_size + trailer)) {
+			return false;
+		}
+	} else {
+		unsigned char header[block::kMinSize];
+		block::encode_header(header, size + trailer, flags);
+
+		if ((!append(header, sizeof(header))) || (!append(data, len))) {
+			return false;
+		}
+
+		if (_M_checksums) {
+			uint32_t crc = htobe32(crc32c::compute(data, len, crc32c::compute(header, sizeof(header))));
+
+			if (!append(&crc, sizeof(uint32_t))) {
+				return false;
+			}
+		}
+	}
+
+	// Index entry.
+	if ((_M_index_interval > 0) && ((_M_count % _M_index_interval) == 0)) {
+		offset = htobe64(offset);
+
+		if (!_M_index_buf.append(reinterpret_cast<const char*>(&offset), sizeof(uint64_t))) {
+			return false;
+		}
+	}
+
+	_M_count++;
+
+	// If the file has to be synced...
+	if ((_M_commit_ms > 0) && (now() - _M_last_commit >= _M_commit_ms)) {
+		return sync();
+	}
+
+	return true;
+}
+
+bool util::block_writer::flush()
+{
+	if (!write_buffers()) {
+		return false;
+	}
+
+	// If the file has to be synced...
+	if ((_M_commit_bytes > 0) && (_M_unsynced >= _M_commit_bytes)) {
+		return commit();
+	}
+
+	return true;
+}
+
+bool util::block_writer::sync()
+{
+	return ((write_buffers()) && (commit()));
+}
+
+bool util::block_writer::append(const void* data, size_t len)
+{
+	// If the data doesn't fit in the buffer...
+	if (len > _M_size - _M_used) {
+		if (!flush()) {
+			return false;
+		}
+
+		// If the data is bigger than the buffer...
+		if (len > _M_size) {
+			if (!_M_file.write(data, len)) {
+				return false;
+			}
+
+			_M_unsynced += len;
+			_M_offset += len;
+
+			return true;
+		}
+	}
+
+	memcpy(_M_buf + _M_used, data, len);
+	_M_used += len;
+
+	_M_offset += len;
+
+	return true;
+}
+
+bool util::block_writer::write_buffers()
+{
+	if (_M_used > 0) {
+		if (!_M_file.write(_M_buf, _M_used)) {
+			return false;
+		}
+
+		_M_unsynced += _M_used;
+		_M_used = 0;
+	}
+
+	// The index is written after the blocks it points to.
+	if (_M_index_buf.count() > 0) {
+		if (!_M_index.write(_M_index_buf.data(), _M_index_buf.count())) {
+			return false;
+		}
+
+		_M_index_buf.reset();
+	}
+
+	return true;
+}
+
+bool util::block_writer::commit()
+{
+	if ((!_M_file.sync()) || ((_M_index_interval > 0) && (!_M_index.sync()))) {
+		return false;
+	}
+
+	_M_unsynced = 0;
+	_M_last_commit = now();
+
+	return true;
+}
+
+uint64_t util::block_writer::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return (static_cast<uint64_t>(ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
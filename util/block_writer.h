@@ -0,0 +1,153 @@
+#ifndef UTIL_BLOCK_WRITER_H
+#define UTIL_BLOCK_WRITER_H
+
+// Block file writer.
+//
+// Blocks are accumulated in a buffer and written in large writes. The file
+// can be synced periodically (group commit): after 'bytes' bytes have been
+// written or 'ms' milliseconds have elapsed since the last sync. Every
+// 'index_interval' blocks, the offset of the block is added to the sparse
+// index (see util::block_index).
+
+#include <stdint.h>
+#include "util/block.h"
+#include "io/sequential_write_only_file.h"
+#include "string/buffer.h"
+
+namespace util {
+	class block_writer {
+		public:
+			static const size_t kDefaultBufferSize = 1024 * 1024;
+			static const unsigned kDefaultIndexInterval = 1024;
+
+			// Constructor.
+			// If 'index_interval' is 0, no index is written.
+			block_writer(size_t buffer_size = kDefaultBufferSize, unsigned index_interval = kDefaultIndexInterval);
+
+			// Destructor.
+			~block_writer();
+
+			// Set group commit ('bytes' / 'ms' = 0: disabled).
+			void group_commit(size_t bytes, unsigned ms);
+
+			// Write a sync block every 'interval' bytes (0: no sync
+			// blocks). If enabled (before open()), the file starts
+			// with a file header which holds the sync marker of the
+			// file (see util::block).
+			void sync_blocks(size_t interval);
+
+			// Compress the blocks with at least 'min_len' bytes of data
+			// (0: no compression). A block is stored uncompressed if
+			// it doesn't get smaller.
+			void compression(size_t min_len);
+
+			// Add a CRC-32C to every block.
+			void checksums(bool enabled);
+
+			// Open (the file must be new or empty).
+			bool open(const char* filename);
+
+			// Close (flushes the buffer, but doesn't sync).
+			bool close();
+
+			// Write block.
+			bool write(const void* data, size_t len);
+
+			// Write buffered blocks.
+			bool flush();
+
+			// Write buffered blocks and sync.
+			bool sync();
+
+			// Get number of blocks written.
+			uint64_t count() const;
+
+		private:
+			io::sequential_write_only_file _M_file;
+			io::sequential_write_only_file _M_index;
+
+			unsigned char* _M_buf;
+			size_t _M_size;
+			size_t _M_used;
+
+			unsigned _M_index_interval;
+			string::buffer _M_index_buf;
+
+			// Group commit.
+			size_t _M_commit_bytes;
+			unsigned _M_commit_ms;
+
+			// Bytes written since the last sync.
+			uint64_t _M_unsynced;
+
+			// Time of the last sync (milliseconds).
+			uint64_t _M_last_commit;
+
+			size_t _M_sync_interval;
+
+			// Sync block of the file.
+			unsigned char _M_sync_block[block::kSyncSize];
+
+			// Offset of the last sync block.
+			uint64_t _M_last_sync;
+
+			// Offset of the next block.
+			uint64_t _M_offset;
+
+			uint64_t _M_count;
+
+			size_t _M_compress_min;
+
+			// Buffer for compressing blocks.
+			unsigned char* _M_compressed;
+
+			bool _M_checksums;
+
+			// Append data.
+			bool append(const void* data, size_t len);
+
+			// Write buffers to the files.
+			bool write_buffers();
+
+			// Sync files.
+			bool commit();
+
+			// Get current time (milliseconds).
+			static uint64_t now();
+	};
+
+	inline block_writer::~block_writer()
+	{
+		if (_M_buf) {
+			close();
+		}
+	}
+
+	inline void block_writer::group_commit(size_t bytes, unsigned ms)
+	{
+		_M_commit_bytes = bytes;
+		_M_commit_ms = ms;
+	}
+
+	inline void block_writer::sync_blocks(size_t interval)
+	{
+		_M_sync_interval = interval;
+	}
+
+	inline void block_writer::compression(size_t min_len)
+	{
+		_M_compress_min = min_len;
+	}
+
+	inline void block_writer::checksums(bool enabled)
+	{
+		_M_checksums = enabled;
+	}
+
+	inline uint64_t block_writer::count() const
+	{
+		return _M_count;
+	}
+}
+
+#endif // UTIL_BLOCK_WRITER_H
@@ -1,13 +1,13 @@
 #include <assert.h>
 #include "util/concurrent/arena.h"
-#include "macros/macros.h"
+#include "util/concurrent/atomic/atomic.h"
 
 util::concurrent::arena::~arena()
 {
-	while (_M_head) {
-		block* next = _M_head->next;
-		free(_M_head);
-		_M_head = next;
+	while (_M_blocks) {
+		block* next = _M_blocks->next;
+		free(_M_blocks);
+		_M_blocks = next;
 	}
 }
 
@@ -21,32 +21,64 @@ void* util::concurrent::arena::allocate(size_t size)
 		size += sizeof(void*) - mod;
 	}
 
-	locks::scoped_lock lock(_M_lock);
+	record* rec;
+	if ((rec = get_record()) == NULL) {
+		return NULL;
+	}
+
+	if ((!rec->head) || (rec->used + size > kDataSize)) {
+		block* b;
+
+		// Big allocation?
+		if (size > kDataSize) {
+			// Allocate a dedicated block and keep using the current one.
+			if ((b = create_block(size)) == NULL) {
+				return NULL;
+			}
+
+			// 'count' might be read by other threads.
+			atomic::release_store(&rec->count, rec->count + size);
 
-	if (_M_used + size > kDataSize) {
-		if (!create_block(MAX(kDataSize, size))) {
+			return b->data;
+		}
+
+		if ((b = create_block(kDataSize)) == NULL) {
 			return NULL;
 		}
+
+		rec->head = b;
+		rec->used = 0;
 	}
 
-	char* p = _M_head->data + _M_used;
-	_M_used += size;
-	_M_count += size;
+	char* p = rec->head->data + rec->used;
+	rec->used += size;
+	atomic::release_store(&rec->count, rec->count + size);
 
 	return p;
 }
 
-bool util::concurrent::arena::create_block(size_t data_size)
+size_t util::concurrent::arena::count() const
+{
+	size_t count = 0;
+
+	for (const thread_records::record* rec = _M_records.first(); rec; rec = rec->next) {
+		count += atomic::acquire_load(&static_cast<const record*>(rec)->count);
+	}
+
+	return count;
+}
+
+struct util::concurrent::arena::block* util::concurrent::arena::create_block(size_t data_size)
 {
 	block* b;
 	if ((b = reinterpret_cast<block*>(malloc(sizeof(block*) + data_size))) == NULL) {
-		return false;
+		return NULL;
 	}
 
-	b->next = _M_head;
-	_M_head = b;
-
-	_M_used = 0;
+	// Add block to the list of blocks.
+	do {
+		b->next = atomic::acquire_load(&_M_blocks);
+	} while (!atomic::bool_compare_and_swap(&_M_blocks, b->next, b));
 
-	return true;
+	return b;
 }
@@ -2,9 +2,14 @@
 #define UTIL_CONCURRENT_ARENA_H
 
 // Simple thread-safe allocator.
+//
+// Every thread allocates from its own block (kept in its record, see
+// util::concurrent::thread_records) without synchronization; the shared list
+// of blocks is only modified (lock-free) when a thread needs a new block.
+// The memory is freed when the arena is destroyed.
 
 #include <stdlib.h>
-#include "util/concurrent/locks/mutex.h"
+#include "util/concurrent/thread_records.h"
 
 namespace util {
 	namespace concurrent {
@@ -16,6 +21,9 @@ namespace util {
 				// Destructor.
 				~arena();
 
+				// Initialize.
+				bool init();
+
 				// Allocate.
 				void* allocate(size_t size);
 
@@ -31,26 +39,40 @@ namespace util {
 					char data[1];
 				};
 
-				block* _M_head;
-				size_t _M_used;
-				size_t _M_count;
+				// Per-thread state.
+				struct record : public thread_records::record {
+					// Current block (NULL: none yet).
+					block* head;
+					size_t used;
+
+					// Number of bytes allocated by this record.
+					size_t count;
+				};
+
+				block* _M_blocks;
 
-				locks::mutex _M_lock;
+				thread_records _M_records;
+
+				// Get record of the current thread.
+				record* get_record();
 
 				// Create block.
-				bool create_block(size_t data_size);
+				block* create_block(size_t data_size);
 		};
 
 		inline arena::arena()
-		: _M_head(NULL),
-		_M_used(kDataSize),
-		_M_count(0)
+			: _M_blocks(NULL)
+		{
+		}
+
+		inline bool arena::init()
 		{
+			return thread_records::init();
 		}
 
-		inline size_t arena::count() const
+		inline arena::record* arena::get_record()
 		{
-			return _M_count;
+			return static_cast<record*>(_M_records.get(sizeof(record)));
 		}
 	}
 }
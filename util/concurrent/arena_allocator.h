@@ -0,0 +1,52 @@
+#ifndef UTIL_CONCURRENT_ARENA_ALLOCATOR_H
+#define UTIL_CONCURRENT_ARENA_ALLOCATOR_H
+
+// Allocator policy (see "util/allocator.h") which allocates from a
+// thread-safe arena. Memory is only freed when the allocator is destroyed.
+
+#include "util/concurrent/arena.h"
+
+namespace util {
+	namespace concurrent {
+		class arena_allocator {
+			public:
+				static const bool kFreesAll = true;
+
+				// Initialize.
+				bool init();
+
+				// Allocate.
+				void* allocate(size_t size);
+
+				// Deallocate.
+				void deallocate(void* p);
+
+				// Get count.
+				size_t count() const;
+
+			private:
+				arena _M_arena;
+		};
+
+		inline bool arena_allocator::init()
+		{
+			return _M_arena.init();
+		}
+
+		inline void* arena_allocator::allocate(size_t size)
+		{
+			return _M_arena.allocate(size);
+		}
+
+		inline void arena_allocator::deallocate(void* p)
+		{
+		}
+
+		inline size_t arena_allocator::count() const
+		{
+			return _M_arena.count();
+		}
+	}
+}
+
+#endif // UTIL_CONCURRENT_ARENA_ALLOCATOR_H
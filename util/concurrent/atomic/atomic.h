@@ -33,6 +33,12 @@ namespace util {
 				return __sync_fetch_and_sub(ptr, val);
 			}
 
+			template<typename _T>
+			static inline _T bit_or(_T* ptr, _T val)
+			{
+				return __sync_fetch_and_or(ptr, val);
+			}
+
 			template<typename _T>
 			static inline _T acquire_load(const _T* ptr)
 			{
@@ -0,0 +1,148 @@
+#include <assert.h>
+#include "util/concurrent/epoch.h"
+#include "util/concurrent/atomic/atomic.h"
+
+util::concurrent::epoch::~epoch()
+{
+	// The records themselves are freed by the registry.
+	for (record* rec = first(); rec; rec = next(rec)) {
+		for (unsigned i = 0; i < kNumberEpochs; i++) {
+			free_list(rec, i);
+		}
+	}
+}
+
+bool util::concurrent::epoch::enter()
+{
+	record* rec;
+	if ((rec = get_record()) == NULL) {
+		return false;
+	}
+
+	// Nested critical section?
+	if (rec->nesting++ > 0) {
+		return true;
+	}
+
+	unsigned long global = atomic::acquire_load(&_M_global);
+	unsigned long prev = rec->local >> 1;
+
+	rec->local = (global << 1) | 1;
+
+	// Make the local epoch visible before accessing shared nodes.
+	__sync_synchronize();
+
+	// If the epoch has changed, some objects might be freed.
+	if (global != prev) {
+		reclaim(rec, global);
+	}
+
+	return true;
+}
+
+void util::concurrent::epoch::exit()
+{
+	record* rec = get_record(false);
+	assert(rec != NULL);
+	assert(rec->nesting > 0);
+
+	if (--rec->nesting == 0) {
+		atomic::release_store(&rec->local, rec->local & ~1ul);
+	}
+}
+
+void util::concurrent::epoch::retire(retired* r, void (*reclaim)(retired* r))
+{
+	record* rec = get_record(false);
+	assert(rec != NULL);
+	assert(rec->nesting > 0);
+
+	// Tag the object with the global epoch read after the unlink (the
+	// local epoch of the thread might be behind).
+	__sync_synchronize();
+	unsigned long global = atomic::acquire_load(&_M_global);
+
+	unsigned idx = global % kNumberEpochs;
+
+	// If the list contains objects of an older epoch (at least
+	// kNumberEpochs epochs ago), they can be freed.
+	if ((rec->limbo[idx]) && (rec->limbo_epoch[idx] != global)) {
+		free_list(rec, idx);
+	}
+
+	rec->limbo_epoch[idx] = global;
+
+	r->reclaim = reclaim;
+	r->next = rec->limbo[idx];
+	rec->limbo[idx] = r;
+
+	rec->count++;
+
+	if (++rec->nretired == kCollectThreshold) {
+		collect();
+	}
+}
+
+void util::concurrent::epoch::collect()
+{
+	record* rec;
+	if ((rec = get_record()) == NULL) {
+		return;
+	}
+
+	rec->nretired = 0;
+
+	try_advance();
+
+	reclaim(rec, atomic::acquire_load(&_M_global));
+}
+
+size_t util::concurrent::epoch::pending() const
+{
+	size_t count = 0;
+
+	for (const record* rec = first(); rec; rec = next(rec)) {
+		count += rec->count;
+	}
+
+	return count;
+}
+
+void util::concurrent::epoch::reclaim(record* rec, unsigned long global)
+{
+	for (unsigned i = 0; i < kNumberEpochs; i++) {
+		if ((rec->limbo[i]) && (global >= rec->limbo_epoch[i] + 2)) {
+			free_list(rec, i);
+		}
+	}
+}
+
+bool util::concurrent::epoch::try_advance()
+{
+	unsigned long global = atomic::acquire_load(&_M_global);
+
+	// The epoch can only be advanced if all the threads inside a critical
+	// section have seen the current epoch.
+	for (const record* rec = first(); rec; rec = next(rec)) {
+		unsigned long local = atomic::acquire_load(&rec->local);
+		if (((local & 1) != 0) && ((local >> 1) != global)) {
+			return false;
+		}
+	}
+
+	return atomic::bool_compare_and_swap(&_M_global, global, global + 1);
+}
+
+void util::concurrent::epoch::free_list(record* rec, unsigned idx)
+{
+	retired* r = rec->limbo[idx];
+	rec->limbo[idx] = NULL;
+
+	while (r) {
+		retired* next = r->next;
+		r->reclaim(r);
+		rec->count--;
+
+		r = next;
+	}
+}
@@ -0,0 +1,159 @@
+#ifndef UTIL_CONCURRENT_EPOCH_H
+#define UTIL_CONCURRENT_EPOCH_H
+
+// Epoch-based memory reclamation, following the scheme described in:
+// "Practical lock-freedom"
+// http://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf
+//
+// Threads access shared nodes inside critical sections (enter() / exit()).
+// Unlinked nodes are retired into a per-thread limbo list tagged with the
+// global epoch read after the unlink (a thread which can still reach the
+// node entered at that epoch at the latest); they are freed once the global
+// epoch has advanced twice, as by then no thread can still hold a reference
+// to them.
+//
+// Every thread gets its own record (local epoch and limbo lists) the first
+// time it enters the epoch, see util::concurrent::thread_records.
+
+#include <stdlib.h>
+#include "util/concurrent/thread_records.h"
+
+namespace util {
+	namespace concurrent {
+		class epoch {
+			public:
+				// Intrusive hook for retired objects.
+				struct retired {
+					retired* next;
+
+					// Function to be called when the object can be freed.
+					void (*reclaim)(retired* r);
+				};
+
+				// Constructor.
+				epoch();
+
+				// Destructor.
+				~epoch();
+
+				// Initialize.
+				bool init();
+
+				// Enter critical section (can be nested).
+				bool enter();
+
+				// Exit critical section.
+				void exit();
+
+				// Retire object (must be called inside a critical section).
+				void retire(retired* r, void (*reclaim)(retired* r));
+
+				// Try to advance the global epoch and free the objects
+				// retired by the current thread which are no longer in use.
+				void collect();
+
+				// Get number of objects pending to be freed.
+				size_t pending() const;
+
+			private:
+				static const unsigned kNumberEpochs = 3;
+
+				// Try to advance the global epoch after
+				// 'kCollectThreshold' retirements.
+				static const unsigned kCollectThreshold = 64;
+
+				struct record : public thread_records::record {
+					// Local epoch (epoch << 1) | active.
+					unsigned long local;
+
+					// Nesting level of the critical sections.
+					unsigned nesting;
+
+					// Number of retirements since last collection.
+					unsigned nretired;
+
+					// Number of objects pending to be freed.
+					size_t count;
+
+					// Objects retired in each epoch (and epoch
+					// of each list).
+					retired* limbo[kNumberEpochs];
+					unsigned long limbo_epoch[kNumberEpochs];
+				};
+
+				unsigned long _M_global;
+
+				thread_records _M_records;
+
+				// Get record of the current thread (creates it if
+				// 'create' is true).
+				record* get_record(bool create = true);
+
+				// Get first record / next record.
+				record* first() const;
+				static record* next(const record* rec);
+
+				// Free the lists of objects which are no longer in
+				// use.
+				void reclaim(record* rec, unsigned long global);
+
+				// Try to advance the global epoch.
+				bool try_advance();
+
+				// Free list of retired objects.
+				void free_list(record* rec, unsigned idx);
+		};
+
+		inline epoch::epoch()
+			: _M_global(0)
+		{
+		}
+
+		inline bool epoch::init()
+		{
+			return thread_records::init();
+		}
+
+		inline epoch::record* epoch::get_record(bool create)
+		{
+			return static_cast<record*>(_M_records.get(create ? sizeof(record) : 0));
+		}
+
+		inline epoch::record* epoch::first() const
+		{
+			return static_cast<record*>(_M_records.first());
+		}
+
+		inline epoch::record* epoch::next(const record* rec)
+		{
+			return static_cast<record*>(rec->next);
+		}
+
+		class scoped_epoch {
+			public:
+				// Constructor.
+				scoped_epoch(epoch& e);
+
+				// Destructor.
+				~scoped_epoch();
+
+			private:
+				epoch& _M_epoch;
+		};
+
+		inline scoped_epoch::scoped_epoch(epoch& e)
+		: _M_epoch(e)
+		{
+			if (!_M_epoch.enter()) {
+				abort();
+			}
+		}
+
+		inline scoped_epoch::~scoped_epoch()
+		{
+			_M_epoch.exit();
+		}
+	}
+}
+
+#endif // UTIL_CONCURRENT_EPOCH_H
@@ -6,19 +6,23 @@
 // http://www.amazon.com/books/dp/0123973376
 // and in the algorithm described in: "Practical lock-freedom"
 // http://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf
+//
+// Nodes are allocated with '_Allocator' (see "util/allocator.h"). As nodes
+// are never erased, an arena can be used
+// (util::concurrent::arena_allocator).
 
 #include <stdlib.h>
 #include <new>
 #include "util/minus.h"
+#include "util/random.h"
+#include "util/allocator.h"
 #include "util/concurrent/atomic/pointer.h"
 #include "util/concurrent/atomic/atomic.h"
-
-// Thread Local Storage.
-static __thread struct drand48_data random_data = {{0xc0}};
+#include "util/concurrent/skiplist_bulk_load.h"
 
 namespace util {
 	namespace concurrent {
-		template<typename _Key, typename _Compare = util::minus<_Key> >
+		template<typename _Key, typename _Compare = util::minus<_Key>, typename _Allocator = util::malloc_allocator>
 		class insert_only_skiplist {
 			public:
 				// Constructor.
@@ -34,6 +38,14 @@ namespace util {
 				// Insert.
 				bool insert(const _Key& k);
 
+				// Bulk load from sorted keys (the list must be empty and
+				// not accessed by other threads while loading).
+				// Duplicated keys are skipped. Returns false if the list
+				// is not empty, the keys are not sorted or there is no
+				// memory (the list is left empty).
+				template<typename _Iterator>
+				bool bulk_load(_Iterator first, _Iterator last);
+
 				// Contains.
 				bool contains(const _Key& k) const;
 
@@ -92,6 +104,8 @@ namespace util {
 
 				_Compare _M_compare;
 
+				_Allocator _M_allocator;
+
 				// Find.
 				bool find(const _Key& k, node** preds, node** succs);
 				bool find(const _Key& k, const node** preds, const node** succs) const;
@@ -111,25 +125,31 @@ namespace util {
 				int random_level();
 		};
 
-		template<typename _Key, typename _Compare>
-		inline insert_only_skiplist<_Key, _Compare>::insert_only_skiplist()
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline insert_only_skiplist<_Key, _Compare, _Allocator>::insert_only_skiplist()
 		: _M_header(NULL),
 		_M_level_hint(1),
 		_M_compare()
 		{
 		}
 
-		template<typename _Key, typename _Compare>
-		inline insert_only_skiplist<_Key, _Compare>::insert_only_skiplist(const _Compare& cmp)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline insert_only_skiplist<_Key, _Compare, _Allocator>::insert_only_skiplist(const _Compare& cmp)
 		: _M_header(NULL),
 		_M_level_hint(1),
 		_M_compare(cmp)
 		{
 		}
 
-		template<typename _Key, typename _Compare>
-		insert_only_skiplist<_Key, _Compare>::~insert_only_skiplist()
+		template<typename _Key, typename _Compare, typename _Allocator>
+		insert_only_skiplist<_Key, _Compare, _Allocator>::~insert_only_skiplist()
 		{
+			// If the allocator frees all the memory and the keys don't have
+			// to be destroyed...
+			if ((_Allocator::kFreesAll) && (__has_trivial_destructor(_Key))) {
+				return;
+			}
+
 			node* n = _M_header;
 			while (n) {
 				node* next = n->next[0].get();
@@ -138,9 +158,14 @@ namespace util {
 			}
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::init()
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::init()
 		{
+			// Initialize allocator.
+			if (!_M_allocator.init()) {
+				return false;
+			}
+
 			// Create header.
 			if ((_M_header = make_node(kMaxLevel)) == NULL) {
 				return false;
@@ -154,8 +179,8 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::insert(const _Key& k)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::insert(const _Key& k)
 		{
 			int level = random_level();
 
@@ -208,14 +233,25 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline bool insert_only_skiplist<_Key, _Compare>::contains(const _Key& k) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		template<typename _Iterator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::bulk_load(_Iterator first, _Iterator last)
+		{
+			return skiplist_bulk_load<node, kMaxLevel>(_M_header, first, last, _M_compare, [this](const _Key& k) {
+				return make_node(k, random_level());
+			}, [this](node* n) {
+				delete_node(n);
+			});
+		}
+
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline bool insert_only_skiplist<_Key, _Compare, _Allocator>::contains(const _Key& k) const
 		{
 			return (find(k) != NULL);
 		}
 
-		template<typename _Key, typename _Compare>
-		inline bool insert_only_skiplist<_Key, _Compare>::find(const _Key& k, _Key& fullkey) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline bool insert_only_skiplist<_Key, _Compare, _Allocator>::find(const _Key& k, _Key& fullkey) const
 		{
 			const node* x;
 			if ((x = find(k)) == NULL) {
@@ -227,14 +263,14 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline const _Key& insert_only_skiplist<_Key, _Compare>::iterator::key() const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline const _Key& insert_only_skiplist<_Key, _Compare, _Allocator>::iterator::key() const
 		{
 			return k;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline bool insert_only_skiplist<_Key, _Compare>::begin(iterator& it) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline bool insert_only_skiplist<_Key, _Compare, _Allocator>::begin(iterator& it) const
 		{
 			const node* curr;
 			if ((curr = _M_header->next[0].get()) == NULL) {
@@ -246,8 +282,8 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::end(iterator& it) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::end(iterator& it) const
 		{
 			const node* pred = _M_header;
 			for (int level = _M_level_hint - 1; level >= 0; level--) {
@@ -269,8 +305,8 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline bool insert_only_skiplist<_Key, _Compare>::previous(iterator& it) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline bool insert_only_skiplist<_Key, _Compare, _Allocator>::previous(iterator& it) const
 		{
 			const node* preds[kMaxLevel];
 			const node* succs[kMaxLevel];
@@ -286,8 +322,8 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::next(iterator& it) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::next(iterator& it) const
 		{
 			const node* preds[kMaxLevel];
 			const node* succs[kMaxLevel];
@@ -308,8 +344,8 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::seek(const _Key& k, iterator& it) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::seek(const _Key& k, iterator& it) const
 		{
 			const node* preds[kMaxLevel];
 			const node* succs[kMaxLevel];
@@ -326,22 +362,22 @@ namespace util {
 			return true;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline insert_only_skiplist<_Key, _Compare>::node::node(int height)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline insert_only_skiplist<_Key, _Compare, _Allocator>::node::node(int height)
 		: key(),
 		level(height)
 		{
 		}
 
-		template<typename _Key, typename _Compare>
-		inline insert_only_skiplist<_Key, _Compare>::node::node(const _Key& k, int height)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline insert_only_skiplist<_Key, _Compare, _Allocator>::node::node(const _Key& k, int height)
 		: key(k),
 		level(height)
 		{
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::find(const _Key& k, node** preds, node** succs)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::find(const _Key& k, node** preds, node** succs)
 		{
 			int ret = -1;
 
@@ -364,8 +400,8 @@ namespace util {
 			return (ret == 0);
 		}
 
-		template<typename _Key, typename _Compare>
-		bool insert_only_skiplist<_Key, _Compare>::find(const _Key& k, const node** preds, const node** succs) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		bool insert_only_skiplist<_Key, _Compare, _Allocator>::find(const _Key& k, const node** preds, const node** succs) const
 		{
 			int ret = -1;
 
@@ -388,8 +424,8 @@ namespace util {
 			return (ret == 0);
 		}
 
-		template<typename _Key, typename _Compare>
-		const struct insert_only_skiplist<_Key, _Compare>::node* insert_only_skiplist<_Key, _Compare>::find(const _Key& k) const
+		template<typename _Key, typename _Compare, typename _Allocator>
+		const struct insert_only_skiplist<_Key, _Compare, _Allocator>::node* insert_only_skiplist<_Key, _Compare, _Allocator>::find(const _Key& k) const
 		{
 			const node* pred = _M_header;
 			for (int level = _M_level_hint - 1; level >= 0; level--) {
@@ -410,8 +446,8 @@ namespace util {
 			return NULL;
 		}
 
-		template<typename _Key, typename _Compare>
-		inline struct insert_only_skiplist<_Key, _Compare>::node* insert_only_skiplist<_Key, _Compare>::make_node(int height)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline struct insert_only_skiplist<_Key, _Compare, _Allocator>::node* insert_only_skiplist<_Key, _Compare, _Allocator>::make_node(int height)
 		{
 			node* n;
 			if ((n = allocate_node(height)) == NULL) {
@@ -421,8 +457,8 @@ namespace util {
 			return new (n) node(height);
 		}
 
-		template<typename _Key, typename _Compare>
-		inline struct insert_only_skiplist<_Key, _Compare>::node* insert_only_skiplist<_Key, _Compare>::make_node(const _Key& k, int height)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline struct insert_only_skiplist<_Key, _Compare, _Allocator>::node* insert_only_skiplist<_Key, _Compare, _Allocator>::make_node(const _Key& k, int height)
 		{
 			node* n;
 			if ((n = allocate_node(height)) == NULL) {
@@ -432,38 +468,26 @@ namespace util {
 			return new (n) node(k, height);
 		}
 
-		template<typename _Key, typename _Compare>
-		inline struct insert_only_skiplist<_Key, _Compare>::node* insert_only_skiplist<_Key, _Compare>::allocate_node(int height)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline struct insert_only_skiplist<_Key, _Compare, _Allocator>::node* insert_only_skiplist<_Key, _Compare, _Allocator>::allocate_node(int height)
 		{
-			return reinterpret_cast<node*>(malloc(sizeof(node) + ((height - 1) * sizeof(atomic::pointer<node>))));
+			return reinterpret_cast<node*>(_M_allocator.allocate(sizeof(node) + ((height - 1) * sizeof(atomic::pointer<node>))));
 		}
 
-		template<typename _Key, typename _Compare>
-		inline void insert_only_skiplist<_Key, _Compare>::delete_node(node* n)
+		template<typename _Key, typename _Compare, typename _Allocator>
+		inline void insert_only_skiplist<_Key, _Compare, _Allocator>::delete_node(node* n)
 		{
 			// Call the destructor.
 			n->~node();
 
 			// Free the memory.
-			free(n);
+			_M_allocator.deallocate(n);
 		}
 
-		template<typename _Key, typename _Compare>
-		int insert_only_skiplist<_Key, _Compare>::random_level()
+		template<typename _Key, typename _Compare, typename _Allocator>
+		int insert_only_skiplist<_Key, _Compare, _Allocator>::random_level()
 		{
-			static const unsigned FRACTION_P = 4;
-
-			int level = 1;
-			long rand;
-
-			do {
-				lrand48_r(&random_data, &rand);
-				if ((rand % FRACTION_P) == 0) {
-					level++;
-				} else {
-					break;
-				}
-			} while (level < kMaxLevel);
+			int level = util::random_level(kMaxLevel);
 
 			// Increment level hint if required.
 			int level_hint;
@@ -8,24 +8,31 @@
 // http://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf
 //
 // Notes:
-// As nodes cannot be freed directly, they are saved in a list until the
-// list reaches 'kThreshold' nodes. At this point the oldest node will be
-// deleted.
+// As nodes cannot be freed directly, erased nodes are retired to an epoch
+// (see "util/concurrent/epoch.h") and freed once no thread can reach them.
+// A node is retired when it has been erased and its inserter has finished
+// linking it (the inserter might link the upper levels of a node which is
+// being erased).
 
 #include <stdlib.h>
 #include <new>
 #include "util/minus.h"
+#include "util/random.h"
 #include "util/concurrent/atomic/markable_ptr.h"
 #include "util/concurrent/atomic/atomic.h"
-#include "util/concurrent/locks/spinlock.h" // For the list of deleted nodes.
-
-// Thread Local Storage.
-static __thread struct drand48_data random_data = {{0xc0}};
+#include "util/concurrent/skiplist_bulk_load.h"
+#include "util/concurrent/epoch.h"
 
 namespace util {
 	namespace concurrent {
+		template<typename _Key, typename _Value, typename _Compare>
+		class skiplist_map;
+
 		template<typename _Key, typename _Compare = util::minus<_Key> >
 		class skiplist {
+			template<typename, typename, typename>
+			friend class skiplist_map;
+
 			public:
 				// Constructor.
 				skiplist();
@@ -40,6 +47,14 @@ namespace util {
 				// Insert.
 				bool insert(const _Key& k);
 
+				// Bulk load from sorted keys (the list must be empty and
+				// not accessed by other threads while loading).
+				// Duplicated keys are skipped. Returns false if the list
+				// is not empty, the keys are not sorted or there is no
+				// memory (the list is left empty).
+				template<typename _Iterator>
+				bool bulk_load(_Iterator first, _Iterator last);
+
 				// Erase.
 				bool erase(const _Key& k);
 
@@ -71,6 +86,54 @@ namespace util {
 				// Seek.
 				bool seek(const _Key& k, iterator& it) const;
 
+			private:
+				struct node;
+
+			public:
+				// Cursor which walks level 0 directly. The current node is
+				// kept alive by staying inside the epoch, so cursors should be
+				// short-lived (they delay the reclamation of erased nodes).
+				class cursor {
+					public:
+						// Constructor.
+						cursor(const skiplist& list);
+
+						// Destructor.
+						~cursor();
+
+						// Move to the first key.
+						bool begin();
+
+						// Move to the first key >= 'k'.
+						bool seek(const _Key& k);
+
+						// Move to the next key.
+						bool next();
+
+						// Get key.
+						const _Key& key() const;
+
+						// Release the current node.
+						void close();
+
+					private:
+						const skiplist& _M_list;
+						const node* _M_node;
+						bool _M_pinned;
+
+						// Enter the epoch if required.
+						void pin();
+
+						// Disable copy constructor and assignment operator.
+						cursor(const cursor&);
+						cursor& operator=(const cursor&);
+				};
+
+				// Call 'fn(key)' for every key in [from, to] (stops if 'fn'
+				// returns false). Returns the number of keys visited.
+				template<typename _Function>
+				size_t scan(const _Key& from, const _Key& to, _Function fn) const;
+
 			private:
 				// [Probability] p = 0.25
 				// [Maximum number of elements] N = 4294967296
@@ -78,18 +141,22 @@ namespace util {
 				// kMaxLevel = L(N) = log4(4294967296) = 16
 				static const int kMaxLevel = 16;
 
+				// Node flags.
+				static const unsigned kInserted = 0x01;
+				static const unsigned kErased = 0x02;
+
 				struct node {
+					// Hook for the epoch (must be the first member).
+					epoch::retired hook;
+
 					// Key.
 					const _Key key;
 
 					// Level.
 					int level;
 
-					// Next deleted node.
-					node* next_deleted;
-
-					// Previous deleted node.
-					node* prev_deleted;
+					// Flags (kInserted | kErased).
+					unsigned flags;
 
 					concurrent::atomic::markable_ptr<node> next[1];
 
@@ -104,21 +171,15 @@ namespace util {
 
 				_Compare _M_compare;
 
-				struct nodelist {
-					static const int kThreshold = 32 * 1024;
-
-					node* head;
-					node* tail;
+				// Epoch for the erased nodes.
+				mutable epoch _M_epoch;
 
-					int count;
-
-					concurrent::locks::spinlock lock;
-
-					// Insert.
-					void insert(node* n);
-				};
-
-				nodelist _M_free_nodes;
+				// Insert the node made by 'make(level)' for the key 'k'
+				// (must be called inside the epoch). Returns NULL if there
+				// is no memory, or the node which has the key if it already
+				// exists ('found' is set to true).
+				template<typename _Make>
+				node* insert_node(const _Key& k, _Make make, bool& found);
 
 				// Find.
 				bool find(const _Key& k, node** preds, node** succs);
@@ -132,7 +193,14 @@ namespace util {
 				node* allocate_node(int height);
 
 				// Delete node.
-				void delete_node(node* n);
+				static void delete_node(node* n);
+
+				// Reclaim node (called by the epoch).
+				static void reclaim_node(epoch::retired* r);
+
+				// Release node (the node is retired when it has been
+				// inserted and erased).
+				void release_node(node* n, unsigned flag);
 
 				// Random level.
 				int random_level();
@@ -144,9 +212,6 @@ namespace util {
 		_M_level_hint(1),
 		_M_compare()
 		{
-			_M_free_nodes.head = NULL;
-			_M_free_nodes.tail = NULL;
-			_M_free_nodes.count = 0;
 		}
 
 		template<typename _Key, typename _Compare>
@@ -155,9 +220,6 @@ namespace util {
 		_M_level_hint(1),
 		_M_compare(cmp)
 		{
-			_M_free_nodes.head = NULL;
-			_M_free_nodes.tail = NULL;
-			_M_free_nodes.count = 0;
 		}
 
 		template<typename _Key, typename _Compare>
@@ -169,18 +231,16 @@ namespace util {
 				delete_node(n);
 				n = next;
 			}
-
-			n = _M_free_nodes.head;
-			while (n) {
-				node* next = n->next_deleted;
-				delete_node(n);
-				n = next;
-			}
 		}
 
 		template<typename _Key, typename _Compare>
 		bool skiplist<_Key, _Compare>::init()
 		{
+			// Initialize epoch.
+			if (!_M_epoch.init()) {
+				return false;
+			}
+
 			// Create header.
 			if ((_M_header = make_node(kMaxLevel)) == NULL) {
 				return false;
@@ -197,71 +257,28 @@ namespace util {
 		template<typename _Key, typename _Compare>
 		bool skiplist<_Key, _Compare>::insert(const _Key& k)
 		{
-			int level = random_level();
-
-			node* preds[kMaxLevel];
-			node* succs[kMaxLevel];
-
-			node* new_node = NULL;
+			concurrent::scoped_epoch guard(_M_epoch);
 
-			do {
-				if (find(k, preds, succs)) {
-					// Already inserted.
-					if (new_node) {
-						delete_node(new_node);
-					}
-
-					return false;
-				}
-
-				// Create node.
-				if ((!new_node) && ((new_node = make_node(k, level)) == NULL)) {
-					return false;
-				}
+			bool found;
+			return ((insert_node(k, [this, &k](int level) {
+				return make_node(k, level);
+			}, found)) && (!found));
+		}
 
-				// Set successor pointers.
-				for (int i = 0; i < level; i++) {
-					new_node->next[i] = succs[i];
-				}
+		template<typename _Key, typename _Compare>
+		template<typename _Iterator>
+		bool skiplist<_Key, _Compare>::bulk_load(_Iterator first, _Iterator last)
+		{
+			return skiplist_bulk_load<node, kMaxLevel>(_M_header, first, last, _M_compare, [this](const _Key& k) {
+				node* n = make_node(k, random_level());
 
-				// Node is considered inserted when it is linked at level 0.
-				if (preds[0]->next[0].compare_and_swap(succs[0], new_node, false, false)) {
-					break;
+				if (n) {
+					// The node is inserted.
+					n->flags = kInserted;
 				}
-			} while (true);
-
-			for (int i = 1; i < level; i++) {
-				do {
-					// If 'new_node' has been marked as deleted...
-					concurrent::atomic::markable_ptr<node> next = new_node->next[i];
-					if (next.marked()) {
-						find(k, preds, succs);
-						return true;
-					}
-
-					if (next.get() != succs[i]) {
-						bool oldmark;
-						if ((!new_node->next[i].compare_and_swap(next.get(), succs[i], false, false, oldmark)) && (oldmark)) {
-							// 'new_node' has been marked as deleted...
-							find(k, preds, succs);
-							return true;
-						}
-					}
-
-					if (preds[i]->next[i].compare_and_swap(succs[i], new_node, false, false)) {
-						break;
-					}
-
-					find(k, preds, succs);
-				} while (true);
-			}
-
-			// If 'new_node' has been marked as deleted...
-			if (new_node->next[level - 1].marked()) {
-				find(k, preds, succs);
-			}
 
-			return true;
+				return n;
+			}, delete_node);
 		}
 
 		template<typename _Key, typename _Compare>
@@ -269,6 +286,9 @@ namespace util {
 		{
 			node* preds[kMaxLevel];
 			node* succs[kMaxLevel];
+
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			if (!find(k, preds, succs)) {
 				// Not found.
 				return false;
@@ -302,8 +322,8 @@ namespace util {
 
 			find(k, preds, succs);
 
-			// Add node to the list of free nodes.
-			_M_free_nodes.insert(node_to_delete);
+			// 'node_to_delete' has been unlinked.
+			release_node(node_to_delete, kErased);
 
 			return true;
 		}
@@ -311,6 +331,8 @@ namespace util {
 		template<typename _Key, typename _Compare>
 		bool skiplist<_Key, _Compare>::contains(const _Key& k) const
 		{
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			const node* pred = _M_header;
 			for (int level = _M_level_hint - 1; level >= 0; level--) {
 				bool marked;
@@ -360,6 +382,8 @@ namespace util {
 		template<typename _Key, typename _Compare>
 		bool skiplist<_Key, _Compare>::begin(iterator& it) const
 		{
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			const node* pred = _M_header;
 			const node* curr;
 			if ((curr = pred->next[0].get()) == NULL) {
@@ -385,6 +409,8 @@ namespace util {
 		template<typename _Key, typename _Compare>
 		bool skiplist<_Key, _Compare>::end(iterator& it) const
 		{
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			const node* pred = _M_header;
 			for (int level = _M_level_hint - 1; level >= 0; level--) {
 				bool marked;
@@ -431,6 +457,8 @@ namespace util {
 			const node* preds[kMaxLevel];
 			const node* succs[kMaxLevel];
 
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			find(it.k, preds, succs);
 
 			if (preds[0] == _M_header) {
@@ -449,6 +477,8 @@ namespace util {
 			const node* succs[kMaxLevel];
 			const node* curr;
 
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			if (!find(it.k, preds, succs)) {
 				if ((curr = succs[0]) == NULL) {
 					return false;
@@ -482,6 +512,8 @@ namespace util {
 			const node* succs[kMaxLevel];
 			const node* succ;
 
+			concurrent::scoped_epoch guard(_M_epoch);
+
 			find(k, preds, succs);
 
 			if ((succ = succs[0]) == NULL) {
@@ -493,52 +525,216 @@ namespace util {
 			return true;
 		}
 
+		template<typename _Key, typename _Compare>
+		inline skiplist<_Key, _Compare>::cursor::cursor(const skiplist& list)
+		: _M_list(list),
+		_M_node(NULL),
+		_M_pinned(false)
+		{
+		}
+
+		template<typename _Key, typename _Compare>
+		inline skiplist<_Key, _Compare>::cursor::~cursor()
+		{
+			close();
+		}
+
+		template<typename _Key, typename _Compare>
+		bool skiplist<_Key, _Compare>::cursor::begin()
+		{
+			pin();
+
+			_M_node = _M_list._M_header;
+
+			return next();
+		}
+
+		template<typename _Key, typename _Compare>
+		bool skiplist<_Key, _Compare>::cursor::seek(const _Key& k)
+		{
+			const node* preds[kMaxLevel];
+			const node* succs[kMaxLevel];
+
+			pin();
+
+			_M_list.find(k, preds, succs);
+
+			return ((_M_node = succs[0]) != NULL);
+		}
+
+		template<typename _Key, typename _Compare>
+		bool skiplist<_Key, _Compare>::cursor::next()
+		{
+			if (!_M_node) {
+				return false;
+			}
+
+			// The next pointers of '_M_node' can still be followed even if
+			// '_M_node' has been erased, as erased nodes are not freed while
+			// we are inside the epoch.
+			const node* curr = _M_node->next[0].get();
+
+			// While 'curr' has been marked as deleted...
+			while (curr) {
+				bool marked;
+				const node* succ = curr->next[0].get(marked);
+				if (!marked) {
+					break;
+				}
+
+				curr = succ;
+			}
+
+			return ((_M_node = curr) != NULL);
+		}
+
+		template<typename _Key, typename _Compare>
+		inline const _Key& skiplist<_Key, _Compare>::cursor::key() const
+		{
+			return _M_node->key;
+		}
+
+		template<typename _Key, typename _Compare>
+		inline void skiplist<_Key, _Compare>::cursor::close()
+		{
+			_M_node = NULL;
+
+			if (_M_pinned) {
+				_M_list._M_epoch.exit();
+				_M_pinned = false;
+			}
+		}
+
+		template<typename _Key, typename _Compare>
+		inline void skiplist<_Key, _Compare>::cursor::pin()
+		{
+			if (!_M_pinned) {
+				if (!_M_list._M_epoch.enter()) {
+					abort();
+				}
+
+				_M_pinned = true;
+			}
+		}
+
+		template<typename _Key, typename _Compare>
+		template<typename _Function>
+		size_t skiplist<_Key, _Compare>::scan(const _Key& from, const _Key& to, _Function fn) const
+		{
+			size_t count = 0;
+
+			cursor c(*this);
+			if (c.seek(from)) {
+				do {
+					if (_M_compare(c.key(), to) > 0) {
+						break;
+					}
+
+					count++;
+
+					if (!fn(c.key())) {
+						break;
+					}
+				} while (c.next());
+			}
+
+			return count;
+		}
+
 		template<typename _Key, typename _Compare>
 		inline skiplist<_Key, _Compare>::node::node(int height)
 		: key(),
-		level(height)
+		level(height),
+		flags(0)
 		{
 		}
 
 		template<typename _Key, typename _Compare>
 		inline skiplist<_Key, _Compare>::node::node(const _Key& k, int height)
 		: key(k),
-		level(height)
+		level(height),
+		flags(0)
 		{
 		}
 
 		template<typename _Key, typename _Compare>
-		void skiplist<_Key, _Compare>::nodelist::insert(node* n)
+		template<typename _Make>
+		struct skiplist<_Key, _Compare>::node* skiplist<_Key, _Compare>::insert_node(const _Key& k, _Make make, bool& found)
 		{
-			lock.lock();
+			int level = random_level();
 
-			n->prev_deleted = NULL;
-			n->next_deleted = head;
+			node* preds[kMaxLevel];
+			node* succs[kMaxLevel];
 
-			if (!tail) {
-				tail = n;
-				count++;
-			} else {
-				head->prev_deleted = n;
+			node* new_node = NULL;
 
-				if (count == kThreshold) {
-					node* last = tail;
-					tail = tail->prev_deleted;
-					tail->next_deleted = NULL;
+			do {
+				if (find(k, preds, succs)) {
+					// Already inserted.
+					if (new_node) {
+						delete_node(new_node);
+					}
 
-					// Call the destructor.
-					last->~node();
+					found = true;
 
-					// Free the memory.
-					free(last);
-				} else {
-					count++;
+					return succs[0];
+				}
+
+				// Create node.
+				if ((!new_node) && ((new_node = make(level)) == NULL)) {
+					return NULL;
+				}
+
+				// Set successor pointers.
+				for (int i = 0; i < level; i++) {
+					new_node->next[i] = succs[i];
+				}
+
+				// Node is considered inserted when it is linked at level 0.
+				if (preds[0]->next[0].compare_and_swap(succs[0], new_node, false, false)) {
+					break;
 				}
+			} while (true);
+
+			bool marked = false;
+
+			for (int i = 1; (i < level) && (!marked); i++) {
+				do {
+					// If 'new_node' has been marked as deleted...
+					concurrent::atomic::markable_ptr<node> next = new_node->next[i];
+					if (next.marked()) {
+						marked = true;
+						break;
+					}
+
+					if (next.get() != succs[i]) {
+						bool oldmark;
+						if ((!new_node->next[i].compare_and_swap(next.get(), succs[i], false, false, oldmark)) && (oldmark)) {
+							// 'new_node' has been marked as deleted...
+							marked = true;
+							break;
+						}
+					}
+
+					if (preds[i]->next[i].compare_and_swap(succs[i], new_node, false, false)) {
+						break;
+					}
+
+					find(k, preds, succs);
+				} while (true);
+			}
+
+			// If 'new_node' has been marked as deleted...
+			if ((marked) || (new_node->next[level - 1].marked())) {
+				find(k, preds, succs);
 			}
 
-			head = n;
+			// 'new_node' won't be linked anymore by this thread.
+			release_node(new_node, kInserted);
 
-			lock.unlock();
+			found = false;
+
+			return new_node;
 		}
 
 		template<typename _Key, typename _Compare>
@@ -667,21 +863,24 @@ namespace util {
 		}
 
 		template<typename _Key, typename _Compare>
-		int skiplist<_Key, _Compare>::random_level()
+		void skiplist<_Key, _Compare>::reclaim_node(epoch::retired* r)
 		{
-			static const unsigned FRACTION_P = 4;
+			delete_node(reinterpret_cast<node*>(r));
+		}
 
-			int level = 1;
-			long rand;
+		template<typename _Key, typename _Compare>
+		inline void skiplist<_Key, _Compare>::release_node(node* n, unsigned flag)
+		{
+			// If the other flag was already set...
+			if ((concurrent::atomic::bit_or(&n->flags, flag) | flag) == (kInserted | kErased)) {
+				_M_epoch.retire(&n->hook, reclaim_node);
+			}
+		}
 
-			do {
-				lrand48_r(&random_data, &rand);
-				if ((rand % FRACTION_P) == 0) {
-					level++;
-				} else {
-					break;
-				}
-			} while (level < kMaxLevel);
+		template<typename _Key, typename _Compare>
+		int skiplist<_Key, _Compare>::random_level()
+		{
+			int level = util::random_level(kMaxLevel);
 
 			// Increment level hint if required.
 			int level_hint;
@@ -0,0 +1,82 @@
+#ifndef UTIL_CONCURRENT_SKIPLIST_BULK_LOAD_H
+#define UTIL_CONCURRENT_SKIPLIST_BULK_LOAD_H
+
+// Bulk load of the concurrent skip lists (util::concurrent::skiplist and
+// util::concurrent::insert_only_skiplist) from sorted keys: every node is
+// appended at the end of each of its levels, without searching.
+
+#include <stddef.h>
+
+namespace util {
+	namespace concurrent {
+		// Load the keys [first, last) into the empty list of 'header'.
+		// 'make(k)' creates the node of 'k' (with its level), 'destroy(n)'
+		// deletes a node. Duplicated keys are skipped.
+		// Returns false if the list is not empty; if the keys are not
+		// sorted or a node cannot be created, the nodes loaded are
+		// destroyed (the list is left empty) and false is returned.
+		template<typename _Node, int _MaxLevel, typename _Iterator, typename _Compare, typename _Make, typename _Destroy>
+		bool skiplist_bulk_load(_Node* header, _Iterator first, _Iterator last, const _Compare& cmp, _Make make, _Destroy destroy)
+		{
+			// Last node of each level.
+			_Node* tails[_MaxLevel];
+			for (int i = 0; i < _MaxLevel; i++) {
+				if (header->next[i].get()) {
+					// Not empty.
+					return false;
+				}
+
+				tails[i] = header;
+			}
+
+			for (; first != last; ++first) {
+				if (tails[0] != header) {
+					int ret;
+					if ((ret = cmp(tails[0]->key, *first)) == 0) {
+						// Duplicated key.
+						continue;
+					} else if (ret > 0) {
+						// Not sorted.
+						break;
+					}
+				}
+
+				_Node* n;
+				if ((n = make(*first)) == NULL) {
+					break;
+				}
+
+				// Link the node at the end of each level.
+				for (int i = 0; i < n->level; i++) {
+					n->next[i] = NULL;
+					tails[i]->next[i] = n;
+					tails[i] = n;
+				}
+			}
+
+			// If all the keys have been loaded...
+			if (first == last) {
+				// Make the nodes visible to other threads.
+				__sync_synchronize();
+
+				return true;
+			}
+
+			// Destroy the nodes loaded.
+			_Node* n = header->next[0].get();
+			while (n) {
+				_Node* next = n->next[0].get();
+				destroy(n);
+				n = next;
+			}
+
+			for (int i = 0; i < _MaxLevel; i++) {
+				header->next[i] = NULL;
+			}
+
+			return false;
+		}
+	}
+}
+
+#endif // UTIL_CONCURRENT_SKIPLIST_BULK_LOAD_H
@@ -0,0 +1,410 @@
+#ifndef UTIL_CONCURRENT_SKIPLIST_MAP_H
+#define UTIL_CONCURRENT_SKIPLIST_MAP_H
+
+// Concurrent map built on util::concurrent::skiplist (see
+// "util/concurrent/skiplist.h"): the nodes of the list hold the key and a
+// pointer to the value.
+//
+// Notes:
+// Values are stored in immutable boxes; a value is replaced atomically by
+// swapping the pointer to its box. Replaced boxes are retired to the epoch
+// of the list, the last box of a node is freed with the node.
+
+#include <stdlib.h>
+#include <new>
+#include "util/minus.h"
+#include "util/concurrent/atomic/pointer.h"
+#include "util/concurrent/skiplist.h"
+
+namespace util {
+	namespace concurrent {
+		template<typename _Key, typename _Value, typename _Compare = util::minus<_Key> >
+		class skiplist_map {
+			public:
+				// Constructor.
+				skiplist_map();
+				skiplist_map(const _Compare& cmp);
+
+				// Initialize.
+				bool init();
+
+				// Insert (fails if the key already exists).
+				bool insert(const _Key& k, const _Value& v);
+
+				// Insert or replace the value of an existing key.
+				// If 'inserted' is not NULL, it is set to true if the key
+				// has been inserted.
+				bool insert_or_assign(const _Key& k, const _Value& v, bool* inserted = NULL);
+
+				// If the key exists, call 'fn(oldval, newval)' ('newval' is a
+				// copy of 'oldval') and, if 'fn' returns true, replace the
+				// value atomically. 'fn' might be called more than once if
+				// the value is replaced or the key is erased concurrently.
+				// Returns false if the key doesn't exist.
+				template<typename _Function>
+				bool compute_if_present(const _Key& k, _Function fn);
+
+				// Erase.
+				bool erase(const _Key& k);
+
+				// Contains.
+				bool contains(const _Key& k) const;
+
+				// Get value.
+				bool get(const _Key& k, _Value& v) const;
+
+				// Call 'fn(key, value)' for every key in [from, to] (stops if
+				// 'fn' returns false). Returns the number of keys visited.
+				template<typename _Function>
+				size_t scan(const _Key& from, const _Key& to, _Function fn) const;
+
+			private:
+				struct box {
+					// Hook for the epoch (must be the first member).
+					epoch::retired hook;
+
+					// Value (not modified once the box is published).
+					_Value value;
+
+					// Constructor.
+					box(const _Value& v);
+				};
+
+				// Key of the list.
+				struct entry {
+					_Key key;
+
+					// Value (owned by the entry, set before the node is
+					// linked and replaced with compare and swap).
+					mutable atomic::pointer<box> val;
+
+					// Constructors (the value is not copied).
+					entry();
+					entry(const _Key& k);
+					entry(const entry& e);
+
+					// Destructor.
+					~entry();
+				};
+
+				// Compare only the keys.
+				class entry_compare {
+					public:
+						// Constructor.
+						entry_compare(const _Compare& cmp);
+
+						int operator()(const entry& x, const entry& y) const;
+
+					private:
+						_Compare _M_compare;
+				};
+
+				typedef skiplist<entry, entry_compare> list;
+				typedef typename list::node node;
+
+				list _M_list;
+
+				// Insert or assign.
+				bool put(const _Key& k, const _Value& v, bool assign, bool* inserted);
+
+				// Find node (must be called inside the epoch).
+				node* find(const _Key& k);
+				const node* find(const _Key& k) const;
+
+				// Make box.
+				static box* make_box(const _Value& v);
+
+				// Delete box.
+				static void delete_box(box* b);
+
+				// Reclaim box (called by the epoch).
+				static void reclaim_box(epoch::retired* r);
+		};
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::skiplist_map()
+		: _M_list(entry_compare(_Compare()))
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::skiplist_map(const _Compare& cmp)
+		: _M_list(entry_compare(cmp))
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline bool skiplist_map<_Key, _Value, _Compare>::init()
+		{
+			return _M_list.init();
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline bool skiplist_map<_Key, _Value, _Compare>::insert(const _Key& k, const _Value& v)
+		{
+			return put(k, v, false, NULL);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline bool skiplist_map<_Key, _Value, _Compare>::insert_or_assign(const _Key& k, const _Value& v, bool* inserted)
+		{
+			return put(k, v, true, inserted);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		template<typename _Function>
+		bool skiplist_map<_Key, _Value, _Compare>::compute_if_present(const _Key& k, _Function fn)
+		{
+			concurrent::scoped_epoch guard(_M_list._M_epoch);
+
+			do {
+				node* n;
+				if ((n = find(k)) == NULL) {
+					// Not found.
+					return false;
+				}
+
+				box* oldbox = n->key.val.get();
+
+				// Copy old value.
+				box* newbox;
+				if ((newbox = make_box(oldbox->value)) == NULL) {
+					return false;
+				}
+
+				if (!fn(oldbox->value, newbox->value)) {
+					// Value not modified.
+					delete_box(newbox);
+					return true;
+				}
+
+				if (n->key.val.compare_and_swap(oldbox, newbox)) {
+					_M_list._M_epoch.retire(&oldbox->hook, reclaim_box);
+
+					// If the node has not been erased concurrently...
+					if (!n->next[0].marked()) {
+						return true;
+					}
+
+					// The new value has been stored in an erased node (it
+					// will be freed with the node), find the key again.
+				} else {
+					// The value has been replaced by another thread.
+					delete_box(newbox);
+				}
+			} while (true);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline bool skiplist_map<_Key, _Value, _Compare>::erase(const _Key& k)
+		{
+			return _M_list.erase(entry(k));
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline bool skiplist_map<_Key, _Value, _Compare>::contains(const _Key& k) const
+		{
+			return _M_list.contains(entry(k));
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		bool skiplist_map<_Key, _Value, _Compare>::get(const _Key& k, _Value& v) const
+		{
+			concurrent::scoped_epoch guard(_M_list._M_epoch);
+
+			const node* n;
+			if ((n = find(k)) == NULL) {
+				return false;
+			}
+
+			v = n->key.val.get()->value;
+
+			return true;
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		template<typename _Function>
+		inline size_t skiplist_map<_Key, _Value, _Compare>::scan(const _Key& from, const _Key& to, _Function fn) const
+		{
+			return _M_list.scan(entry(from), entry(to), [&fn](const entry& e) {
+				return fn(e.key, e.val.get()->value);
+			});
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::box::box(const _Value& v)
+		: value(v)
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::entry::entry()
+		: key(),
+		val(NULL)
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::entry::entry(const _Key& k)
+		: key(k),
+		val(NULL)
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::entry::entry(const entry& e)
+		: key(e.key),
+		val(NULL)
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::entry::~entry()
+		{
+			box* b;
+			if ((b = val.get()) != NULL) {
+				delete_box(b);
+			}
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline skiplist_map<_Key, _Value, _Compare>::entry_compare::entry_compare(const _Compare& cmp)
+		: _M_compare(cmp)
+		{
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline int skiplist_map<_Key, _Value, _Compare>::entry_compare::operator()(const entry& x, const entry& y) const
+		{
+			return _M_compare(x.key, y.key);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		bool skiplist_map<_Key, _Value, _Compare>::put(const _Key& k, const _Value& v, bool assign, bool* inserted)
+		{
+			box* b;
+			if ((b = make_box(v)) == NULL) {
+				return false;
+			}
+
+			entry e(k);
+
+			concurrent::scoped_epoch guard(_M_list._M_epoch);
+
+			do {
+				// Set if the box has been given to a new node.
+				bool given = false;
+
+				bool found;
+				node* n;
+				if ((n = _M_list.insert_node(e, [this, &e, b, &given](int level) {
+					node* n;
+					if ((n = _M_list.make_node(e, level)) != NULL) {
+						n->key.val = b;
+						given = true;
+					}
+
+					return n;
+				}, found)) == NULL) {
+					if (!given) {
+						delete_box(b);
+					}
+
+					return false;
+				}
+
+				if (!found) {
+					if (inserted) {
+						*inserted = true;
+					}
+
+					return true;
+				}
+
+				// Already inserted.
+				if (!assign) {
+					if (!given) {
+						delete_box(b);
+					}
+
+					return false;
+				}
+
+				// If the box has been freed with the new node...
+				if ((given) && ((b = make_box(v)) == NULL)) {
+					return false;
+				}
+
+				// Replace value.
+				box* oldbox;
+				do {
+					oldbox = n->key.val.get();
+				} while (!n->key.val.compare_and_swap(oldbox, b));
+
+				_M_list._M_epoch.retire(&oldbox->hook, reclaim_box);
+
+				// If the node has not been erased concurrently...
+				if (!n->next[0].marked()) {
+					if (inserted) {
+						*inserted = false;
+					}
+
+					return true;
+				}
+
+				// The value has been lost (it will be freed with the node),
+				// retry as an insert (find() unlinks the node).
+				if ((b = make_box(v)) == NULL) {
+					return false;
+				}
+			} while (true);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline typename skiplist_map<_Key, _Value, _Compare>::node* skiplist_map<_Key, _Value, _Compare>::find(const _Key& k)
+		{
+			node* preds[list::kMaxLevel];
+			node* succs[list::kMaxLevel];
+
+			return _M_list.find(entry(k), preds, succs) ? succs[0] : NULL;
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline const typename skiplist_map<_Key, _Value, _Compare>::node* skiplist_map<_Key, _Value, _Compare>::find(const _Key& k) const
+		{
+			const node* preds[list::kMaxLevel];
+			const node* succs[list::kMaxLevel];
+
+			return _M_list.find(entry(k), preds, succs) ? succs[0] : NULL;
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline struct skiplist_map<_Key, _Value, _Compare>::box* skiplist_map<_Key, _Value, _Compare>::make_box(const _Value& v)
+		{
+			box* b;
+			if ((b = reinterpret_cast<box*>(malloc(sizeof(box)))) == NULL) {
+				return NULL;
+			}
+
+			return new (b) box(v);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		inline void skiplist_map<_Key, _Value, _Compare>::delete_box(box* b)
+		{
+			// Call the destructor.
+			b->~box();
+
+			// Free the memory.
+			free(b);
+		}
+
+		template<typename _Key, typename _Value, typename _Compare>
+		void skiplist_map<_Key, _Value, _Compare>::reclaim_box(epoch::retired* r)
+		{
+			delete_box(reinterpret_cast<box*>(r));
+		}
+	}
+}
+
+#endif // UTIL_CONCURRENT_SKIPLIST_MAP_H
@@ -0,0 +1,153 @@
+#include <string.h>
+#include "util/concurrent/thread_records.h"
+#include "util/concurrent/atomic/atomic.h"
+
+// Thread key shared by all the registries: its value is the list of
+// records of the thread (one per registry).
+static pthread_key_t key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static bool key_created = false;
+
+// Identifier of the next registry.
+static unsigned long next_id = 0;
+
+util::concurrent::thread_records::thread_records()
+	: _M_records(NULL),
+	  _M_id(atomic::add(&next_id, 1ul))
+{
+}
+
+util::concurrent::thread_records::~thread_records()
+{
+	while (_M_records) {
+		record* next = _M_records->next;
+
+		// If a thread is still using the record, the thread frees it.
+		if (!atomic::bool_compare_and_swap(&_M_records->in_use, kInUse, kOrphaned)) {
+			free(_M_records);
+		}
+
+		_M_records = next;
+	}
+}
+
+bool util::concurrent::thread_records::init()
+{
+	pthread_once(&key_once, create_key);
+
+	return atomic::acquire_load(&key_created);
+}
+
+struct util::concurrent::thread_records::record* util::concurrent::thread_records::get(size_t size)
+{
+	record* head = reinterpret_cast<record*>(pthread_getspecific(key));
+	record* prev = NULL;
+	record* rec = head;
+
+	while (rec) {
+		// If the registry of the record has been destroyed...
+		if (atomic::acquire_load(&rec->in_use) == kOrphaned) {
+			record* next = rec->thread_next;
+
+			if (prev) {
+				prev->thread_next = next;
+			} else {
+				head = next;
+			}
+
+			free(rec);
+
+			rec = next;
+			continue;
+		}
+
+		if (rec->id == _M_id) {
+			// Move the record to the front of the list.
+			if (prev) {
+				prev->thread_next = rec->thread_next;
+				rec->thread_next = head;
+				head = rec;
+			}
+
+			break;
+		}
+
+		prev = rec;
+		rec = rec->thread_next;
+	}
+
+	if ((rec) || (size == 0)) {
+		if (head != pthread_getspecific(key)) {
+			pthread_setspecific(key, head);
+		}
+
+		return rec;
+	}
+
+	// Reuse a record released by some other thread.
+	for (rec = atomic::acquire_load(&_M_records); rec; rec = rec->next) {
+		if ((atomic::acquire_load(&rec->in_use) == kFree) && (atomic::bool_compare_and_swap(&rec->in_use, kFree, kInUse))) {
+			break;
+		}
+	}
+
+	if (!rec) {
+		// Round to the cache line size to avoid false sharing.
+		size = (size + kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+
+		void* p;
+		if (posix_memalign(&p, kCacheLineSize, size) != 0) {
+			pthread_setspecific(key, head);
+			return NULL;
+		}
+
+		memset(p, 0, size);
+
+		rec = reinterpret_cast<record*>(p);
+
+		rec->in_use = kInUse;
+		rec->id = _M_id;
+
+		// Add record to the list of records.
+		do {
+			rec->next = atomic::acquire_load(&_M_records);
+		} while (!atomic::bool_compare_and_swap(&_M_records, rec->next, rec));
+	}
+
+	rec->thread_next = head;
+
+	if (pthread_setspecific(key, rec) != 0) {
+		atomic::release_store(&rec->in_use, kFree);
+		return NULL;
+	}
+
+	return rec;
+}
+
+struct util::concurrent::thread_records::record* util::concurrent::thread_records::first() const
+{
+	return atomic::acquire_load(&_M_records);
+}
+
+void util::concurrent::thread_records::release_records(void* arg)
+{
+	record* rec = reinterpret_cast<record*>(arg);
+
+	while (rec) {
+		record* next = rec->thread_next;
+
+		// If the registry has been destroyed, free the record.
+		if (!atomic::bool_compare_and_swap(&rec->in_use, kInUse, kFree)) {
+			free(rec);
+		}
+
+		rec = next;
+	}
+}
+
+void util::concurrent::thread_records::create_key()
+{
+	if (pthread_key_create(&key, release_records) == 0) {
+		atomic::release_store(&key_created, true);
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef UTIL_CONCURRENT_THREAD_RECORDS_H
+#define UTIL_CONCURRENT_THREAD_RECORDS_H
+
+// Registry of the per-thread records of an object (epoch, arena...).
+//
+// A thread gets its record the first time it asks for it; when the thread
+// exits, its records are released and reused by the next threads. The
+// records of a thread (one per object) are linked together and found
+// through a single process-wide thread key, so the number of objects is not
+// limited by PTHREAD_KEYS_MAX.
+
+#include <stdlib.h>
+#include <pthread.h>
+
+namespace util {
+	namespace concurrent {
+		class thread_records {
+			public:
+				// Header of the records (the records of the objects
+				// derive from it).
+				struct record {
+					// State of the record (kFree, kInUse or
+					// kOrphaned).
+					int in_use;
+
+					// Identifier of the registry.
+					unsigned long id;
+
+					// Next record of the registry.
+					record* next;
+
+					// Next record of the thread.
+					record* thread_next;
+				};
+
+				// Constructor.
+				thread_records();
+
+				// Destructor (the records still in use are freed by
+				// their threads).
+				~thread_records();
+
+				// Initialize (creates the thread key).
+				static bool init();
+
+				// Get record of the current thread. If the thread has
+				// no record and 'size' is not 0, a record released by
+				// another thread is reused or a new record of 'size'
+				// bytes is created (zero-filled).
+				record* get(size_t size = 0);
+
+				// Get first record of the registry.
+				record* first() const;
+
+			private:
+				static const size_t kCacheLineSize = 64;
+
+				// States of a record.
+				static const int kFree = 0;
+				static const int kInUse = 1;
+
+				// The registry has been destroyed while the record was
+				// in use, the thread frees it.
+				static const int kOrphaned = 2;
+
+				record* _M_records;
+
+				// Identifier of the registry (not reused).
+				unsigned long _M_id;
+
+				// Release the records of a thread (called when the
+				// thread exits).
+				static void release_records(void* arg);
+
+				// Create the thread key.
+				static void create_key();
+		};
+	}
+}
+
+#endif // UTIL_CONCURRENT_THREAD_RECORDS_H
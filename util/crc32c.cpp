@@ -0,0 +1,138 @@
+#include <string.h>
+#include <pthread.h>
+#include "util/crc32c.h"
+
+// Reversed polynomial.
+static const uint32_t kPolynomial = 0x82f63b78;
+
+static uint32_t table[8][256];
+static bool sse42;
+
+// The tables are initialized in the first call (not by a static
+// initializer: CRCs might be computed by the constructors of other static
+// objects).
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void initialize();
+static uint32_t compute_hardware(const uint8_t* data, size_t len, uint32_t crc);
+
+uint32_t util::crc32c::compute(const void* data, size_t len, uint32_t crc)
+{
+	pthread_once(&once, initialize);
+
+	if (sse42) {
+		return ~compute_hardware(reinterpret_cast<const uint8_t*>(data), len, ~crc);
+	}
+
+	return compute_table(data, len, crc);
+}
+
+uint32_t util::crc32c::compute_table(const void* data, size_t len, uint32_t crc)
+{
+	pthread_once(&once, initialize);
+
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+	crc = ~crc;
+
+	// Slicing-by-8.
+	while (len >= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, p, sizeof(uint32_t));
+		memcpy(&hi, p + 4, sizeof(uint32_t));
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+		lo = __builtin_bswap32(lo);
+		hi = __builtin_bswap32(hi);
+#endif
+
+		lo ^= crc;
+
+		crc = table[7][lo & 0xff] ^
+		      table[6][(lo >> 8) & 0xff] ^
+		      table[5][(lo >> 16) & 0xff] ^
+		      table[4][lo >> 24] ^
+		      table[3][hi & 0xff] ^
+		      table[2][(hi >> 8) & 0xff] ^
+		      table[1][(hi >> 16) & 0xff] ^
+		      table[0][hi >> 24];
+
+		p += 8;
+		len -= 8;
+	}
+
+	while (len-- > 0) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+	}
+
+	return ~crc;
+}
+
+bool util::crc32c::hardware()
+{
+	pthread_once(&once, initialize);
+
+	return sse42;
+}
+
+void initialize()
+{
+	// Initialize tables.
+	for (unsigned i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (unsigned j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+		}
+
+		table[0][i] = crc;
+	}
+
+	for (unsigned i = 0; i < 256; i++) {
+		for (unsigned j = 1; j < 8; j++) {
+			table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xff];
+		}
+	}
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	sse42 = __builtin_cpu_supports("sse4.2");
+#else
+	sse42 = false;
+#endif
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t compute_hardware(const uint8_t* data, size_t len, uint32_t crc)
+{
+	// Align to 8 bytes.
+	while ((len > 0) && ((reinterpret_cast<uintptr_t>(data) & 7) != 0)) {
+		crc = __builtin_ia32_crc32qi(crc, *data++);
+		len--;
+	}
+
+	uint64_t crc64 = crc;
+
+	while (len >= 8) {
+		uint64_t n;
+		memcpy(&n, data, sizeof(uint64_t));
+
+		crc64 = __builtin_ia32_crc32di(crc64, n);
+
+		data += 8;
+		len -= 8;
+	}
+
+	crc = crc64;
+
+	while (len-- > 0) {
+		crc = __builtin_ia32_crc32qi(crc, *data++);
+	}
+
+	return crc;
+}
+#else
+uint32_t compute_hardware(const uint8_t* data, size_t len, uint32_t crc)
+{
+	return ~util::crc32c::compute_table(data, len, ~crc);
+}
+#endif
@@ -0,0 +1,28 @@
+#ifndef UTIL_CRC32C_H
+#define UTIL_CRC32C_H
+
+// CRC-32C (Castagnoli).
+//
+// Uses the SSE 4.2 crc32 instruction if the CPU supports it, otherwise
+// a table (slicing-by-8).
+// The CRC can be computed incrementally:
+// compute(b, blen, compute(a, alen)) == compute(a + b, alen + blen).
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace util {
+	class crc32c {
+		public:
+			// Compute CRC.
+			static uint32_t compute(const void* data, size_t len, uint32_t crc = 0);
+
+			// Compute CRC with the table.
+			static uint32_t compute_table(const void* data, size_t len, uint32_t crc = 0);
+
+			// Is the crc32 instruction available?
+			static bool hardware();
+	};
+}
+
+#endif // UTIL_CRC32C_H
@@ -3,6 +3,22 @@
 
 ssize_t util::file_block_reader::read(void* buf, size_t count, int timeout, error& err)
 {
+	if (!_M_sequential) {
+		_M_file.advise(0, 0, POSIX_FADV_SEQUENTIAL);
+		_M_sequential = true;
+	}
+
+	// If half of the readahead window has been consumed, ask for the
+	// next window.
+	if ((_M_readahead > 0) && (_M_unhinted >= _M_readahead / 2)) {
+		off_t offset;
+		if ((offset = _M_file.offset()) >= 0) {
+			_M_file.advise(offset, _M_readahead, POSIX_FADV_WILLNEED);
+		}
+
+		_M_unhinted = 0;
+	}
+
 	ssize_t ret;
 	switch ((ret = _M_file.read(buf, count))) {
 		case -1:
@@ -12,7 +28,7 @@ ssize_t util::file_block_reader::read(void* buf, size_t count, int timeout, erro
 			err = kEndOfFile;
 			break;
 		default:
-			;
+			_M_unhinted += ret;
 	}
 
 	return ret;
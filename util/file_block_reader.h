@@ -7,18 +7,33 @@
 namespace util {
 	class file_block_reader : public block_reader {
 		public:
+			static const size_t kDefaultReadahead = 4 * 1024 * 1024;
+
 			// Constructor.
-			file_block_reader(fs::file& file);
+			// The kernel is asked to read 'readahead' bytes ahead of
+			// the current offset (0: no readahead hints).
+			file_block_reader(fs::file& file, size_t buffer_size = kDefaultBufferSize, size_t readahead = kDefaultReadahead);
 
 		protected:
 			ssize_t read(void* buf, size_t count, int timeout, error& err);
 
 		private:
 			fs::file& _M_file;
+
+			size_t _M_readahead;
+
+			// Bytes read since the last readahead hint.
+			size_t _M_unhinted;
+
+			bool _M_sequential;
 	};
 
-	inline file_block_reader::file_block_reader(fs::file& file)
-		: _M_file(file)
+	inline file_block_reader::file_block_reader(fs::file& file, size_t buffer_size, size_t readahead)
+		: block_reader(buffer_size),
+		  _M_file(file),
+		  _M_readahead(readahead),
+		  _M_unhinted(readahead),
+		  _M_sequential(false)
 	{
 	}
 }
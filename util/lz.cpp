@@ -0,0 +1,186 @@
+#include <string.h>
+#include "util/lz.h"
+
+static inline uint32_t read32(const uint8_t* p)
+{
+	uint32_t n;
+	memcpy(&n, p, sizeof(uint32_t));
+
+	return n;
+}
+
+static inline uint8_t* write_length(uint8_t* op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+
+	*op++ = len;
+
+	return op;
+}
+
+size_t util::lz::compress(const void* in, size_t len, void* out)
+{
+	const uint8_t* begin = reinterpret_cast<const uint8_t*>(in);
+	const uint8_t* end = begin + len;
+	const uint8_t* ip = begin;
+	const uint8_t* anchor = begin;
+
+	uint8_t* op = reinterpret_cast<uint8_t*>(out);
+
+	if (len >= kMinMatch) {
+		// Positions of the last sequences of 4 bytes.
+		uint32_t table[1 << kHashBits];
+		memset(table, 0, sizeof(table));
+
+		const uint8_t* limit = end - kMinMatch;
+
+		while (ip <= limit) {
+			uint32_t seq = read32(ip);
+			uint32_t h = (seq * 2654435761u) >> (32 - kHashBits);
+
+			const uint8_t* ref = begin + table[h];
+			table[h] = ip - begin;
+
+			if ((ref >= ip) || (static_cast<size_t>(ip - ref) > kMaxOffset) || (read32(ref) != seq)) {
+				// Skip faster over incompressible data.
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			// Extend match.
+			const uint8_t* m = ip + kMinMatch;
+			const uint8_t* r = ref + kMinMatch;
+			while ((m < end) && (*m == *r)) {
+				m++;
+				r++;
+			}
+
+			size_t literals = ip - anchor;
+			size_t match = (m - ip) - kMinMatch;
+
+			uint8_t* token = op++;
+			*token = ((literals < 15) ? literals : 15) << 4;
+			if (literals >= 15) {
+				op = write_length(op, literals - 15);
+			}
+
+			memcpy(op, anchor, literals);
+			op += literals;
+
+			size_t offset = ip - ref;
+			*op++ = offset & 0xff;
+			*op++ = offset >> 8;
+
+			if (match >= 15) {
+				*token |= 15;
+				op = write_length(op, match - 15);
+			} else {
+				*token |= match;
+			}
+
+			ip = anchor = m;
+		}
+	}
+
+	// Last literals.
+	size_t literals = end - anchor;
+
+	*op++ = ((literals < 15) ? literals : 15) << 4;
+	if (literals >= 15) {
+		op = write_length(op, literals - 15);
+	}
+
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	return op - reinterpret_cast<uint8_t*>(out);
+}
+
+bool util::lz::decompress(const void* in, size_t inlen, void* out, size_t outlen, size_t& len)
+{
+	const uint8_t* ip = reinterpret_cast<const uint8_t*>(in);
+	const uint8_t* iend = ip + inlen;
+
+	uint8_t* begin = reinterpret_cast<uint8_t*>(out);
+	uint8_t* op = begin;
+	uint8_t* oend = begin + outlen;
+
+	while (ip < iend) {
+		unsigned token = *ip++;
+
+		// Literals.
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			unsigned c;
+			do {
+				if (ip == iend) {
+					return false;
+				}
+
+				literals += (c = *ip++);
+			} while (c == 255);
+		}
+
+		if ((literals > static_cast<size_t>(iend - ip)) || (literals > static_cast<size_t>(oend - op))) {
+			return false;
+		}
+
+		memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+
+		// Last sequence?
+		if (ip == iend) {
+			len = op - begin;
+			return true;
+		}
+
+		// Match.
+		if (iend - ip < 2) {
+			return false;
+		}
+
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if ((offset == 0) || (offset > static_cast<size_t>(op - begin))) {
+			return false;
+		}
+
+		size_t match = token & 0x0f;
+		if (match == 15) {
+			unsigned c;
+			do {
+				if (ip == iend) {
+					return false;
+				}
+
+				match += (c = *ip++);
+			} while (c == 255);
+		}
+
+		match += kMinMatch;
+
+		if (match > static_cast<size_t>(oend - op)) {
+			return false;
+		}
+
+		const uint8_t* ref = op - offset;
+
+		if (offset >= match) {
+			memcpy(op, ref, match);
+			op += match;
+		} else {
+			// Overlapping match.
+			for (size_t i = 0; i < match; i++) {
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	// The last sequence must have literals only.
+	return false;
+}
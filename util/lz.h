@@ -0,0 +1,43 @@
+#ifndef UTIL_LZ_H
+#define UTIL_LZ_H
+
+// Fast LZ77 compressor (LZ4-like format).
+//
+// The compressed data is a sequence of:
+//   token: literal length (4 high bits) and match length - 4 (4 low bits);
+//          15 means that the length continues in the next bytes (every
+//          byte is added to the length, until a byte < 255).
+//   literals.
+//   match offset (2 bytes, little endian) and match length (if the token
+//   has 15).
+// The last sequence only has literals.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace util {
+	class lz {
+		public:
+			// Get maximum size of the compressed data.
+			static size_t bound(size_t len);
+
+			// Compress ('out' must have at least bound(len) bytes).
+			// Returns the size of the compressed data.
+			static size_t compress(const void* in, size_t len, void* out);
+
+			// Decompress (at most 'outlen' bytes).
+			static bool decompress(const void* in, size_t inlen, void* out, size_t outlen, size_t& len);
+
+		private:
+			static const size_t kMinMatch = 4;
+			static const size_t kMaxOffset = 65535;
+			static const unsigned kHashBits = 13;
+	};
+
+	inline size_t lz::bound(size_t len)
+	{
+		return len + (len / 255) + 16;
+	}
+}
+
+#endif // UTIL_LZ_H
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util/mmap_block_reader.h"
+#include "macros/macros.h"
+
+util::mmap_block_reader::mmap_block_reader(fs::file& file, off_t offset, size_t window_size)
+	: _M_file(file),
+	  _M_base(NULL),
+	  _M_map_offset(0),
+	  _M_map_len(0),
+	  _M_offset(offset),
+	  _M_filesize(0),
+	  _M_scratch(NULL),
+	  _M_checksums_required(false)
+{
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+
+	// The window must be big enough for the biggest block (which might
+	// not start at a page boundary).
+	window_size = MAX(window_size, block::kMaxSize + pagesize);
+
+	_M_window_size = (window_size + pagesize - 1) & ~(pagesize - 1);
+}
+
+bool util::mmap_block_reader::next(block& block, block_reader::error& err)
+{
+	// Map header.
+	if (!map(_M_offset, block::kMinSize, err)) {
+		return false;
+	}
+
+	const unsigned char* begin = _M_base + (_M_offset - _M_map_offset);
+
+	util::block header(begin);
+	blocklen_t block_size = header.size();
+
+	// If the block is too big...
+	if (block_size > block::kMaxSize) {
+		err = block_reader::kBlockTooBig;
+		return false;
+	}
+
+	// If the header is invalid (e.g. torn write)...
+	if (!header.valid_header(_M_checksums_required)) {
+		err = block_reader::kCorruptBlock;
+		return false;
+	}
+
+	// Map block.
+	if (block_size > block::kMinSize) {
+		if (!map(_M_offset, block_size, err)) {
+			return false;
+		}
+
+		begin = _M_base + (_M_offset - _M_map_offset);
+	}
+
+	block = util::block(begin);
+
+	_M_offset += block_size;
+
+	if (!block.verify()) {
+		err = block_reader::kCorruptBlock;
+		return false;
+	}
+
+	if (block.compressed()) {
+		if ((!_M_scratch) && ((_M_scratch = reinterpret_cast<unsigned char*>(malloc(block::kMaxSize))) == NULL)) {
+			err = block_reader::kNoMemory;
+			return false;
+		}
+
+		if (!block.decompress(_M_scratch, block)) {
+			err = block_reader::kCorruptBlock;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t util::mmap_block_reader::next_batch(block* blocks, size_t max, block_reader::error& err)
+{
+	if ((max == 0) || (!next(*blocks, err))) {
+		return 0;
+	}
+
+	size_t n = 1;
+
+	// Add the complete blocks in the current window (the errors, if any,
+	// will be reported by the next call). Compressed blocks are not added,
+	// as they are decompressed into the same buffer.
+	const unsigned char* end = _M_base + _M_map_len;
+
+	while (n < max) {
+		const unsigned char* begin = _M_base + (_M_offset - _M_map_offset);
+		if (static_cast<size_t>(end - begin) < block::kMinSize) {
+			break;
+		}
+
+		blocklen_t block_size = util::block(begin).size();
+		util::block b(begin);
+		if ((block_size > static_cast<size_t>(end - begin)) || (!b.valid_header(_M_checksums_required)) || (b.compressed()) || (!b.verify())) {
+			break;
+		}
+
+		blocks[n++] = b;
+
+		_M_offset += block_size;
+	}
+
+	return n;
+}
+
+bool util::mmap_block_reader::map(off_t offset, size_t len, block_reader::error& err)
+{
+	off_t end = offset + len;
+
+	// If the range is already mapped...
+	if ((_M_base) && (offset >= _M_map_offset) && (end <= _M_map_offset + static_cast<off_t>(_M_map_len))) {
+		return true;
+	}
+
+	// If the range is beyond the end of the file, check whether the file
+	// has grown.
+	if (end > _M_filesize) {
+		struct stat status;
+		if (fstat(_M_file.fd(), &status) < 0) {
+			err = block_reader::kReadError;
+			return false;
+		}
+
+		if (end > (_M_filesize = status.st_size)) {
+			err = block_reader::kEndOfFile;
+			return false;
+		}
+	}
+
+	unmap();
+
+	off_t map_offset = offset & ~(static_cast<off_t>(sysconf(_SC_PAGESIZE)) - 1);
+
+	// Don't map beyond the end of the file.
+	size_t map_len = MIN(static_cast<off_t>(_M_window_size), _M_filesize - map_offset);
+
+	void* p;
+	if ((p = mmap(NULL, map_len, PROT_READ, MAP_SHARED, _M_file.fd(), map_offset)) == MAP_FAILED) {
+		err = block_reader::kNoMemory;
+		return false;
+	}
+
+	madvise(p, map_len, MADV_SEQUENTIAL);
+
+	_M_base = reinterpret_cast<unsigned char*>(p);
+	_M_map_offset = map_offset;
+	_M_map_len = map_len;
+
+	return true;
+}
+
+void util::mmap_block_reader::unmap()
+{
+	if (_M_base) {
+		munmap(_M_base, _M_map_len);
+		_M_base = NULL;
+	}
+}
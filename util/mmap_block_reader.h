@@ -0,0 +1,106 @@
+#ifndef UTIL_MMAP_BLOCK_READER_H
+#define UTIL_MMAP_BLOCK_READER_H
+
+// Block reader which maps the file in memory.
+//
+// The blocks point straight into the mapping (no copies, no read() per
+// block). Huge files are mapped in windows of 'window_size' bytes; a block
+// remains valid until the window is moved (if the whole file fits in one
+// window, until the reader is destroyed).
+//
+// The file can grow while it is being read (the size is checked again when
+// the reader reaches the end of the file), but it must not be truncated or
+// overwritten: accessing a page beyond the new end of the file raises
+// SIGBUS, and the blocks already returned would change under the caller.
+
+#include <sys/types.h>
+#include "util/block_reader.h"
+#include "fs/file.h"
+
+namespace util {
+	class mmap_block_reader {
+		public:
+			static const size_t kDefaultWindowSize = 1024 * 1024 * 1024;
+
+			// Constructor.
+			mmap_block_reader(fs::file& file, off_t offset = 0, size_t window_size = kDefaultWindowSize);
+
+			// Destructor.
+			~mmap_block_reader();
+
+			// Get next block (the checksums are verified and the
+			// compressed blocks are decompressed into an internal
+			// buffer).
+			bool next(block& block);
+			bool next(block& block, block_reader::error& err);
+
+			// Get up to 'max' blocks.
+			// Returns the number of blocks (0 on error).
+			size_t next_batch(block* blocks, size_t max);
+			size_t next_batch(block* blocks, size_t max, block_reader::error& err);
+
+			// Get offset of the next block.
+			off_t offset() const;
+
+			// Reject the blocks without checksum (except the file
+			// header and the sync blocks).
+			void require_checksums(bool required);
+
+		private:
+			fs::file& _M_file;
+
+			size_t _M_window_size;
+
+			// Mapping.
+			unsigned char* _M_base;
+			off_t _M_map_offset;
+			size_t _M_map_len;
+
+			// Offset of the next block.
+			off_t _M_offset;
+
+			off_t _M_filesize;
+
+			// Buffer for decompressing blocks.
+			unsigned char* _M_scratch;
+
+			bool _M_checksums_required;
+
+			// Make sure that the range [offset, offset + len) is mapped
+			// (and within the file).
+			bool map(off_t offset, size_t len, block_reader::error& err);
+
+			// Unmap window.
+			void unmap();
+	};
+
+	inline mmap_block_reader::~mmap_block_reader()
+	{
+		unmap();
+		free(_M_scratch);
+	}
+
+	inline bool mmap_block_reader::next(block& block)
+	{
+		block_reader::error err;
+		return next(block, err);
+	}
+
+	inline size_t mmap_block_reader::next_batch(block* blocks, size_t max)
+	{
+		block_reader::error err;
+		return next_batch(blocks, max, err);
+	}
+
+	inline off_t mmap_block_reader::offset() const
+	{
+		return _M_offset;
+	}
+
+	inline void mmap_block_reader::require_checksums(bool required)
+	{
+		_M_checksums_required = required;
+	}
+}
+
+#endif // UTIL_MMAP_BLOCK_READER_H
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util/parallel_block_scanner.h"
+
+bool util::parallel_block_scanner::open(fs::file& file)
+{
+	close();
+
+	struct stat status;
+	if (fstat(file.fd(), &status) < 0) {
+		return false;
+	}
+
+	// If the file is empty...
+	if (status.st_size == 0) {
+		return true;
+	}
+
+	void* p;
+	if ((p = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, file.fd(), 0)) == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(p, status.st_size, MADV_SEQUENTIAL);
+
+	_M_data = reinterpret_cast<const unsigned char*>(p);
+	_M_size = status.st_size;
+
+	// If the file starts with a file header...
+	if ((_M_size >= static_cast<off_t>(block::kFileHeaderSize)) && (block(_M_data).file_header())) {
+		block::make_sync_block(block(_M_data), _M_sync);
+
+		_M_first = block::kFileHeaderSize;
+		_M_has_sync = true;
+	}
+
+	return true;
+}
+
+void util::parallel_block_scanner::close()
+{
+	if (_M_data) {
+		munmap(const_cast<unsigned char*>(_M_data), _M_size);
+
+		_M_data = NULL;
+		_M_size = 0;
+	}
+
+	_M_first = 0;
+	_M_has_sync = false;
+}
+
+off_t util::parallel_block_scanner::find_sync(off_t offset) const
+{
+	// If the file has no sync blocks...
+	if ((!_M_has_sync) || (offset >= _M_size)) {
+		return _M_size;
+	}
+
+	const void* p;
+	if ((p = memmem(_M_data + offset, _M_size - offset, _M_sync, block::kSyncSize)) == NULL) {
+		return _M_size;
+	}
+
+	return reinterpret_cast<const unsigned char*>(p) - _M_data;
+}
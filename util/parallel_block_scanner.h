@@ -0,0 +1,226 @@
+#ifndef UTIL_PARALLEL_BLOCK_SCANNER_H
+#define UTIL_PARALLEL_BLOCK_SCANNER_H
+
+// Scans a block file with several threads.
+//
+// The file is mapped in memory and split in as many byte ranges as
+// workers. Every worker resynchronizes to a block boundary by searching the
+// first sync block (see block::kSyncSize) at or after the beginning of its
+// range, and processes the blocks until it reaches a sync block at or after
+// the end of its range; this way every block is processed by exactly one
+// worker. The sync marker is taken from the file header; if the file has no
+// file header, the first worker processes the whole file. The checksums are
+// verified and the compressed blocks are decompressed before calling the
+// callback.
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "util/block.h"
+#include "util/move.h"
+#include "fs/file.h"
+#include "macros/macros.h"
+
+namespace util {
+	class parallel_block_scanner {
+		public:
+			// Constructor.
+			parallel_block_scanner();
+
+			// Destructor.
+			~parallel_block_scanner();
+
+			// Open.
+			bool open(fs::file& file);
+
+			// Close.
+			void close();
+
+			// Reject the blocks without checksum (except the file
+			// header and the sync blocks).
+			void require_checksums(bool required);
+
+			// Scan file with 'nworkers' threads.
+			// For every block (except the file header and the sync
+			// blocks), 'fn' is called as:
+			// bool fn(const block& b, unsigned worker); if it returns
+			// false, the worker stops. 'fn' is shared by the workers.
+			// Returns false if the file is corrupted or the threads
+			// couldn't be created.
+			template<typename _Fn>
+			bool scan(unsigned nworkers, _Fn&& fn) const;
+
+			// Scan the blocks of the range [begin, end).
+			template<typename _Fn>
+			bool scan(off_t begin, off_t end, _Fn&& fn, unsigned worker) const;
+
+			// Get offset of the first sync block at or after 'offset'
+			// (the file size if there are no more sync blocks).
+			off_t find_sync(off_t offset) const;
+
+		private:
+			const unsigned char* _M_data;
+			off_t _M_size;
+
+			// Offset of the first block (after the file header).
+			off_t _M_first;
+
+			// Sync block of the file (if the file has a file header).
+			unsigned char _M_sync[block::kSyncSize];
+			bool _M_has_sync;
+
+			bool _M_checksums_required;
+
+			template<typename _Fn>
+			struct worker {
+				pthread_t thread;
+
+				const parallel_block_scanner* scanner;
+				_Fn* fn;
+				unsigned id;
+
+				off_t begin;
+				off_t end;
+
+				bool ret;
+			};
+
+			template<typename _Fn>
+			static void* run(void* arg);
+	};
+
+	inline parallel_block_scanner::parallel_block_scanner()
+		: _M_data(NULL),
+		  _M_size(0),
+		  _M_first(0),
+		  _M_has_sync(false),
+		  _M_checksums_required(false)
+	{
+	}
+
+	inline parallel_block_scanner::~parallel_block_scanner()
+	{
+		close();
+	}
+
+	inline void parallel_block_scanner::require_checksums(bool required)
+	{
+		_M_checksums_required = required;
+	}
+
+	template<typename _Fn>
+	bool parallel_block_scanner::scan(unsigned nworkers, _Fn&& fn) const
+	{
+		typedef typename util::remove_reference<_Fn>::type function;
+
+		if (nworkers <= 1) {
+			return scan(0, _M_size, fn, 0);
+		}
+
+		worker<function>* workers;
+		if ((workers = reinterpret_cast<worker<function>*>(malloc(nworkers * sizeof(worker<function>)))) == NULL) {
+			return false;
+		}
+
+		bool ret = true;
+
+		unsigned i;
+		for (i = 0; i < nworkers; i++) {
+			workers[i].scanner = this;
+			workers[i].fn = &fn;
+			workers[i].id = i;
+			workers[i].begin = (_M_size * i) / nworkers;
+			workers[i].end = (_M_size * (i + 1)) / nworkers;
+
+			if (pthread_create(&workers[i].thread, NULL, run<function>, &workers[i]) != 0) {
+				ret = false;
+				break;
+			}
+		}
+
+		// Wait for the workers.
+		for (unsigned j = 0; j < i; j++) {
+			pthread_join(workers[j].thread, NULL);
+
+			if (!workers[j].ret) {
+				ret = false;
+			}
+		}
+
+		free(workers);
+
+		return ret;
+	}
+
+	template<typename _Fn>
+	bool parallel_block_scanner::scan(off_t begin, off_t end, _Fn&& fn, unsigned worker) const
+	{
+		off_t offset = (begin == 0) ? _M_first : find_sync(MAX(begin, _M_first));
+
+		// Buffer for decompressing blocks.
+		unsigned char* scratch = NULL;
+
+		bool ret = true;
+
+		while (offset + static_cast<off_t>(block::kMinSize) <= _M_size) {
+			block b(_M_data + offset);
+
+			if (!b.valid_header(_M_checksums_required)) {
+				ret = false;
+				break;
+			}
+
+			blocklen_t size = b.size();
+
+			// Incomplete block at the end of the file?
+			if (offset + size > _M_size) {
+				break;
+			}
+
+			if ((_M_has_sync) && (b.sync(_M_sync + block::kMinSize))) {
+				// If the block belongs to the next range...
+				if (offset >= end) {
+					break;
+				}
+			} else {
+				if (!b.verify()) {
+					ret = false;
+					break;
+				}
+
+				if (b.compressed()) {
+					if ((!scratch) && ((scratch = reinterpret_cast<unsigned char*>(malloc(block::kMaxSize))) == NULL)) {
+						ret = false;
+						break;
+					}
+
+					if (!b.decompress(scratch, b)) {
+						ret = false;
+						break;
+					}
+				}
+
+				if (!fn(b, worker)) {
+					break;
+				}
+			}
+
+			offset += size;
+		}
+
+		free(scratch);
+
+		return ret;
+	}
+
+	template<typename _Fn>
+	void* parallel_block_scanner::run(void* arg)
+	{
+		worker<_Fn>* w = reinterpret_cast<worker<_Fn>*>(arg);
+		w->ret = w->scanner->scan(w->begin, w->end, *w->fn, w->id);
+
+		return NULL;
+	}
+}
+
+#endif // UTIL_PARALLEL_BLOCK_SCANNER_H
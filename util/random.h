@@ -0,0 +1,88 @@
+#ifndef UTIL_RANDOM_H
+#define UTIL_RANDOM_H
+
+// Fast pseudo-random number generators (not suitable for cryptography).
+//
+// xorshift64*: "An experimental exploration of Marsaglia's xorshift
+// generators, scrambled"
+// http://arxiv.org/abs/1402.6246
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+namespace util {
+	class xorshift {
+		public:
+			// Constructor.
+			xorshift(uint64_t seed);
+
+			// Seed.
+			void seed(uint64_t seed);
+
+			// Get next random number.
+			uint64_t next();
+
+		private:
+			uint64_t _M_state;
+	};
+
+	// Mix bits (splitmix64 finalizer).
+	static inline uint64_t splitmix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	inline xorshift::xorshift(uint64_t seed)
+	{
+		this->seed(seed);
+	}
+
+	inline void xorshift::seed(uint64_t seed)
+	{
+		// The state must be nonzero.
+		if ((_M_state = splitmix(seed)) == 0) {
+			_M_state = 0x9e3779b97f4a7c15ull;
+		}
+	}
+
+	inline uint64_t xorshift::next()
+	{
+		_M_state ^= _M_state >> 12;
+		_M_state ^= _M_state << 25;
+		_M_state ^= _M_state >> 27;
+
+		return _M_state * 0x2545f4914f6cdd1dull;
+	}
+
+	// Seed for the generator of the current thread.
+	static inline uint64_t thread_seed()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return ((static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec) ^
+		       splitmix(static_cast<uint64_t>(pthread_self()));
+	}
+
+	// Get random number from the generator of the current thread (seeded
+	// with the time and the thread id).
+	inline uint64_t thread_random()
+	{
+		static thread_local xorshift generator(thread_seed());
+
+		return generator.next();
+	}
+
+	// Get random level in [1, max_level] (max_level <= 32) for a skip list
+	// with p = 0.25: every pair of trailing zero bits adds one level and the
+	// sentinel bit limits the level to 'max_level'.
+	inline int random_level(int max_level)
+	{
+		return 1 + (__builtin_ctzll(thread_random() | (1ull << (2 * (max_level - 1)))) / 2);
+	}
+}
+
+#endif // UTIL_RANDOM_H
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util/uring_block_reader.h"
+
+util::uring_block_reader::~uring_block_reader()
+{
+	if (_M_slots) {
+		// Wait for the reads in flight (they still point to the
+		// buffers).
+		for (unsigned i = 0; i < _M_nslots; i++) {
+			while (_M_slots[i].in_flight) {
+				block_reader::error err;
+				if (!reap(-1, err)) {
+					break;
+				}
+			}
+		}
+
+		for (unsigned i = 0; i < _M_nslots; i++) {
+			// If the read couldn't be reaped, the kernel might still
+			// write into the buffer: leak it.
+			if (!_M_slots[i].in_flight) {
+				free(_M_slots[i].data);
+			}
+		}
+
+		free(_M_slots);
+	}
+
+	free(_M_carry);
+	free(_M_scratch);
+}
+
+bool util::uring_block_reader::init()
+{
+	static const size_t kAlignment = 4096;
+
+	if ((_M_next_offset = _M_file.offset()) < 0) {
+		return false;
+	}
+
+	_M_read_size = (MAX(_M_read_size, kAlignment) + kAlignment - 1) & ~(kAlignment - 1);
+
+	if (!_M_ring.init(_M_nslots)) {
+		return false;
+	}
+
+	if ((_M_slots = reinterpret_cast<slot*>(calloc(_M_nslots, sizeof(slot)))) == NULL) {
+		return false;
+	}
+
+	for (unsigned i = 0; i < _M_nslots; i++) {
+		void* p;
+		if (posix_memalign(&p, kAlignment, _M_read_size) != 0) {
+			return false;
+		}
+
+		slot& s = _M_slots[i];
+		s.data = reinterpret_cast<unsigned char*>(p);
+		s.offset = _M_next_offset;
+
+		_M_next_offset += _M_read_size;
+
+		if (!submit(s)) {
+			return false;
+		}
+	}
+
+	return _M_ring.submit();
+}
+
+bool util::uring_block_reader::next(block& block, int timeout, block_reader::error& err)
+{
+	if (!next_raw(block, timeout, err)) {
+		return false;
+	}
+
+	if (!block.verify()) {
+		err = block_reader::kCorruptBlock;
+		return false;
+	}
+
+	if (block.compressed()) {
+		if ((!_M_scratch) && ((_M_scratch = reinterpret_cast<unsigned char*>(malloc(block::kMaxSize))) == NULL)) {
+			err = block_reader::kNoMemory;
+			return false;
+		}
+
+		if (!block.decompress(_M_scratch, block)) {
+			err = block_reader::kCorruptBlock;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t util::uring_block_reader::next_batch(block* blocks, size_t max, int timeout, block_reader::error& err)
+{
+	if ((max == 0) || (!next(*blocks, timeout, err))) {
+		return 0;
+	}
+
+	size_t n = 1;
+
+	// Add the complete blocks in the current slot (the errors, if any,
+	// will be reported by the next call). Compressed blocks are not added,
+	// as they are decompressed into the same buffer.
+	slot& s = _M_slots[_M_current];
+
+	while (n < max) {
+		size_t avail = s.filled - s.pos;
+		if (avail < block::kMinSize) {
+			break;
+		}
+
+		const unsigned char* begin = s.data + s.pos;
+
+		blocklen_t block_size = util::block(begin).size();
+		util::block b(begin);
+		if ((block_size > avail) || (!b.valid_header(_M_checksums_required)) || (b.compressed()) || (!b.verify())) {
+			break;
+		}
+
+		blocks[n++] = b;
+
+		s.pos += block_size;
+	}
+
+	return n;
+}
+
+bool util::uring_block_reader::next_raw(block& block, int timeout, block_reader::error& err)
+{
+	// If the previous block was returned from the carry buffer...
+	if ((_M_carried > 0) && (_M_carried == _M_carry_len)) {
+		_M_carried = 0;
+		_M_carry_len = 0;
+	}
+
+	do {
+		slot& s = _M_slots[_M_current];
+
+		const unsigned char* begin = s.data + s.pos;
+		size_t avail = s.filled - s.pos;
+
+		if (avail == 0) {
+			if (!fill(0, timeout, err)) {
+				return false;
+			}
+
+			continue;
+		}
+
+		if (_M_carried == 0) {
+			if (avail >= block::kMinSize) {
+				util::block header(begin);
+				if (!check_header(header, err)) {
+					return false;
+				}
+
+				blocklen_t block_size = header.size();
+
+				// If the block is in the slot...
+				if (block_size <= avail) {
+					block = util::block(begin);
+
+					s.pos += block_size;
+					return true;
+				}
+			}
+
+			// If the rest of the slot hasn't been read yet...
+			if (s.filled < _M_read_size) {
+				if (!fill(avail, timeout, err)) {
+					return false;
+				}
+
+				continue;
+			}
+
+			// The block continues in the next slot.
+			if ((!_M_carry) && ((_M_carry = reinterpret_cast<unsigned char*>(malloc(block::kMaxSize))) == NULL)) {
+				err = block_reader::kNoMemory;
+				return false;
+			}
+		}
+
+		// Copy (the rest of) the header or the block.
+		size_t len = (_M_carried < block::kMinSize) ? block::kMinSize : _M_carry_len;
+		size_t n = MIN(len - _M_carried, avail);
+
+		memcpy(_M_carry + _M_carried, begin, n);
+
+		_M_carried += n;
+		s.pos += n;
+
+		// If the header is complete...
+		if ((_M_carry_len == 0) && (_M_carried == block::kMinSize)) {
+			util::block header(_M_carry);
+			if (!check_header(header, err)) {
+				return false;
+			}
+
+			_M_carry_len = header.size();
+		}
+
+		if (_M_carried == _M_carry_len) {
+			block = util::block(_M_carry);
+			return true;
+		}
+	} while (true);
+}
+
+bool util::uring_block_reader::fill(size_t avail, int timeout, block_reader::error& err)
+{
+	do {
+		slot& s = _M_slots[_M_current];
+
+		if (s.in_flight) {
+			if (!reap(timeout, err)) {
+				return false;
+			}
+		} else if (s.filled - s.pos > avail) {
+			return true;
+		} else if (s.filled == _M_read_size) {
+			// The slot has been consumed, reuse it for the next
+			// read.
+			s.offset = _M_next_offset;
+			s.filled = 0;
+			s.pos = 0;
+
+			_M_next_offset += _M_read_size;
+
+			if ((!submit(s)) || (!_M_ring.submit())) {
+				err = block_reader::kReadError;
+				return false;
+			}
+
+			_M_current = (_M_current + 1) % _M_nslots;
+
+			avail = 0;
+
+			// If the next slot reached the end of the file, the result
+			// might be stale (the file might have grown since), read it
+			// again.
+			slot& next = _M_slots[_M_current];
+			if ((!next.in_flight) && (next.res == 0) && (next.filled < _M_read_size)) {
+				if ((!submit(next)) || (!_M_ring.submit())) {
+					err = block_reader::kReadError;
+					return false;
+				}
+			}
+		} else {
+			// Short read. If the end of the file has been reached,
+			// report it; the file might grow, the rest of the slot
+			// will be read in the next call.
+			int res = s.res;
+
+			if ((res == 0) && (!s.eof)) {
+				s.eof = true;
+
+				err = block_reader::kEndOfFile;
+				return false;
+			}
+
+			s.eof = false;
+
+			if ((!submit(s)) || (!_M_ring.submit())) {
+				err = block_reader::kReadError;
+				return false;
+			}
+
+			if (res < 0) {
+				err = block_reader::kReadError;
+				return false;
+			}
+		}
+	} while (true);
+}
+
+bool util::uring_block_reader::submit(slot& s)
+{
+	if (!_M_ring.read(_M_file.fd(), s.data + s.filled, _M_read_size - s.filled, s.offset + s.filled, &s - _M_slots)) {
+		return false;
+	}
+
+	s.in_flight = true;
+
+	return true;
+}
+
+bool util::uring_block_reader::reap(int timeout, block_reader::error& err)
+{
+	if (!_M_ring.wait(timeout)) {
+		err = (errno == ETIMEDOUT) ? block_reader::kTimeout : block_reader::kReadError;
+		return false;
+	}
+
+	struct io_uring_cqe* cqe;
+	while ((cqe = _M_ring.peek()) != NULL) {
+		slot& s = _M_slots[cqe->user_data];
+
+		if ((s.res = cqe->res) > 0) {
+			s.filled += s.res;
+		}
+
+		s.in_flight = false;
+
+		_M_ring.seen();
+	}
+
+	return true;
+}
+
+bool util::uring_block_reader::check_header(const block& header, block_reader::error& err) const
+{
+	// If the block is too big...
+	if (header.size() > block::kMaxSize) {
+		err = block_reader::kBlockTooBig;
+		return false;
+	}
+
+	// If the header is invalid (e.g. torn write)...
+	if (!header.valid_header(_M_checksums_required)) {
+		err = block_reader::kCorruptBlock;
+		return false;
+	}
+
+	return true;
+}
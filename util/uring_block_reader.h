@@ -0,0 +1,146 @@
+#ifndef UTIL_URING_BLOCK_READER_H
+#define UTIL_URING_BLOCK_READER_H
+
+// Block reader which keeps several reads in flight with io_uring.
+//
+// The file is read in chunks of 'read_size' bytes into 'nbuffers' buffers;
+// while the blocks of one buffer are parsed, the reads of the next buffers
+// are already in progress, so parsing overlaps with the disk I/O.
+//
+// The blocks point straight into the buffers (only the blocks which span
+// two buffers are copied). A block remains valid until the next call to
+// next() / next_batch().
+
+#include "util/block_reader.h"
+#include "fs/file.h"
+#include "fs/uring.h"
+
+namespace util {
+	class uring_block_reader {
+		public:
+			static const unsigned kDefaultNumberBuffers = 3;
+			static const size_t kDefaultReadSize = 1024 * 1024;
+
+			// Constructor.
+			uring_block_reader(fs::file& file, unsigned nbuffers = kDefaultNumberBuffers, size_t read_size = kDefaultReadSize);
+
+			// Destructor.
+			~uring_block_reader();
+
+			// Initialize (starts reading from the current offset of the
+			// file).
+			bool init();
+
+			// Get next block (the checksums are verified and the
+			// compressed blocks are decompressed into an internal
+			// buffer).
+			bool next(block& block, int timeout);
+			bool next(block& block, int timeout, block_reader::error& err);
+
+			// Get up to 'max' blocks: the next block plus the complete
+			// blocks which are already in the current buffer.
+			// Returns the number of blocks (0 on error).
+			size_t next_batch(block* blocks, size_t max, int timeout);
+			size_t next_batch(block* blocks, size_t max, int timeout, block_reader::error& err);
+
+			// Reject the blocks without checksum (except the file
+			// header and the sync blocks).
+			void require_checksums(bool required);
+
+		private:
+			struct slot {
+				unsigned char* data;
+
+				// Offset in the file.
+				off_t offset;
+
+				// Number of bytes read.
+				size_t filled;
+
+				// Number of bytes consumed.
+				size_t pos;
+
+				// Result of the last read.
+				int res;
+
+				bool in_flight;
+
+				// Has the end of file been reported?
+				bool eof;
+			};
+
+			fs::file& _M_file;
+			fs::uring _M_ring;
+
+			slot* _M_slots;
+			unsigned _M_nslots;
+
+			size_t _M_read_size;
+
+			// Slot being consumed.
+			unsigned _M_current;
+
+			// Offset of the next read.
+			off_t _M_next_offset;
+
+			// Block which spans several slots.
+			unsigned char* _M_carry;
+			size_t _M_carried;
+			size_t _M_carry_len;
+
+			// Buffer for decompressing blocks.
+			unsigned char* _M_scratch;
+
+			bool _M_checksums_required;
+
+			// Get next block (without decompressing it).
+			bool next_raw(block& block, int timeout, block_reader::error& err);
+
+			// Wait until the current slot has more than 'avail' bytes
+			// to consume.
+			bool fill(size_t avail, int timeout, block_reader::error& err);
+
+			// Read the rest of the slot.
+			bool submit(slot& s);
+
+			// Process completions ('timeout' in milliseconds).
+			bool reap(int timeout, block_reader::error& err);
+
+			// Check block header.
+			bool check_header(const block& header, block_reader::error& err) const;
+	};
+
+	inline uring_block_reader::uring_block_reader(fs::file& file, unsigned nbuffers, size_t read_size)
+		: _M_file(file),
+		  _M_slots(NULL),
+		  _M_nslots(MAX(nbuffers, 1)),
+		  _M_read_size(read_size),
+		  _M_current(0),
+		  _M_next_offset(0),
+		  _M_carry(NULL),
+		  _M_carried(0),
+		  _M_carry_len(0),
+		  _M_scratch(NULL),
+		  _M_checksums_required(false)
+	{
+	}
+
+	inline bool uring_block_reader::next(block& block, int timeout)
+	{
+		block_reader::error err;
+		return next(block, timeout, err);
+	}
+
+	inline size_t uring_block_reader::next_batch(block* blocks, size_t max, int timeout)
+	{
+		block_reader::error err;
+		return next_batch(blocks, max, timeout, err);
+	}
+
+	inline void uring_block_reader::require_checksums(bool required)
+	{
+		_M_checksums_required = required;
+	}
+}
+
+#endif // UTIL_URING_BLOCK_READER_H